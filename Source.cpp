@@ -3,289 +3,152 @@
 #include<random>
 #include<string>
 #include<ctime>
+#include<cstdio>
 //#include<sys\timeb.h>
 #include<chrono>
-#include "pricingservice.hpp"
-#include "guiservice.hpp"
-#include "streamingAlgoservice.hpp"
-#include "historicaldataservice.hpp"
-#include "executionAlgoservice.hpp"
+#include<thread>
+#include<atomic>
+#include<memory>
+#include<csignal>
+#include "tradingsystem.hpp"
+#include "followfeedsource.hpp"
+#include "socketfeedsource.hpp"
+#include "feedgenerator.hpp"
+#include "alloccounter.hpp"
+#include "latency.hpp"
 
 using namespace std;
 
-vector<string> bond_type = { "2Y","3Y","5Y","7Y","10Y","30Y" };
-
-void create_prices(int n)
+// Signal handler asking for a latency report while the feeds run
+void request_latency_report(int)
 {
-	cout << "Creating price data......" << endl;
-	ofstream f;
-	f.open("price.txt");
-	//f << "type, mid, spread" << endl;
-	for (int i = 0; i < 6; i++)
-	{
-		cout << i << endl;
-		for (int j = 0; j < n; j++)
-		{
-			int x1 = 99 + rand() % 2;
-			int x2 = rand() % 32;
-			int x3 = rand() % 8;
-			string s1 = to_string(x1) + '-';
-			string s2, s3;
-			if (x2 < 10)
-				s2 = '0' + to_string(x2);
-			else
-				s2 = to_string(x2);
-			if (x3 == 4)
-				s3 = "+";
-			else
-				s3 = to_string(x3);
-			string mid = s1 + s2 + s3;
-			int x4 = 2 + rand() % 3;
-			string spread;
-			if (x4 == 4)
-				spread = "0-00+";
-			else
-				spread = "0-00" + to_string(x4);
-			f << bond_type[i] << "," << mid << "," << spread << endl;
-
-		}
-	}
-	cout << "Creating data done!" << endl;
+	LatencyTracer::Instance().RequestReport();
 }
 
-string timestamp()
-{
-	using namespace chrono;
-	auto now = system_clock::now();
-	auto sec = time_point_cast<seconds>(now);
-	auto millisec = duration_cast<milliseconds>(now - sec);
-	string m = to_string(millisec.count());
-	if (millisec.count() > 100);
-	else if (millisec.count() > 10)
-		m = "0" + m;
-	else
-		m = "00" + m;
-	
-	time_t tv = system_clock::to_time_t(now);
-	tm *local;
-	local = localtime(&tv);
-	/*char temp[50];
-	strftime(temp, 50, "%F %T", localtime(&tv));*/
-
-	string timestamp = "2018 "+string(asctime(local)).substr(4,15) + "." + m;
-	
+// Set by SIGINT to end --follow and --market
+volatile sig_atomic_t stop_following = 0;
 
-	return timestamp;
+// Signal handler asking the followed and socket feeds to stop
+void request_stop(int)
+{
+	stop_following = 1;
 }
 
-void create_trades()
+int main(int argc, char *argv[])
 {
-	cout << "Creating trade data......" << endl;
-	ofstream f;
-	f.open("trades.txt");
-	//f << "type, mid, spread" << endl;
-	for (int i = 0; i < 6; i++)
+	// With --follow the feeds are not generated: they are read as they stand and then
+	// followed as an upstream process appends to them, until interrupted. With
+	// --market ADDRESS order books are read from a socket served there, such as by
+	// tradingfeedsim, instead of from market.txt. With --binary-history the historical
+	// stores are written as binary records (*.bin), which tradingconvert turns into text.
+	bool follow = false;
+	bool binaryhistory = false;
+	string marketaddress;
+	for (int i = 1; i < argc; i++)
 	{
-		cout << i << endl;
-		for (int j = 0; j < 10; j++)
+		string option = argv[i];
+		if (option == "--follow")
+			follow = true;
+		else if (option == "--market" && i + 1 < argc)
+			marketaddress = argv[++i];
+		else if (option == "--binary-history")
+			binaryhistory = true;
+		else
 		{
-			string id = to_string(i * 10 + j + 1);
-			int x1 = 99 + rand() % 2;
-			int x2 = rand() % 32;
-			int x3 = rand() % 8;
-			string s1 = to_string(x1) + '-';
-			string s2, s3;
-			if (x2 < 10)
-				s2 = '0' + to_string(x2);
-			else
-				s2 = to_string(x2);
-			if (x3 == 4)
-				s3 = "+";
-			else
-				s3 = to_string(x3);
-			string price = s1 + s2 + s3;
-			int r = rand() % 3;
-			string book;
-			if (r == 0)
-				book = "TRSY1";
-			else if (r == 1)
-				book = "TRSY2";
-			else
-				book = "TRSY3";
-			string side;
-			if (j % 2 == 0)
-				side = "BUY";
-			else
-				side = "SELL";
-			int q = 1000000 * (j % 5 + 1);
-			f << bond_type[i] << "," << id << "," << price << "," << to_string(q) << "," << book << "," << side << endl;
-
+			cerr << "usage: tradingsystem [--follow] [--market unix:PATH|tcp:HOST:PORT] [--binary-history]" << endl;
+			return 1;
 		}
 	}
-	cout << "Creating trade done!" << endl;
-
+	if (!follow)
+	{
+		// Seeded feeds for the products in bonds.txt, the same on every run. Book
+		// levels quote scattered mids, so some books cross and the execution algo trades.
+		ifstream reference("bonds.txt");
+		FeedGeneratorConfig config;
+		config.threads = thread::hardware_concurrency();
+		config.levelJitter = 16;
+		FeedGenerator generator(FeedGenerator::ReadProductIds(reference), config);
+		cout << "Creating data......" << endl;
+		generator.WritePrices("price.txt", 606);
+		generator.WriteTrades("trades.txt", 60);
+		generator.WriteMarket("market.txt", 120);
+		generator.WriteInquiries("inquiry.txt", 60);
+		cout << "Creating data done!" << endl;
+	}
 
+	// Reference data is loaded once, before any service or feed looks up a product
+	ifstream bondfile("bonds.txt");
+	ProductRegistry<Bond>::Instance().Load(bondfile);
 
+	TradingSystem<Bond> tradingsystem;
+	if (binaryhistory)
+		tradingsystem.SetHistoryFormat(BINARY_RECORDS);
 
-}
-void create_market(int n)
-{
-	cout << "Creating market data......" << endl;
-	ofstream f;
-	f.open("market.txt");
-	//f << "type, mid, spread" << endl;
-	for (int i = 0; i < 6; i++)
+	// The feeds are memory-mapped and read in place, or followed
+	const char *feedpaths[] = { "price.txt", "trades.txt", "market.txt", "inquiry.txt" };
+	unique_ptr<FeedSource> feeds[4];
+	vector<FollowFeedSource*> followed;
+	SocketFeedSource *marketsocket = nullptr;
+	for (int i = 0; i < 4; i++)
 	{
-		cout << i << endl;
-		for (int j = 0; j < n; j++)
+		if (i == 2 && !marketaddress.empty())
 		{
-			int x1 = 99 + rand() % 2;
-			int x2 = rand() % 32;
-			int x3 = rand() % 8;
-			string s1 = to_string(x1) + '-';
-			string s2, s3;
-			if (x2 < 10)
-				s2 = '0' + to_string(x2);
-			else
-				s2 = to_string(x2);
-			if (x3 == 4)
-				s3 = "+";
-			else
-				s3 = to_string(x3);
-			string mid = s1 + s2 + s3;
-			int x4 = 8 - abs(j % 6 - 3) * 2;
-			string spread;
-			
-			if (x4 == 4)
-				spread = "0-00+";
-			else
-				spread = "0-00" + to_string(x4);
-
-			long position = 1000000;
-			position = position * (j % 5 + 1);
-			f << bond_type[i] << "," << mid << "," << spread <<"," <<to_string(position)<<endl;
-
+			marketsocket = new SocketFeedSource(marketaddress);
+			feeds[i].reset(marketsocket);
+			if (!marketsocket->IsOpen())
+			{
+				cerr << "cannot connect to " << marketaddress << endl;
+				return 1;
+			}
 		}
-	}
-	cout << "Creating data done!" << endl;
-}
-
-void create_inquiry()
-{
-	cout << "Creating inquiry data......" << endl;
-	ofstream f;
-	f.open("inquiry.txt");
-	//f << "type, mid, spread" << endl;
-	for (int i = 0; i < 6; i++)
-	{
-		cout << i << endl;
-		for (int j = 0; j < 5; j++)
+		else if (follow)
 		{
-			int x1 = 99 + rand() % 2;
-			int x2 = rand() % 32;
-			int x3 = rand() % 8;
-			string s1 = to_string(x1) + '-';
-			string s2, s3;
-			if (x2 < 10)
-				s2 = '0' + to_string(x2);
-			else
-				s2 = to_string(x2);
-			if (x3 == 4)
-				s3 = "+";
-			else
-				s3 = to_string(x3);
-			string mid = s1 + s2 + s3;
-			int x4 = 8 - abs(j % 6 - 3) * 2;
-			string spread;
-
-			if (x4 == 4)
-				spread = "0-00+";
-			else
-				spread = "0-00" + to_string(x4);
-			string buy = "BUY";
-			string sell = "SELL";
-			long position = 1000000;
-			position = position * (j % 5 + 1);
-			f << bond_type[i] << "," << buy << "," << to_string(position)<<"," << mid << "," << spread << "," << "RECEIVED" << endl;
-			f << bond_type[i] << "," << sell << "," << to_string(position) <<","<< mid << "," << spread << "," << "RECEIVED" << endl;
-
+			FollowFeedSource *feed = new FollowFeedSource(feedpaths[i]);
+			followed.push_back(feed);
+			feeds[i].reset(feed);
 		}
+		else
+			feeds[i].reset(new MappedFeedSource(feedpaths[i]));
 	}
-	cout << "Creating data done!" << endl;
-}
-
-
-
-
-
-
-int main()
-{
-	create_prices(101);
-	create_trades();
-	create_market(100);
-	create_inquiry();
-	PricingService<Bond> pricingservice;
-	GuiService<Bond> guiservice;
-	StreamingAlgoService<Bond> streamingalgoservice;
-	StreamingService<Bond> streamingservice;
-
-
-	TradeBookingService<Bond> tradebookingservice;
-	PositionService<Bond> positionservice;
-	RiskService<Bond> riskservice;
-
-
-	MarketDataService<Bond> marketdataservice;
-	ExecutionService<Bond> executionservice;
-	ExecutionAlgoService<Bond> executionalgoservice;
-
-
-	InquiryService<Bond> inquiryservice;
-
-
-	HistoricalDataServiceStream<Bond> historicaldataservicestream;
-	HistoricalDataServicePosition<Bond> historicaldataserviceposition;
-	HistoricalDataServiceRisk<Bond> historicaldataservicerisk;
-	HistoricalDataServiceExecution<Bond> historicaldataserviceexecution;
-	HistoricalDataServiceInquiry<Bond> historicaldataserviceinquiry;
-
-	
-	pricingservice.AddListener(guiservice.GetListener());
-	pricingservice.AddListener(streamingalgoservice.GetListener());
-	streamingalgoservice.AddListener(streamingservice.GetListener());
-	streamingservice.AddListener(historicaldataservicestream.GetListener());
-
-	ifstream pricefile("price.txt");
-	ifstream tradefile("trades.txt");
-	ifstream marketfile("market.txt");
-	ifstream inquiryfile("inquiry.txt");
-
-	tradebookingservice.AddListener(positionservice.GetListener());
-	positionservice.AddListener(historicaldataserviceposition.GetListener());
-	positionservice.AddListener(riskservice.GetListener());
-	
-	riskservice.AddListener(historicaldataservicerisk.GetListener());
-	riskservice.AddListenerB(historicaldataservicerisk.GetListenerB());
-
-	marketdataservice.AddListener(executionalgoservice.GetListener());
-	executionalgoservice.AddListener(executionservice.GetListener());
-	executionservice.AddListener(historicaldataserviceexecution.GetListener());
-	executionservice.AddListener(tradebookingservice.GetListener());
-
-	inquiryservice.AddListener(historicaldataserviceinquiry.GetListener());
-
+	if (follow || marketsocket)
+		signal(SIGINT, request_stop);
+
+	// A latency report can be asked for while the feeds run (kill -USR1 on POSIX)
+#ifdef SIGUSR1
+	signal(SIGUSR1, request_latency_report);
+#endif
+	atomic<bool> feedsdone(false);
+	thread reporter([&] {
+		while (!feedsdone.load())
+		{
+			this_thread::sleep_for(chrono::milliseconds(100));
+			if (LatencyTracer::Instance().ReportRequested())
+				LatencyTracer::Instance().Report(cout);
+			if (stop_following)
+			{
+				for (FollowFeedSource *feed : followed)
+					feed->Stop();
+				if (marketsocket)
+					marketsocket->Stop();
+			}
+		}
+	});
 
-	pricingservice.GetConnector()->Subscribe(pricefile);
-	tradebookingservice.GetConnector()->Subscribe(tradefile);
-	marketdataservice.GetConnector()->Subscribe(marketfile);
-	inquiryservice.GetConnector()->Subscribe(inquiryfile);
+	tradingsystem.Run(*feeds[0], *feeds[1], *feeds[2], *feeds[3]);
+	feedsdone = true;
+	reporter.join();
 	cout << "price gui done" << endl;
+	LatencyTracer::Instance().Report(cout);
+	if (AllocationCounter::Enabled())
+		cout << "heap allocations on event paths: " << AllocationCounter::Counted()
+			<< " (" << AllocationCounter::Total() << " in total)" << endl;
 	
 	
 	
 	
+#ifdef _WIN32
 	system("pause");
+#endif
 
 
 	return 0;
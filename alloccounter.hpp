@@ -0,0 +1,228 @@
+/**
+ * alloccounter.hpp
+ * Debug counter for heap allocations made while events are processed.
+ *
+ * Build with TRADING_COUNT_ALLOCS defined to replace the global operator new, the
+ * aligned forms included, and count allocations; without it every call here compiles
+ * to nothing and Enabled() is false. The replacement operators are defined in this
+ * header, so with the flag on include it from exactly one translation unit per program.
+ */
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+/**
+ * Process-wide allocation counts.
+ * Total() counts every allocation. Counted() only counts allocations made on a
+ * thread inside an AllocationRegion and outside any AllocationExempt, which is how
+ * the event paths are measured without the feed parsing and file writing at their ends.
+ */
+class AllocationCounter
+{
+
+public:
+
+  // Get whether allocations are being counted in this build
+  static bool Enabled()
+  {
+#ifdef TRADING_COUNT_ALLOCS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // Get the number of allocations since startup
+  static long Total() { return State().total.load(memory_order_relaxed); }
+
+  // Get the number of allocations made inside regions
+  static long Counted() { return State().counted.load(memory_order_relaxed); }
+
+  // Record one allocation on the calling thread
+  static void Record()
+  {
+    Counters &state = State();
+    state.total.fetch_add(1, memory_order_relaxed);
+    if (Region() > 0 && Exempt() == 0)
+      state.counted.fetch_add(1, memory_order_relaxed);
+  }
+
+  // Get this thread's region nesting depth
+  static int& Region()
+  {
+    static thread_local int depth = 0;
+    return depth;
+  }
+
+  // Get this thread's exemption nesting depth
+  static int& Exempt()
+  {
+    static thread_local int depth = 0;
+    return depth;
+  }
+
+private:
+  struct Counters
+  {
+    atomic<long> total;
+    atomic<long> counted;
+  };
+
+  static Counters& State()
+  {
+    static Counters state{ {0}, {0} };
+    return state;
+  }
+
+};
+
+/**
+ * Marks the enclosing scope as event processing: allocations in it are counted.
+ */
+class AllocationRegion
+{
+
+public:
+
+#ifdef TRADING_COUNT_ALLOCS
+  AllocationRegion() { AllocationCounter::Region()++; }
+  ~AllocationRegion() { AllocationCounter::Region()--; }
+#else
+  AllocationRegion() {}
+#endif
+
+  AllocationRegion(const AllocationRegion&) = delete;
+  AllocationRegion& operator=(const AllocationRegion&) = delete;
+
+};
+
+/**
+ * Excludes the enclosing scope from an AllocationRegion, for sinks such as file writers.
+ */
+class AllocationExempt
+{
+
+public:
+
+#ifdef TRADING_COUNT_ALLOCS
+  AllocationExempt() { AllocationCounter::Exempt()++; }
+  ~AllocationExempt() { AllocationCounter::Exempt()--; }
+#else
+  AllocationExempt() {}
+#endif
+
+  AllocationExempt(const AllocationExempt&) = delete;
+  AllocationExempt& operator=(const AllocationExempt&) = delete;
+
+};
+
+#ifdef TRADING_COUNT_ALLOCS
+
+// The replacement operators allocate and free only through these, kept out of line
+// so the compiler pairs each operator delete with its operator new rather than
+// seeing free called on memory from new. An alignment of 0 is the default one.
+#ifdef _MSC_VER
+#define ALLOC_COUNTER_NOINLINE __declspec(noinline)
+#else
+#define ALLOC_COUNTER_NOINLINE __attribute__((noinline))
+#endif
+
+ALLOC_COUNTER_NOINLINE void* CountedAllocate(size_t size, size_t alignment)
+{
+  AllocationCounter::Record();
+  if (size == 0)
+    size = 1;
+  if (alignment == 0)
+    return malloc(size);
+#ifdef _WIN32
+  return _aligned_malloc(size, alignment);
+#else
+  // aligned_alloc takes sizes in whole multiples of the alignment
+  return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+ALLOC_COUNTER_NOINLINE void CountedFree(void *p, size_t alignment)
+{
+#ifdef _WIN32
+  if (alignment != 0)
+  {
+    _aligned_free(p);
+    return;
+  }
+#else
+  (void)alignment;
+#endif
+  free(p);
+}
+
+void* operator new(size_t size)
+{
+  void *p = CountedAllocate(size, 0);
+  if (!p)
+    throw bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+  return CountedAllocate(size, 0);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+  return CountedAllocate(size, 0);
+}
+
+void* operator new(size_t size, align_val_t alignment)
+{
+  void *p = CountedAllocate(size, size_t(alignment));
+  if (!p)
+    throw bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size, align_val_t alignment)
+{
+  return operator new(size, alignment);
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+  return CountedAllocate(size, size_t(alignment));
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+  return CountedAllocate(size, size_t(alignment));
+}
+
+void operator delete(void *p) noexcept { CountedFree(p, 0); }
+void operator delete[](void *p) noexcept { CountedFree(p, 0); }
+void operator delete(void *p, size_t) noexcept { CountedFree(p, 0); }
+void operator delete[](void *p, size_t) noexcept { CountedFree(p, 0); }
+void operator delete(void *p, const nothrow_t&) noexcept { CountedFree(p, 0); }
+void operator delete[](void *p, const nothrow_t&) noexcept { CountedFree(p, 0); }
+void operator delete(void *p, align_val_t alignment) noexcept { CountedFree(p, size_t(alignment)); }
+void operator delete[](void *p, align_val_t alignment) noexcept { CountedFree(p, size_t(alignment)); }
+void operator delete(void *p, size_t, align_val_t alignment) noexcept { CountedFree(p, size_t(alignment)); }
+void operator delete[](void *p, size_t, align_val_t alignment) noexcept { CountedFree(p, size_t(alignment)); }
+void operator delete(void *p, align_val_t alignment, const nothrow_t&) noexcept { CountedFree(p, size_t(alignment)); }
+void operator delete[](void *p, align_val_t alignment, const nothrow_t&) noexcept { CountedFree(p, size_t(alignment)); }
+
+#endif
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * asynclistener.hpp
+ * Defines an asynchronous ServiceListener adapter that decouples a Service
+ * from a slow listener through a lock-free SPSC queue and a consumer thread.
+ */
+#ifndef ASYNC_LISTENER_HPP
+#define ASYNC_LISTENER_HPP
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "soa.hpp"
+#include "spscqueue.hpp"
+#include "alloccounter.hpp"
+#include "latency.hpp"
+
+using namespace std;
+
+// Kind of listener callback carried across an asynchronous edge
+enum AsyncEventKind { ASYNC_ADD, ASYNC_REMOVE, ASYNC_UPDATE };
+
+/**
+ * A listener callback queued on an asynchronous edge.
+ * Type V is the data type of the edge.
+ */
+template<typename V>
+struct AsyncEvent
+{
+  AsyncEventKind kind;
+  V data;
+  LatencyContext trace;
+};
+
+/**
+ * Listener adapter that makes one Service -> ServiceListener edge asynchronous.
+ * Register it on the upstream Service in place of the wrapped listener; callbacks are
+ * copied into a bounded ring buffer and replayed on a dedicated consumer thread, in order.
+ * The upstream Service must invoke this listener from a single thread.
+ * When the ring buffer is full the producer spins until the consumer catches up.
+ * Type V is the data type of the edge.
+ */
+template<typename V>
+class AsyncListener : public ServiceListener<V>
+{
+
+public:
+
+  // ctor wrapping a listener; starts the consumer thread
+  AsyncListener(ServiceListener<V> *_listener, size_t capacity = 4096);
+  ~AsyncListener();
+
+  // Listener callback to process an add event to the Service
+  virtual void ProcessAdd(V &data) { Enqueue(ASYNC_ADD, data); }
+
+  // Listener callback to process a remove event to the Service
+  virtual void ProcessRemove(V &data) { Enqueue(ASYNC_REMOVE, data); }
+
+  // Listener callback to process an update event to the Service
+  virtual void ProcessUpdate(V &data) { Enqueue(ASYNC_UPDATE, data); }
+
+  // Deliver everything already queued and stop the consumer thread
+  void Stop();
+
+  // Get the wrapped listener
+  ServiceListener<V>* GetListener() const { return listener; }
+
+private:
+  ServiceListener<V> *listener;
+  SPSCQueue<AsyncEvent<V>> queue;
+  AsyncEvent<V> pending;
+  atomic<bool> running;
+  thread consumer;
+
+  void Enqueue(AsyncEventKind kind, V &data);
+  void Run();
+  void Dispatch(AsyncEvent<V> &event);
+
+};
+
+template<typename V>
+AsyncListener<V>::AsyncListener(ServiceListener<V> *_listener, size_t capacity) :
+  listener(_listener), queue(capacity), running(true)
+{
+  consumer = thread(&AsyncListener<V>::Run, this);
+}
+
+template<typename V>
+AsyncListener<V>::~AsyncListener()
+{
+  Stop();
+}
+
+template<typename V>
+void AsyncListener<V>::Stop()
+{
+  running.store(false, memory_order_release);
+  if (consumer.joinable())
+    consumer.join();
+}
+
+template<typename V>
+void AsyncListener<V>::Enqueue(AsyncEventKind kind, V &data)
+{
+  pending.kind = kind;
+  pending.data = data;
+  pending.trace = LatencyTrace::Current();
+  while (!queue.TryPush(pending))
+    this_thread::yield();
+}
+
+template<typename V>
+void AsyncListener<V>::Dispatch(AsyncEvent<V> &event)
+{
+  AllocationRegion region;
+  LatencyResume resume(event.trace);
+  switch (event.kind)
+  {
+  case ASYNC_ADD:
+    listener->ProcessAdd(event.data);
+    break;
+  case ASYNC_REMOVE:
+    listener->ProcessRemove(event.data);
+    break;
+  case ASYNC_UPDATE:
+    listener->ProcessUpdate(event.data);
+    break;
+  }
+}
+
+template<typename V>
+void AsyncListener<V>::Run()
+{
+  AsyncEvent<V> event;
+  long idle = 0;
+  while (true)
+  {
+    if (queue.TryPop(event))
+    {
+      Dispatch(event);
+      idle = 0;
+      continue;
+    }
+    if (!running.load(memory_order_acquire))
+    {
+      // The producer has stopped; drain whatever it pushed before Stop()
+      while (queue.TryPop(event))
+        Dispatch(event);
+      return;
+    }
+    // Spin briefly for low wake-up latency, then back off so an idle edge does not hold a core
+    if (++idle < 1000)
+      continue;
+    else if (idle < 2000)
+      this_thread::yield();
+    else
+      this_thread::sleep_for(chrono::microseconds(50));
+  }
+}
+
+#endif
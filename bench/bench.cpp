@@ -0,0 +1,972 @@
+/**
+ * bench.cpp
+ * Throughput and latency benchmarks for each stage of the trading system,
+ * run over generated feeds of configurable size.
+ *
+ * Usage: tradingbench [--ticks N] [--products N] [--trades N] [--inquiries N]
+ *                     [--ops N] [--risk-ops N] [--writes N] [--pipeline-ticks N]
+ *                     [--follow-ticks N] [--threads N] [--seed N] [--dir PATH]
+ *                     [--stages a,b,...] [--format json|csv] [--out FILE]
+ *
+ * Feeds come from FeedGenerator (feedgenerator.hpp), seeded by --seed, and the
+ * generate stages time it writing each feed.
+ *
+ * Every stage reports ops, wall seconds and ops per second. Stages that time each
+ * operation also report mean, p50, p99, p99.9 and max in nanoseconds; the per-op
+ * figures include the cost of reading the clock twice (a few nanoseconds).
+ * The subscribe stages time a whole memory-mapped feed through one connector and
+ * its service, with no listeners attached; subscribe.pricing.stream reads the same
+ * feed through an ifstream for comparison, and subscribe.pricing.binary reads it
+ * converted to binary records; subscribe.pricing.parallel parses it on --threads
+ * threads. subscribe.market.updates moves books as often as subscribe.market does,
+ * but as incremental level updates. The follow stages report how long a price appended to
+ * a followed file takes to come out of the pricing service, and the socket stages
+ * how long an order book written to a Unix domain or TCP loopback socket takes to
+ * come out of the market data service. The pipeline stage runs
+ * the fully wired system and reports the end-to-end latency of each feed -> sink path.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <filesystem>
+#include <cstdio>
+#include <cstdlib>
+#include "../tradingsystem.hpp"
+#include "../latency.hpp"
+#include "../followfeedsource.hpp"
+#include "../socketfeedsource.hpp"
+#include "../feedgenerator.hpp"
+
+using namespace std;
+
+// Sizes and output of one benchmark run
+struct BenchConfig
+{
+  size_t ticks = 1000000;
+  size_t products = 1000;
+  size_t trades = 1000000;
+  size_t inquiries = 100000;
+  size_t ops = 1000000;
+  size_t riskOps = 10000;
+  size_t writes = 100000;
+  size_t pipelineTicks = 100000;
+  size_t followTicks = 10000;
+  size_t threads = thread::hardware_concurrency();
+  unsigned long long seed = 1;
+  string dir = "bench_work";
+  string stages;
+  string format = "json";
+  string out;
+};
+
+// Measurements for one stage; the percentiles are only set when sampled
+struct StageResult
+{
+  string stage;
+  uint64_t ops = 0;
+  double seconds = 0;
+  bool sampled = false;
+  double meanNs = 0;
+  double p50Ns = 0;
+  double p99Ns = 0;
+  double p999Ns = 0;
+  double maxNs = 0;
+};
+
+// Fill in per-op figures from a histogram of TickClock ticks
+void Summarize(StageResult &result, const LatencyHistogram &histogram, double nanosPerTick)
+{
+  result.sampled = true;
+  result.meanNs = result.ops ? result.seconds * 1e9 / double(result.ops) : 0;
+  result.p50Ns = histogram.GetPercentile(50) * nanosPerTick;
+  result.p99Ns = histogram.GetPercentile(99) * nanosPerTick;
+  result.p999Ns = histogram.GetPercentile(99.9) * nanosPerTick;
+  result.maxNs = histogram.GetMax() * nanosPerTick;
+}
+
+// Run op(i) for i in [0, ops), timing each call
+template<typename F>
+StageResult TimeEach(const string &stage, size_t ops, F op)
+{
+  LatencyHistogram histogram;
+  auto start = chrono::steady_clock::now();
+  for (size_t i = 0; i < ops; i++)
+  {
+    uint64_t begin = TickClock::Now();
+    op(i);
+    histogram.Record(TickClock::Now() - begin);
+  }
+  StageResult result;
+  result.stage = stage;
+  result.ops = ops;
+  result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  Summarize(result, histogram, TickClock::NanosPerTick());
+  return result;
+}
+
+// Run body() once and charge it with the given number of ops
+template<typename F>
+StageResult TimeWhole(const string &stage, size_t ops, F body)
+{
+  auto start = chrono::steady_clock::now();
+  body();
+  StageResult result;
+  result.stage = stage;
+  result.ops = ops;
+  result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+// Keeps benchmarked results alive so the work is not optimized away
+volatile double sink;
+
+//--------------------------------------------Data generation--------------------------------------------
+
+/**
+ * Draws the in-memory prices, books and trades the direct stages time, for the
+ * products the feeds are generated for. The same seed always draws the same data.
+ */
+class BenchData
+{
+
+public:
+
+  BenchData(size_t _products, unsigned long long seed) :
+    products(_products), rng(seed)
+  {
+  }
+
+  // Register reference data for every product
+  void RegisterProducts()
+  {
+    for (size_t i = 0; i < products; i++)
+      ProductRegistry<Bond>::Instance().Add(Bond(FeedGenerator::SyntheticProductId(i), CUSIP, "T",
+        float(1 + i % 40 * 0.125), date(2019 + int(i % 30), 1 + int(i % 12), 15)));
+  }
+
+  // Get a price in fractional notation: 99-00 to 100-31 plus an eighth of a 32nd
+  string Price()
+  {
+    char price[16];
+    int handle = 99 + int(rng() % 2);
+    int ticks = int(rng() % 32);
+    int eighth = int(rng() % 8);
+    if (eighth == 4)
+      snprintf(price, sizeof(price), "%d-%02d+", handle, ticks);
+    else
+      snprintf(price, sizeof(price), "%d-%02d%d", handle, ticks, eighth);
+    return price;
+  }
+
+  // Get a bid/offer spread of 1/128 to 1/64
+  string Spread()
+  {
+    int eighth = 2 + int(rng() % 3);
+    return eighth == 4 ? "0-00+" : "0-00" + to_string(eighth);
+  }
+
+  // Get a random order book for a product, with the given number of levels a side
+  OrderBook<Bond> Book(const Bond &bond, int levels)
+  {
+    vector<Order> bids;
+    vector<Order> offers;
+    for (int level = 0; level < levels; level++)
+    {
+      FixedPrice mid = FixedPrice::FromTicks(99 * TICKS_PER_POINT + int64_t(rng() % 512));
+      FixedPrice spread = FixedPrice::FromTicks(int64_t(2 + rng() % 3));
+      long quantity = 1000000 * (level % 5 + 1);
+      bids.push_back(Order(mid - spread.Half(), quantity, BID));
+      offers.push_back(Order(mid + spread.Half(), quantity, OFFER));
+    }
+    return OrderBook<Bond>(bond, bids, offers);
+  }
+
+  // Get a venue's book of the given number of adjacent levels a side around 100
+  OrderBook<Bond> DeepBook(const Bond &bond, int levels, Market venue = BROKERTEC)
+  {
+    vector<Order> bids;
+    vector<Order> offers;
+    for (int level = 0; level < levels; level++)
+    {
+      bids.push_back(Order(FixedPrice::FromTicks(100 * TICKS_PER_POINT - 1 - level), 1000000, BID));
+      offers.push_back(Order(FixedPrice::FromTicks(100 * TICKS_PER_POINT + 1 + level), 1000000, OFFER));
+    }
+    return OrderBook<Bond>(bond, bids, offers, venue);
+  }
+
+  // Get a random add, resize or delete of a level of a venue's DeepBook, within the
+  // given number of ticks of its inside
+  OrderBookUpdate<Bond> RandomUpdate(const Bond &bond, int ticks, Market venue = BROKERTEC)
+  {
+    PricingSide side = rng() % 2 ? BID : OFFER;
+    int64_t offset = 1 + int64_t(rng() % uint64_t(ticks));
+    int64_t tick = 100 * TICKS_PER_POINT + (side == BID ? -offset : offset);
+    long quantity = long(1000000 * (1 + rng() % 5));
+    return OrderBookUpdate<Bond>(bond, BookAction(rng() % 3), Order(FixedPrice::FromTicks(tick), quantity, side), venue);
+  }
+
+  // Get a random trade
+  Trade<Bond> RandomTrade(size_t i)
+  {
+    static const char *books[] = { "TRSY1", "TRSY2", "TRSY3" };
+    const Bond &bond = ProductRegistry<Bond>::Instance().Get(FeedGenerator::SyntheticProductId(rng() % products));
+    return Trade<Bond>(bond, "T" + to_string(i + 1), FixedPrice::FromTicks(99 * TICKS_PER_POINT + int64_t(rng() % 512)), books[rng() % 3],
+      long(1000000 * (i % 5 + 1)), i % 2 == 0 ? BUY : SELL);
+  }
+
+private:
+  size_t products;
+  mt19937_64 rng;
+
+};
+
+//--------------------------------------------Stages--------------------------------------------
+
+/**
+ * Runs the selected stages and collects their results.
+ */
+class Bench
+{
+
+public:
+
+  Bench(const BenchConfig &_config) :
+    config(_config), data(_config.products, _config.seed),
+    feeds(FeedGenerator::SyntheticProducts(_config.products), FeedConfig(_config))
+  {
+  }
+
+  // Run every selected stage
+  void Run()
+  {
+    // The historical writers append, so start each run from empty stores
+    for (const char *store : { "gui.txt", "streaming.txt", "position.txt", "risk.txt", "Execution.txt", "allinquiries.txt",
+      "streaming.bin" })
+      filesystem::remove(store);
+    data.RegisterProducts();
+    // Direct calls to services must not extend a trace left behind by a connector
+    LatencyTrace::Clear();
+
+    if (Selected("generate")) Generate();
+    if (Selected("convert")) Convert();
+    if (Selected("subscribe.pricing")) SubscribePricing();
+    if (Selected("subscribe.tradebooking")) SubscribeTradeBooking();
+    if (Selected("subscribe.market")) SubscribeMarket();
+    if (Selected("subscribe.inquiry")) SubscribeInquiry();
+    if (Selected("orderbook.getbidoffer")) GetBidOffer();
+    if (Selected("orderbook.apply")) ApplyUpdates();
+    if (Selected("marketdata.onupdate")) OnUpdate();
+    if (Selected("marketdata.onupdate.venues")) OnUpdateVenues();
+    if (Selected("marketdata.aggregatedepth")) AggregateDepth();
+    if (Selected("position.addtrade")) AddTrade();
+    if (Selected("risk.getbucketedrisk")) GetBucketedRisk();
+    if (Selected("historical.position")) HistoricalPosition();
+    if (Selected("historical.risk")) HistoricalRisk();
+    if (Selected("historical.execution")) HistoricalExecution();
+    if (Selected("historical.streaming")) HistoricalStreaming();
+    if (Selected("historical.inquiry")) HistoricalInquiry();
+    if (Selected("follow.pricing")) FollowPricing();
+    if (Selected("socket.market")) SocketMarket();
+    if (Selected("pipeline")) Pipeline();
+  }
+
+  // Write the results as JSON or CSV
+  void Write(ostream &out) const
+  {
+    if (config.format == "csv")
+      WriteCsv(out);
+    else
+      WriteJson(out);
+  }
+
+private:
+  BenchConfig config;
+  BenchData data;
+  FeedGenerator feeds;
+  vector<StageResult> results;
+
+  // Feeds are generated on the bench's threads from its seed. Book levels scatter
+  // their mids so that some books cross and the pipeline's execution path runs.
+  static FeedGeneratorConfig FeedConfig(const BenchConfig &config)
+  {
+    FeedGeneratorConfig feedconfig;
+    feedconfig.seed = config.seed;
+    feedconfig.threads = config.threads ? config.threads : 1;
+    feedconfig.levelJitter = 16;
+    return feedconfig;
+  }
+
+  // A stage runs if no list was given, or the list names it or a prefix of it ("subscribe")
+  bool Selected(const string &stage) const
+  {
+    if (config.stages.empty())
+      return true;
+    stringstream list(config.stages);
+    string name;
+    while (getline(list, name, ','))
+      if (!name.empty() && stage.compare(0, name.size(), name) == 0
+        && (stage.size() == name.size() || stage[name.size()] == '.'))
+        return true;
+    return false;
+  }
+
+  void Add(const StageResult &result)
+  {
+    results.push_back(result);
+    cerr << result.stage << ": " << result.ops << " ops in " << result.seconds << " s" << endl;
+  }
+
+  // Run a connector over a memory-mapped file with its chatter sent nowhere
+  template<typename Connector>
+  static void Subscribe(Connector *connector, const string &path)
+  {
+    MappedFeedSource source(path);
+    streambuf *saved = cout.rdbuf(nullptr);
+    connector->Subscribe(source);
+    cout.rdbuf(saved);
+    cout.clear();
+  }
+
+  // Run a connector over a file read through an ifstream
+  template<typename Connector>
+  static void SubscribeStream(Connector *connector, const string &path)
+  {
+    ifstream file(path);
+    streambuf *saved = cout.rdbuf(nullptr);
+    connector->Subscribe(file);
+    cout.rdbuf(saved);
+    cout.clear();
+  }
+
+  void Convert()
+  {
+    vector<string> prices(config.ticks < 65536 ? config.ticks : 65536);
+    for (auto &price : prices)
+      price = data.Price();
+    double total = 0;
+    Add(TimeEach("convert", config.ticks, [&](size_t i) { total += convert(prices[i % prices.size()]); }));
+    // The same prices a column at a time
+    vector<string_view> column(prices.begin(), prices.end());
+    vector<double> parsed(column.size());
+    Add(TimeWhole("convert.batch", config.ticks, [&] {
+      for (size_t done = 0; done < config.ticks; done += column.size())
+      {
+        size_t count = min(column.size(), config.ticks - done);
+        total += double(PriceParser::ParseBatch(column.data(), parsed.data(), count)) + parsed[0];
+      }
+    }));
+    sink = total;
+  }
+
+  // Generate each feed, text and binary, on the bench's threads; ops are messages
+  // (a book for the market feed)
+  void Generate()
+  {
+    size_t books = config.ticks / 5;
+    Add(TimeWhole("generate.pricing", config.ticks, [&] { feeds.WritePrices("generate_price.txt", config.ticks); }));
+    Add(TimeWhole("generate.tradebooking", config.trades, [&] { feeds.WriteTrades("generate_trades.txt", config.trades); }));
+    Add(TimeWhole("generate.market", books, [&] { feeds.WriteMarket("generate_market.txt", books); }));
+    Add(TimeWhole("generate.inquiry", config.inquiries, [&] { feeds.WriteInquiries("generate_inquiry.txt", config.inquiries); }));
+    FeedGeneratorConfig binary = FeedConfig(config);
+    binary.format = BINARY_RECORDS;
+    FeedGenerator binaryfeeds(FeedGenerator::SyntheticProducts(config.products), binary);
+    Add(TimeWhole("generate.pricing.binary", config.ticks, [&] { binaryfeeds.WritePrices("generate_price.bin", config.ticks); }));
+  }
+
+  void SubscribePricing()
+  {
+    feeds.WritePrices("price.txt", config.ticks);
+    PricingService<Bond> service;
+    Add(TimeWhole("subscribe.pricing", config.ticks, [&] { Subscribe(service.GetConnector(), "price.txt"); }));
+    Add(TimeWhole("subscribe.pricing.stream", config.ticks, [&] { SubscribeStream(service.GetConnector(), "price.txt"); }));
+    WritePriceRecords("price.txt", "price.bin");
+    Add(TimeWhole("subscribe.pricing.binary", config.ticks, [&] { Subscribe(service.GetConnector(), "price.bin"); }));
+    service.GetConnector()->SetParseThreads(config.threads ? config.threads : 1);
+    Add(TimeWhole("subscribe.pricing.parallel", config.ticks, [&] { Subscribe(service.GetConnector(), "price.txt"); }));
+    service.GetConnector()->SetParseThreads(1);
+    LatencyTrace::Clear();
+  }
+
+  // Write the prices of a text feed as a binary one
+  static void WritePriceRecords(const string &textpath, const string &binarypath)
+  {
+    MappedFeedSource text(textpath);
+    ofstream file(binarypath, ios::binary);
+    RecordHeader header = MakeRecordHeader(PRICE_RECORD, sizeof(PriceRecord));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    string_view line;
+    string_view fields[3];
+    while (text.NextLine(line))
+    {
+      if (SplitFields(line, ',', fields, 3) < 3)
+        continue;
+      PriceRecord record;
+      SetRecordText(record.productId, fields[0]);
+      record.mid = convert(fields[1]);
+      record.spread = convert(fields[2]);
+      WriteRecord(file, record);
+    }
+  }
+
+  void SubscribeTradeBooking()
+  {
+    feeds.WriteTrades("trades.txt", config.trades);
+    TradeBookingService<Bond> service;
+    Add(TimeWhole("subscribe.tradebooking", config.trades, [&] { Subscribe(service.GetConnector(), "trades.txt"); }));
+    LatencyTrace::Clear();
+  }
+
+  void SubscribeMarket()
+  {
+    size_t lines = config.ticks / 5 * 5;
+    feeds.WriteMarket("market.txt", lines / 5);
+    MarketDataService<Bond> service;
+    Add(TimeWhole("subscribe.market", lines, [&] { Subscribe(service.GetConnector(), "market.txt"); }));
+    LatencyTrace::Clear();
+
+    // As many book moves again, sent as the level updates that make them
+    size_t updates = feeds.WriteMarketUpdates("updates.txt", lines / 5);
+    MarketDataService<Bond> incremental;
+    Add(TimeWhole("subscribe.market.updates", updates, [&] { Subscribe(incremental.GetConnector(), "updates.txt"); }));
+    LatencyTrace::Clear();
+  }
+
+  void SubscribeInquiry()
+  {
+    feeds.WriteInquiries("inquiry.txt", config.inquiries);
+    InquiryService<Bond> service;
+    Add(TimeWhole("subscribe.inquiry", config.inquiries, [&] { Subscribe(service.GetConnector(), "inquiry.txt"); }));
+    LatencyTrace::Clear();
+  }
+
+  // One five-level book per product
+  vector<OrderBook<Bond>> Books()
+  {
+    vector<OrderBook<Bond>> books;
+    for (size_t i = 0; i < config.products; i++)
+      books.push_back(data.Book(ProductRegistry<Bond>::Instance().Get(FeedGenerator::SyntheticProductId(i)), 5));
+    return books;
+  }
+
+  void GetBidOffer()
+  {
+    vector<OrderBook<Bond>> books = Books();
+    double total = 0;
+    Add(TimeEach("orderbook.getbidoffer", config.ops, [&](size_t i) {
+      total += books[i % books.size()].GetBidOffer().GetBidOrder().GetPrice().ToDouble();
+    }));
+    sink = total;
+  }
+
+  // Books 50 levels deep, one per product, and level updates to them, each within 64
+  // ticks of the inside, so the best level comes and goes
+  void DeepUpdates(vector<OrderBook<Bond>> &books, vector<OrderBookUpdate<Bond>> &updates, vector<size_t> &targets)
+  {
+    const int depth = 50;
+    for (size_t i = 0; i < config.products; i++)
+      books.push_back(data.DeepBook(ProductRegistry<Bond>::Instance().Get(FeedGenerator::SyntheticProductId(i)), depth));
+    for (size_t i = 0; i < min<size_t>(config.ops, 1 << 20); i++)
+    {
+      targets.push_back(i % books.size());
+      updates.push_back(data.RandomUpdate(books[targets.back()].GetProduct(), 64));
+    }
+  }
+
+  void ApplyUpdates()
+  {
+    vector<OrderBook<Bond>> books;
+    vector<OrderBookUpdate<Bond>> updates;
+    vector<size_t> targets;
+    DeepUpdates(books, updates, targets);
+    double total = 0;
+    Add(TimeEach("orderbook.apply", config.ops, [&](size_t i) {
+      size_t n = i % updates.size();
+      OrderBook<Bond> &book = books[targets[n]];
+      book.Apply(updates[n]);
+      total += book.GetBids().GetBestQuantity();
+    }));
+    sink = total;
+  }
+
+  class TopCounter : public ServiceListener<TopOfBook<Bond>>
+  {
+  public:
+    size_t tops = 0;
+
+    virtual void ProcessAdd(TopOfBook<Bond> &) { tops++; }
+    virtual void ProcessRemove(TopOfBook<Bond> &) {}
+    virtual void ProcessUpdate(TopOfBook<Bond> &) {}
+  };
+
+  // The same updates through the service, which notes each book's top after each
+  // one and tells a top listener when it moved
+  void OnUpdate()
+  {
+    vector<OrderBook<Bond>> books;
+    vector<OrderBookUpdate<Bond>> updates;
+    vector<size_t> targets;
+    DeepUpdates(books, updates, targets);
+    MarketDataService<Bond> service;
+    for (auto &book : books)
+      service.OnMessage(book);
+    TopCounter counter;
+    service.AddTopListener(&counter);
+    Add(TimeEach("marketdata.onupdate", config.ops, [&](size_t i) {
+      service.OnUpdate(updates[i % updates.size()]);
+    }));
+    sink = double(counter.tops);
+  }
+
+  // Updates spread over the books of every venue, each merged into the product's
+  // consolidated book as it is applied
+  void OnUpdateVenues()
+  {
+    const int depth = 50;
+    MarketDataService<Bond> service;
+    vector<const Bond*> bonds;
+    for (size_t i = 0; i < config.products; i++)
+    {
+      bonds.push_back(&ProductRegistry<Bond>::Instance().Get(FeedGenerator::SyntheticProductId(i)));
+      for (int venue = 0; venue < MARKETS; venue++)
+      {
+        OrderBook<Bond> book = data.DeepBook(*bonds.back(), depth, Market(venue));
+        service.OnMessage(book);
+      }
+    }
+    vector<OrderBookUpdate<Bond>> updates;
+    for (size_t i = 0; i < min<size_t>(config.ops, 1 << 20); i++)
+      updates.push_back(data.RandomUpdate(*bonds[i % bonds.size()], 64, Market(i / bonds.size() % MARKETS)));
+    TopCounter counter;
+    service.AddTopListener(&counter);
+    Add(TimeEach("marketdata.onupdate.venues", config.ops, [&](size_t i) {
+      service.OnUpdate(updates[i % updates.size()]);
+    }));
+    sink = double(counter.tops);
+  }
+
+  void AggregateDepth()
+  {
+    MarketDataService<Bond> service;
+    vector<OrderBook<Bond>> books = Books();
+    vector<string> ids;
+    for (auto &book : books)
+    {
+      service.OnMessage(book);
+      ids.push_back(book.GetProduct().GetProductId());
+    }
+    double total = 0;
+    Add(TimeEach("marketdata.aggregatedepth", config.ops, [&](size_t i) {
+      total += double(service.AggregateDepth(ids[i % ids.size()]).GetBidStack().size());
+    }));
+    sink = total;
+  }
+
+  void AddTrade()
+  {
+    PositionService<Bond> service;
+    vector<Trade<Bond>> trades;
+    size_t pool = config.products * 16;
+    for (size_t i = 0; i < pool; i++)
+      trades.push_back(data.RandomTrade(i));
+    Add(TimeEach("position.addtrade", config.ops, [&](size_t i) { service.AddTrade(trades[i % trades.size()]); }));
+  }
+
+  void GetBucketedRisk()
+  {
+    RiskService<Bond> service;
+    vector<Bond> bonds;
+    for (size_t i = 0; i < config.products; i++)
+    {
+      const Bond &bond = ProductRegistry<Bond>::Instance().Get(FeedGenerator::SyntheticProductId(i));
+      bonds.push_back(bond);
+      Position<Bond> position(bond, long(i) * 1000000, 0, 0);
+      service.AddPosition(position);
+    }
+    // A single sector holding the whole universe
+    BucketedSector<Bond> sector(bonds, "All");
+    double total = 0;
+    Add(TimeEach("risk.getbucketedrisk", config.riskOps, [&](size_t) { total += service.GetBucketedRisk(sector).GetPV01(); }));
+    sink = total;
+  }
+
+  void HistoricalPosition()
+  {
+    HistoricalDataServicePosition<Bond> service;
+    const Bond &bond = ProductRegistry<Bond>::Instance().Get(FeedGenerator::SyntheticProductId(0));
+    Position<Bond> position(bond, 1000000, 2000000, 3000000);
+    Add(TimeEach("historical.position", config.writes, [&](size_t) { service.PersistData("", position); }));
+  }
+
+  void HistoricalRisk()
+  {
+    HistoricalDataServiceRisk<Bond> service;
+    const Bond &bond = ProductRegistry<Bond>::Instance().Get(FeedGenerator::SyntheticProductId(0));
+    PV01<Bond> pv01(bond, 0.048643, 6000000);
+    Add(TimeEach("historical.risk", config.writes, [&](size_t) { service.PersistData("", pv01); }));
+  }
+
+  void HistoricalExecution()
+  {
+    HistoricalDataServiceExecution<Bond> service;
+    const Bond &bond = ProductRegistry<Bond>::Instance().Get(FeedGenerator::SyntheticProductId(0));
+    ExecutionOrder<Bond> order(bond, BID, "1", MARKET, FixedPrice::FromDouble(99.5), 1000000, 0, "1", false);
+    Add(TimeEach("historical.execution", config.writes, [&](size_t) { service.PersistData("", order); }));
+  }
+
+  void HistoricalStreaming()
+  {
+    HistoricalDataServiceStream<Bond> service;
+    const Bond &bond = ProductRegistry<Bond>::Instance().Get(FeedGenerator::SyntheticProductId(0));
+    PriceStream<Bond> stream(bond, PriceStreamOrder(FixedPrice::FromDouble(99.5), 1000000, 2000000, BID),
+      PriceStreamOrder(FixedPrice::FromDouble(99.515625), 1000000, 2000000, OFFER));
+    Add(TimeEach("historical.streaming", config.writes, [&](size_t) { service.PersistData("", stream); }));
+    service.SetFormat(BINARY_RECORDS);
+    Add(TimeEach("historical.streaming.binary", config.writes, [&](size_t) { service.PersistData("", stream); }));
+  }
+
+  void HistoricalInquiry()
+  {
+    HistoricalDataServiceInquiry<Bond> service;
+    const Bond &bond = ProductRegistry<Bond>::Instance().Get(FeedGenerator::SyntheticProductId(0));
+    Inquiry<Bond> inquiry("1", bond, BUY, 1000000, FixedPrice::FromDouble(99.5), DONE);
+    Add(TimeEach("historical.inquiry", config.writes, [&](size_t) { service.PersistData("", inquiry); }));
+  }
+
+  // Times each price from being appended to a followed file to leaving the pricing service
+  class AppendProbe : public ServiceListener<Price<Bond>>
+  {
+  public:
+    explicit AppendProbe(size_t count) : appended(count), seen(0) {}
+
+    vector<atomic<uint64_t>> appended;
+    atomic<size_t> seen;
+    LatencyHistogram histogram;
+
+    virtual void ProcessAdd(Price<Bond> &)
+    {
+      size_t i = seen.load(memory_order_relaxed);
+      histogram.Record(TickClock::Now() - appended[i].load(memory_order_acquire));
+      seen.store(i + 1, memory_order_release);
+    }
+    virtual void ProcessRemove(Price<Bond> &) {}
+    virtual void ProcessUpdate(Price<Bond> &) {}
+  };
+
+  // Append prices one at a time to a file a PricingConnector follows, each once the
+  // last has come through. follow.pricing appends back to back, so the reader is
+  // still spinning; follow.pricing.idle leaves 1ms between appends, so it has gone
+  // to sleep and is woken by the file changing.
+  void FollowPricing()
+  {
+    FollowOne("follow.pricing", config.followTicks, chrono::microseconds(0));
+    FollowOne("follow.pricing.idle", config.followTicks / 10, chrono::microseconds(1000));
+  }
+
+  void FollowOne(const string &stage, size_t ticks, chrono::microseconds gap)
+  {
+    vector<string> lines(ticks);
+    for (auto &line : lines)
+      line = FeedGenerator::SyntheticProductId(0) + "," + data.Price() + "," + data.Spread() + "\n";
+    ofstream file("follow_price.txt", ios::trunc);
+    FollowFeedSource source("follow_price.txt");
+    PricingService<Bond> service;
+    service.GetConnector()->SetBatchSize(1);
+    AppendProbe probe(ticks);
+    service.AddListener(&probe);
+    streambuf *saved = cout.rdbuf(nullptr);
+    thread reader([&] { service.GetConnector()->Subscribe(source); });
+    Add(TimeWhole(stage, ticks, [&] {
+      for (size_t i = 0; i < ticks; i++)
+      {
+        if (gap.count() > 0)
+          this_thread::sleep_for(gap);
+        probe.appended[i].store(TickClock::Now(), memory_order_release);
+        file << lines[i] << flush;
+        while (probe.seen.load(memory_order_acquire) <= i)
+          this_thread::yield();
+      }
+    }));
+    source.Stop();
+    reader.join();
+    cout.rdbuf(saved);
+    cout.clear();
+    Summarize(results.back(), probe.histogram, TickClock::NanosPerTick());
+    // The appends are paced, so the mean is of the latencies, not of the wall time
+    results.back().meanNs = 0;
+    LatencyTrace::Clear();
+  }
+
+  // Times each order book from being written to a socket to leaving the market data service
+  class BookProbe : public ServiceListener<OrderBook<Bond>>
+  {
+  public:
+    explicit BookProbe(size_t count) : written(count), seen(0) {}
+
+    vector<atomic<uint64_t>> written;
+    atomic<size_t> seen;
+    LatencyHistogram histogram;
+
+    virtual void ProcessAdd(OrderBook<Bond> &)
+    {
+      size_t i = seen.load(memory_order_relaxed);
+      histogram.Record(TickClock::Now() - written[i].load(memory_order_acquire));
+      seen.store(i + 1, memory_order_release);
+    }
+    virtual void ProcessRemove(OrderBook<Bond> &) {}
+    virtual void ProcessUpdate(OrderBook<Bond> &) {}
+  };
+
+  // Write order books one at a time, as the five lines of each in one write, to a
+  // socket a MarketConnector reads, each once the last has come through. Ticks are
+  // --follow-ticks books.
+  void SocketMarket()
+  {
+#ifndef _WIN32
+    SocketOne("socket.market", "unix:bench_market.sock", config.followTicks);
+#endif
+    SocketOne("socket.market.tcp", "tcp:127.0.0.1:0", config.followTicks);
+  }
+
+  void SocketOne(const string &stage, const string &address, size_t ticks)
+  {
+    feeds.WriteMarket("socket_market.txt", ticks);
+    vector<string> books;
+    {
+      MappedFeedSource file("socket_market.txt");
+      string_view line;
+      string book;
+      for (size_t n = 1; file.NextLine(line); n++)
+      {
+        book.append(line.data(), line.size()).push_back('\n');
+        if (n % 5 == 0)
+        {
+          books.push_back(book);
+          book.clear();
+        }
+      }
+    }
+    SocketFeedServer server(address);
+    SocketFeedSource source(server.GetAddress());
+    if (!server.IsOpen() || !source.IsOpen() || !server.Accept())
+    {
+      cerr << stage << ": cannot connect at " << address << endl;
+      return;
+    }
+    MarketDataService<Bond> service;
+    service.GetConnector()->SetBatchSize(1);
+    BookProbe probe(books.size());
+    service.AddListener(&probe);
+    streambuf *saved = cout.rdbuf(nullptr);
+    thread reader([&] { service.GetConnector()->Subscribe(source); });
+    Add(TimeWhole(stage, books.size(), [&] {
+      for (size_t i = 0; i < books.size(); i++)
+      {
+        probe.written[i].store(TickClock::Now(), memory_order_release);
+        server.Send(books[i]);
+        while (probe.seen.load(memory_order_acquire) <= i)
+          this_thread::yield();
+      }
+    }));
+    server.Disconnect();
+    reader.join();
+    cout.rdbuf(saved);
+    cout.clear();
+    Summarize(results.back(), probe.histogram, TickClock::NanosPerTick());
+    results.back().meanNs = 0;
+    LatencyTrace::Clear();
+  }
+
+  // The fully wired system over all four feeds; one result for the whole run and one
+  // per feed -> sink path from the latency tracer
+  void Pipeline()
+  {
+    size_t ticks = config.pipelineTicks;
+    size_t trades = ticks / 10;
+    size_t market = ticks / 5 * 5;
+    size_t inquiries = ticks / 10;
+    feeds.WritePrices("pipeline_price.txt", ticks);
+    feeds.WriteTrades("pipeline_trades.txt", trades);
+    feeds.WriteMarket("pipeline_market.txt", market / 5);
+    feeds.WriteInquiries("pipeline_inquiry.txt", inquiries);
+
+    LatencyTracer::Instance().Reset();
+    {
+      TradingSystem<Bond> system(config.threads ? config.threads : 1);
+      MappedFeedSource pricefeed("pipeline_price.txt");
+      MappedFeedSource tradefeed("pipeline_trades.txt");
+      MappedFeedSource marketfeed("pipeline_market.txt");
+      MappedFeedSource inquiryfeed("pipeline_inquiry.txt");
+      streambuf *saved = cout.rdbuf(nullptr);
+      Add(TimeWhole("pipeline", ticks + trades + market + inquiries, [&] {
+        system.Run(pricefeed, tradefeed, marketfeed, inquiryfeed);
+      }));
+      cout.rdbuf(saved);
+      cout.clear();
+    }
+
+    double nanosPerTick = TickClock::NanosPerTick();
+    double seconds = results.back().seconds;
+    LatencyTracer::Instance().Visit([&](const string &name, const LatencyHistogram &histogram) {
+      if (name.find(" -> ") == string::npos)
+        return;
+      StageResult result;
+      result.stage = "pipeline." + name;
+      result.ops = histogram.GetCount();
+      result.seconds = seconds;
+      Summarize(result, histogram, nanosPerTick);
+      // Events overlap in the pipeline, so the mean is of the latencies, not of the wall time
+      result.meanNs = 0;
+      results.push_back(result);
+    });
+  }
+
+  void WriteJson(ostream &out) const
+  {
+    out << "{\n  \"benchmark\": \"tradingbench\",\n  \"config\": {"
+      << "\"ticks\": " << config.ticks << ", \"products\": " << config.products
+      << ", \"trades\": " << config.trades << ", \"inquiries\": " << config.inquiries
+      << ", \"ops\": " << config.ops << ", \"risk_ops\": " << config.riskOps
+      << ", \"writes\": " << config.writes << ", \"pipeline_ticks\": " << config.pipelineTicks
+      << ", \"follow_ticks\": " << config.followTicks
+      << ", \"threads\": " << config.threads << ", \"seed\": " << config.seed << "},\n  \"results\": [";
+    char line[512];
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      const StageResult &r = results[i];
+      snprintf(line, sizeof(line), "%s\n    {\"stage\": \"%s\", \"ops\": %llu, \"seconds\": %.6f, \"ops_per_sec\": %.1f",
+        i ? "," : "", r.stage.c_str(), (unsigned long long)r.ops, r.seconds, OpsPerSec(r));
+      out << line;
+      if (r.sampled)
+      {
+        if (r.meanNs > 0)
+          snprintf(line, sizeof(line), ", \"mean_ns\": %.1f", r.meanNs);
+        else
+          snprintf(line, sizeof(line), ", \"mean_ns\": null");
+        out << line;
+        snprintf(line, sizeof(line), ", \"p50_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f, \"max_ns\": %.1f}",
+          r.p50Ns, r.p99Ns, r.p999Ns, r.maxNs);
+      }
+      else
+        snprintf(line, sizeof(line), ", \"mean_ns\": null, \"p50_ns\": null, \"p99_ns\": null, \"p999_ns\": null, \"max_ns\": null}");
+      out << line;
+    }
+    out << "\n  ]\n}\n";
+  }
+
+  void WriteCsv(ostream &out) const
+  {
+    out << "stage,ops,seconds,ops_per_sec,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n";
+    char line[512];
+    for (const StageResult &r : results)
+    {
+      snprintf(line, sizeof(line), "%s,%llu,%.6f,%.1f", r.stage.c_str(), (unsigned long long)r.ops, r.seconds, OpsPerSec(r));
+      out << line;
+      if (r.sampled)
+      {
+        if (r.meanNs > 0)
+          snprintf(line, sizeof(line), ",%.1f", r.meanNs);
+        else
+          snprintf(line, sizeof(line), ",");
+        out << line;
+        snprintf(line, sizeof(line), ",%.1f,%.1f,%.1f,%.1f\n", r.p50Ns, r.p99Ns, r.p999Ns, r.maxNs);
+      }
+      else
+        snprintf(line, sizeof(line), ",,,,,\n");
+      out << line;
+    }
+  }
+
+  static double OpsPerSec(const StageResult &r)
+  {
+    return r.seconds > 0 ? double(r.ops) / r.seconds : 0;
+  }
+
+};
+
+//--------------------------------------------Command line--------------------------------------------
+
+void usage()
+{
+  cerr << "usage: tradingbench [--ticks N] [--products N] [--trades N] [--inquiries N]\n"
+    "                    [--ops N] [--risk-ops N] [--writes N] [--pipeline-ticks N]\n"
+    "                    [--follow-ticks N] [--threads N] [--seed N] [--dir PATH]\n"
+    "                    [--stages a,b,...] [--format json|csv] [--out FILE]\n"
+    "stages: generate.pricing generate.tradebooking generate.market generate.inquiry\n"
+    "        generate.pricing.binary convert convert.batch subscribe.pricing\n"
+    "        subscribe.pricing.stream subscribe.pricing.binary subscribe.pricing.parallel\n"
+    "        subscribe.tradebooking subscribe.market subscribe.market.updates subscribe.inquiry\n"
+    "        orderbook.getbidoffer orderbook.apply marketdata.onupdate\n"
+    "        marketdata.onupdate.venues marketdata.aggregatedepth position.addtrade\n"
+    "        risk.getbucketedrisk historical.position historical.risk historical.execution\n"
+    "        historical.streaming historical.streaming.binary historical.inquiry\n"
+    "        follow.pricing follow.pricing.idle socket.market socket.market.tcp pipeline\n";
+}
+
+int main(int argc, char **argv)
+{
+  BenchConfig config;
+  for (int i = 1; i < argc; i++)
+  {
+    string option = argv[i];
+    if (option == "--help" || option == "-h")
+    {
+      usage();
+      return 0;
+    }
+    if (i + 1 >= argc)
+    {
+      usage();
+      return 1;
+    }
+    string value = argv[++i];
+    if (option == "--ticks") config.ticks = stoull(value);
+    else if (option == "--products") config.products = stoull(value);
+    else if (option == "--trades") config.trades = stoull(value);
+    else if (option == "--inquiries") config.inquiries = stoull(value);
+    else if (option == "--ops") config.ops = stoull(value);
+    else if (option == "--risk-ops") config.riskOps = stoull(value);
+    else if (option == "--writes") config.writes = stoull(value);
+    else if (option == "--pipeline-ticks") config.pipelineTicks = stoull(value);
+    else if (option == "--follow-ticks") config.followTicks = stoull(value);
+    else if (option == "--threads") config.threads = stoull(value);
+    else if (option == "--seed") config.seed = stoull(value);
+    else if (option == "--dir") config.dir = value;
+    else if (option == "--stages") config.stages = value;
+    else if (option == "--format") config.format = value;
+    else if (option == "--out") config.out = value;
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+  if (config.products == 0 || (config.format != "json" && config.format != "csv"))
+  {
+    usage();
+    return 1;
+  }
+
+  // Results are written relative to where the bench was started
+  string out = config.out.empty() ? "" : filesystem::absolute(config.out).string();
+
+  // Generated feeds and everything the services persist go to the work directory
+  filesystem::create_directories(config.dir);
+  filesystem::current_path(config.dir);
+
+  Bench bench(config);
+  bench.Run();
+
+  if (out.empty())
+    bench.Write(cout);
+  else
+  {
+    ofstream file(out);
+    bench.Write(file);
+  }
+  return 0;
+}
@@ -0,0 +1,328 @@
+/**
+ * binaryrecords.hpp
+ * Defines the fixed-width binary layouts of the feed and history records, and a
+ * reader that takes a feed in either the binary or the text layout.
+ */
+#ifndef BINARY_RECORDS_HPP
+#define BINARY_RECORDS_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <iostream>
+#include <fstream>
+#include "feedsource.hpp"
+
+using namespace std;
+
+/**
+ * A binary file is a RecordHeader followed by records of one type, back to back
+ * with no separators. Every record has a fixed size and only naturally aligned
+ * members, so a file is read by copying recordSize bytes at a time and nothing is
+ * parsed. Integers and doubles are stored in the byte order of the writer (little-
+ * endian on the platforms this builds for); a reader of the other order sees a
+ * header it does not recognize and rejects the file.
+ *
+ * Text fields are NUL padded to their width. Prices are doubles: a feed price is a
+ * whole number of 256ths, so it is stored and read back exactly. History records
+ * carry their time in milliseconds since the epoch where the text stores carry a
+ * timestamp.
+ */
+
+// Version written in new headers; readers accept any version whose records are at
+// least as long as theirs, ignoring fields appended after the ones they know
+const uint16_t RECORD_VERSION = 1;
+
+// What a binary file holds
+enum RecordType : uint16_t
+{
+  PRICE_RECORD = 1, TRADE_RECORD, MARKET_RECORD, INQUIRY_RECORD,
+  STREAM_RECORD, POSITION_RECORD, RISK_RECORD, EXECUTION_RECORD, INQUIRY_HISTORY_RECORD, GUI_RECORD,
+  BOOK_UPDATE_RECORD
+};
+
+// How a store is written
+enum RecordFormat { TEXT_RECORDS, BINARY_RECORDS };
+
+struct RecordHeader
+{
+  char magic[4];
+  uint16_t type;
+  uint16_t version;
+  uint32_t recordSize;
+  uint32_t reserved;
+};
+static_assert(sizeof(RecordHeader) == 16, "RecordHeader must have no padding");
+
+// The first bytes of every binary file
+const char RECORD_MAGIC[4] = { 'T', 'S', 'R', 'B' };
+
+// One line of price.txt
+struct PriceRecord
+{
+  static const RecordType TYPE = PRICE_RECORD;
+  char productId[16];
+  double mid;
+  double spread;
+};
+static_assert(sizeof(PriceRecord) == 32, "PriceRecord must have no padding");
+
+// One line of trades.txt; side is a Side
+struct TradeRecord
+{
+  static const RecordType TYPE = TRADE_RECORD;
+  char productId[16];
+  char tradeId[16];
+  char book[8];
+  double price;
+  int64_t quantity;
+  uint8_t side;
+  uint8_t unused[7];
+};
+static_assert(sizeof(TradeRecord) == 64, "TradeRecord must have no padding");
+
+// One line of market.txt, a level of an order book
+struct MarketRecord
+{
+  static const RecordType TYPE = MARKET_RECORD;
+  char productId[16];
+  double mid;
+  double spread;
+  int64_t quantity;
+};
+static_assert(sizeof(MarketRecord) == 40, "MarketRecord must have no padding");
+
+// One line of inquiry.txt; side is a Side and state an InquiryState
+struct InquiryRecord
+{
+  static const RecordType TYPE = INQUIRY_RECORD;
+  char productId[16];
+  int64_t quantity;
+  double mid;
+  double spread;
+  uint8_t side;
+  uint8_t state;
+  uint8_t unused[6];
+};
+static_assert(sizeof(InquiryRecord) == 48, "InquiryRecord must have no padding");
+
+// One price stream, both lines of it in streaming.txt
+struct StreamRecord
+{
+  static const RecordType TYPE = STREAM_RECORD;
+  int64_t time;
+  char productId[16];
+  double bidPrice;
+  int64_t bidVisibleQuantity;
+  int64_t bidHiddenQuantity;
+  double offerPrice;
+  int64_t offerVisibleQuantity;
+  int64_t offerHiddenQuantity;
+};
+static_assert(sizeof(StreamRecord) == 72, "StreamRecord must have no padding");
+
+// One line of position.txt, with the positions of the three books in book order
+struct PositionRecord
+{
+  static const RecordType TYPE = POSITION_RECORD;
+  int64_t time;
+  char productId[16];
+  int64_t positions[3];
+  int64_t aggregate;
+};
+static_assert(sizeof(PositionRecord) == 56, "PositionRecord must have no padding");
+
+// One line of risk.txt; name is a product ID or a bucketed sector's name
+struct RiskRecord
+{
+  static const RecordType TYPE = RISK_RECORD;
+  int64_t time;
+  char name[16];
+  double pv01;
+  int64_t quantity;
+};
+static_assert(sizeof(RiskRecord) == 40, "RiskRecord must have no padding");
+
+// One line of Execution.txt; side is a PricingSide and orderType an OrderType
+struct ExecutionRecord
+{
+  static const RecordType TYPE = EXECUTION_RECORD;
+  int64_t time;
+  char productId[16];
+  char orderId[16];
+  char parentOrderId[16];
+  double price;
+  double visibleQuantity;
+  double hiddenQuantity;
+  uint8_t side;
+  uint8_t orderType;
+  uint8_t isChildOrder;
+  uint8_t unused[5];
+};
+static_assert(sizeof(ExecutionRecord) == 88, "ExecutionRecord must have no padding");
+
+// One line of allinquiries.txt; side is a Side and state an InquiryState
+struct InquiryHistoryRecord
+{
+  static const RecordType TYPE = INQUIRY_HISTORY_RECORD;
+  int64_t time;
+  char inquiryId[16];
+  char productId[16];
+  int64_t quantity;
+  double price;
+  uint8_t side;
+  uint8_t state;
+  uint8_t unused[6];
+};
+static_assert(sizeof(InquiryHistoryRecord) == 64, "InquiryHistoryRecord must have no padding");
+
+// One line of gui.txt, a throttled price
+struct GuiRecord
+{
+  static const RecordType TYPE = GUI_RECORD;
+  int64_t time;
+  char productId[16];
+  double mid;
+  double spread;
+};
+static_assert(sizeof(GuiRecord) == 40, "GuiRecord must have no padding");
+
+// One line of an incremental market feed, a change to one level of a venue's order
+// book; action is a BookAction, side a PricingSide and venue a Market, so records
+// written before venues were kept are BROKERTEC's
+struct BookUpdateRecord
+{
+  static const RecordType TYPE = BOOK_UPDATE_RECORD;
+  char productId[16];
+  double price;
+  int64_t quantity;
+  uint8_t action;
+  uint8_t side;
+  uint8_t venue;
+  uint8_t unused[5];
+};
+static_assert(sizeof(BookUpdateRecord) == 40, "BookUpdateRecord must have no padding");
+
+// Copy text into a fixed field, NUL padded; text longer than the field is cut to
+// fit and false is returned
+template<size_t N>
+inline bool SetRecordText(char (&field)[N], string_view text)
+{
+  size_t length = text.size() < N ? text.size() : N;
+  memcpy(field, text.data(), length);
+  memset(field + length, 0, N - length);
+  return length == text.size();
+}
+
+// Get the text of a fixed field
+template<size_t N>
+inline string_view GetRecordText(const char (&field)[N])
+{
+  const void *end = memchr(field, 0, N);
+  return string_view(field, end ? size_t(static_cast<const char*>(end) - field) : N);
+}
+
+// Get the header for a new file of records
+inline RecordHeader MakeRecordHeader(RecordType type, size_t recordSize)
+{
+  RecordHeader header;
+  memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+  header.type = type;
+  header.version = RECORD_VERSION;
+  header.recordSize = uint32_t(recordSize);
+  header.reserved = 0;
+  return header;
+}
+
+// Get whether a feed starts with a record header, and if so which; the header is
+// left in place
+inline bool PeekRecordHeader(FeedSource &source, RecordHeader &header)
+{
+  string_view head = source.Peek(sizeof(RecordHeader));
+  if (head.size() < sizeof(RecordHeader) || memcmp(head.data(), RECORD_MAGIC, sizeof(RECORD_MAGIC)) != 0)
+    return false;
+  memcpy(&header, head.data(), sizeof(header));
+  return true;
+}
+
+// Open a binary store to append records of type R, writing the header if the store
+// is new
+template<typename R>
+inline void OpenRecordStore(ofstream &file, const char *path)
+{
+  file.open(path, ios::binary | ios::app);
+  file.seekp(0, ios::end);
+  if (file.tellp() == streampos(0))
+  {
+    RecordHeader header = MakeRecordHeader(R::TYPE, sizeof(R));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+}
+
+// Append a record to a binary store
+template<typename R>
+inline void WriteRecord(ostream &file, const R &record)
+{
+  file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+}
+
+/**
+ * Reads records of type R from a feed that starts with a header for them.
+ * Constructing one looks at the start of the feed: if it is binary the header is
+ * taken off and the reader converts to true, and records are then read with Next;
+ * otherwise the feed is left untouched for the caller to read as text.
+ * A binary feed of some other record type is reported and read as empty.
+ */
+template<typename R>
+class RecordReader
+{
+
+public:
+
+  // ctor for a reader over a feed
+  explicit RecordReader(FeedSource &_source) :
+    source(_source), binary(false), recordSize(0)
+  {
+    RecordHeader header;
+    if (!PeekRecordHeader(source, header))
+      return;
+    binary = true;
+    string_view skipped;
+    source.NextBlock(sizeof(header), skipped);
+    if (header.type != R::TYPE || header.recordSize < sizeof(R))
+    {
+      cerr << "binary feed holds record type " << header.type << " of " << header.recordSize
+        << " bytes, expected type " << int(R::TYPE) << "; nothing read" << endl;
+      return;
+    }
+    recordSize = header.recordSize;
+  }
+
+  // Get whether the feed is binary
+  explicit operator bool() const { return binary; }
+
+  // Get the next record; false at the end of the feed. A partial record at the end
+  // of the feed is not read.
+  bool Next(R &record)
+  {
+    string_view block;
+    if (recordSize == 0 || !source.NextBlock(recordSize, block))
+      return false;
+    memcpy(&record, block.data(), sizeof(R));
+    return true;
+  }
+
+  // Get whether the next record can be read without waiting for the feed to grow
+  bool Ready() const
+  {
+    return recordSize > 0 && source.BlockReady(recordSize);
+  }
+
+private:
+  FeedSource &source;
+  bool binary;
+  size_t recordSize;
+
+};
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * bufferedfeedsource.hpp
+ * Defines the buffering shared by feeds that arrive over time, such as a file still
+ * being written or a socket.
+ */
+#ifndef BUFFERED_FEED_SOURCE_HPP
+#define BUFFERED_FEED_SOURCE_HPP
+
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include "feedsource.hpp"
+
+using namespace std;
+
+/**
+ * Feed read into a buffer of its own as the data arrives.
+ * Lines and blocks are handed out as views of the buffer, so nothing is copied
+ * between the read and the parse. When everything read so far has been handed out,
+ * a read asks the source for more with Fill(), and if none has arrived waits for it
+ * with Wait(). A partly received last line is held back until its line end arrives.
+ *
+ * A source implements ReadSome, which must not block, and Wait.
+ */
+class BufferedFeedSource : public FeedSource
+{
+
+public:
+
+  // Get the next line, waiting for one to arrive; false once the feed has ended
+  virtual bool NextLine(string_view &line)
+  {
+    size_t scanned = 0;
+    while (true)
+    {
+      const char *start = storage.data() + begin;
+      const char *newline = static_cast<const char*>(memchr(start + scanned, '\n', end - begin - scanned));
+      if (newline)
+      {
+        size_t length = size_t(newline - start);
+        begin += length + 1;
+        line = Trim(start, length);
+        return true;
+      }
+      scanned = end - begin;
+      if (!Fill() && !Wait())
+      {
+        // Ended: hand out an unfinished last line as it is
+        if (begin == end)
+          return false;
+        line = Trim(storage.data() + begin, end - begin);
+        begin = end;
+        return true;
+      }
+    }
+  }
+
+  // Get the next size bytes, waiting for them to arrive; false once the feed has
+  // ended with fewer than that left
+  virtual bool NextBlock(size_t size, string_view &block)
+  {
+    while (end - begin < size)
+      if (!Fill() && !Wait())
+        return false;
+    block = string_view(storage.data() + begin, size);
+    begin += size;
+    return true;
+  }
+
+  // Look at up to size bytes at the front of the feed, waiting until that many or a
+  // whole line have arrived
+  virtual string_view Peek(size_t size)
+  {
+    while (end - begin < size && !memchr(storage.data() + begin, '\n', end - begin))
+      if (!Fill() && !Wait())
+        break;
+    size_t length = end - begin < size ? end - begin : size;
+    return string_view(storage.data() + begin, length);
+  }
+
+  // Get whether a whole line is already buffered; a partly received one does not
+  // count, as reading it waits for its line end
+  virtual bool Ready()
+  {
+    return memchr(storage.data() + begin, '\n', end - begin) != nullptr;
+  }
+
+  // Get whether size bytes are already buffered
+  virtual bool BlockReady(size_t size)
+  {
+    return end - begin >= size;
+  }
+
+protected:
+  static const size_t CHUNK = 1 << 16;
+
+  BufferedFeedSource() : storage(CHUNK), begin(0), end(0) {}
+
+  // Read whatever has arrived beyond what was read, as much as fits in one call;
+  // true if anything was
+  bool Fill()
+  {
+    // Make room at the back, moving the unread bytes down or growing the buffer
+    if (begin > 0 && (begin == end || storage.size() - end < CHUNK))
+    {
+      memmove(storage.data(), storage.data() + begin, end - begin);
+      end -= begin;
+      begin = 0;
+    }
+    if (storage.size() - end < CHUNK)
+      storage.resize(storage.size() + CHUNK);
+    long long count = ReadSome(storage.data() + end, storage.size() - end);
+    if (count <= 0)
+      return false;
+    end += size_t(count);
+    return true;
+  }
+
+  // Drop everything buffered
+  void Discard()
+  {
+    begin = end = 0;
+  }
+
+  // Read up to size bytes without blocking; returns the count read, zero or less if
+  // nothing was
+  virtual long long ReadSome(char *buffer, size_t size) = 0;
+
+  // Wait until Fill() has read more; false once the feed has ended
+  virtual bool Wait() = 0;
+
+private:
+  vector<char> storage;
+  // The unread bytes of storage
+  size_t begin;
+  size_t end;
+
+  static string_view Trim(const char *start, size_t length)
+  {
+    if (length > 0 && start[length - 1] == '\r')
+      length--;
+    return string_view(start, length);
+  }
+
+};
+
+#endif
@@ -0,0 +1,149 @@
+/**
+ * chunkedingest.hpp
+ * Defines parsing of an in-memory text feed on several threads, with the results
+ * handed on in the feed's own order.
+ */
+#ifndef CHUNKED_INGEST_HPP
+#define CHUNKED_INGEST_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string_view>
+#include <cstring>
+#include <exception>
+
+using namespace std;
+
+// Split text into at most count chunks of about equal size, each ending just after a
+// line end (the last one at the end of the text), so no line is cut in two
+inline vector<string_view> SplitChunks(string_view text, size_t count)
+{
+  vector<string_view> chunks;
+  if (count == 0)
+    count = 1;
+  size_t target = text.size() / count + 1;
+  size_t start = 0;
+  while (start < text.size())
+  {
+    size_t end = start + target;
+    if (end >= text.size())
+      end = text.size();
+    else
+    {
+      const char *newline = static_cast<const char*>(memchr(text.data() + end, '\n', text.size() - end));
+      end = newline ? size_t(newline - text.data()) + 1 : text.size();
+    }
+    chunks.push_back(text.substr(start, end - start));
+    start = end;
+  }
+  return chunks;
+}
+
+/**
+ * Parse a text feed on the given number of threads and consume the results in order.
+ * The text is cut into line-aligned chunks; parse(chunk, out) turns one chunk into
+ * records and may run on any parse thread, while consume(records) is called on the
+ * calling thread once per chunk, strictly in chunk order. Every record therefore
+ * reaches consume in the order its line has in the text, so per-product order, and
+ * indeed the whole order, is as if the feed had been read on one thread.
+ *
+ * Chunks are about 64KB however long the text, and parsing runs at most a window of
+ * two chunks per thread ahead of consume, so the parsed records held at once come
+ * from a fixed amount of text. Their vectors are reused from one window to the next.
+ *
+ * An exception thrown by parse or consume stops the parsing; once every parse thread
+ * has finished, the first one is rethrown on the calling thread.
+ */
+template<typename R, typename Parse, typename Consume>
+void ParallelIngest(string_view text, size_t threads, Parse parse, Consume consume)
+{
+  if (threads == 0)
+    threads = 1;
+  // Chunks of about 64KB, as many as the text needs
+  vector<string_view> chunks = SplitChunks(text, text.size() / 65536 + 1);
+  size_t window = threads * 2;
+
+  // Chunk i is parsed into parsed[i % window], free once chunk i - window is consumed
+  vector<vector<R>> parsed(window);
+  vector<char> done(chunks.size(), 0);
+  mutex lock;
+  condition_variable changed;
+  size_t next = 0;
+  size_t consumed = 0;
+  // The first exception thrown by parse or consume, which stops every thread
+  exception_ptr failure;
+
+  // Record a failure and wake every thread to stop
+  auto fail = [&](exception_ptr error) {
+    {
+      lock_guard<mutex> guard(lock);
+      if (!failure)
+        failure = error;
+    }
+    changed.notify_all();
+  };
+
+  auto work = [&] {
+    while (true)
+    {
+      size_t i;
+      {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [&] { return failure || next >= chunks.size() || next < consumed + window; });
+        if (failure || next >= chunks.size())
+          return;
+        i = next++;
+      }
+      try
+      {
+        parse(chunks[i], parsed[i % window]);
+      }
+      catch (...)
+      {
+        fail(current_exception());
+        return;
+      }
+      {
+        lock_guard<mutex> guard(lock);
+        done[i] = 1;
+      }
+      changed.notify_all();
+    }
+  };
+  vector<thread> workers;
+  try
+  {
+    for (size_t t = 0; t < threads; t++)
+      workers.emplace_back(work);
+
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+      {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [&] { return failure || done[i] != 0; });
+        if (failure)
+          break;
+      }
+      consume(parsed[i % window]);
+      parsed[i % window].clear();
+      {
+        lock_guard<mutex> guard(lock);
+        consumed = i + 1;
+      }
+      changed.notify_all();
+    }
+  }
+  catch (...)
+  {
+    fail(current_exception());
+  }
+  // Every worker is joined before a failure goes on up, as on one thread
+  for (auto &worker : workers)
+    worker.join();
+  if (failure)
+    rethrow_exception(failure);
+}
+
+#endif
@@ -18,14 +18,14 @@ template<typename T>
 class ExecutionAlgoService : public Service<string,ExecutionOrder<T> >
 {
 private:
-	map<string, ExecutionOrder<T>> ordermap;
+	ProductTable<ExecutionOrder<T>> ordermap;
 	vector<ServiceListener<ExecutionOrder<T>>*> listeners;
 	ExecutionAlgoListener<T>* listener;
 public:
 	ExecutionAlgoService() {
 		listener = new ExecutionAlgoListener<T>(this);
 		listeners = vector<ServiceListener<ExecutionOrder<T>>*>();
-		ordermap = map<string, ExecutionOrder<T>>();
+		ordermap = ProductTable<ExecutionOrder<T>>();
 	}
 	~ExecutionAlgoService() {
 		delete listener;
@@ -41,7 +41,7 @@ public:
 	// The callback that a Connector should invoke for any new or updated data
 	virtual void OnMessage(ExecutionOrder<T> &data)
 	{
-		ordermap[data.GetProduct().GetProductId()] = data;
+		ordermap[data.GetProduct().GetProductIndex()] = data;
 	}
 
 	// Add a listener to the Service for callbacks on add, remove, and update events
@@ -58,6 +58,8 @@ public:
 	}
 
 	virtual void ExecuteOrder(ExecutionOrder<T>& executionorder) {
+		static const LatencyPoint hop("execution algo");
+		LatencyHop trace(hop);
 		for (auto& l : listeners)
 			l->ProcessAdd(executionorder);
 	}
@@ -67,8 +69,12 @@ public:
 
 };
 
+// Listens to the top of each book, which is all the algo trades on, so depth
+// changes behind the best bid and offer never reach it. The top is only reported
+// when it moves in price or size, so a book that stays tight is crossed once, not
+// again for every book or update that leaves its top as it was.
 template<typename T>
-class ExecutionAlgoListener :public ServiceListener<OrderBook<T>> {
+class ExecutionAlgoListener :public ServiceListener<TopOfBook<T>> {
 private:
 	ExecutionAlgoService<T>* exealgo;
 public:
@@ -76,12 +82,21 @@ public:
 		exealgo = s;
 	}
 	~ExecutionAlgoListener() {}
-	void ProcessAdd(OrderBook<T> &data)
+	void ProcessAdd(TopOfBook<T> &data)
+	{
+		CheckBook(data);
+	}
+
+	// Cross the spread of a book whose bid and offer are within 1/128 (two ticks)
+	void CheckBook(const TopOfBook<T> &data)
 	{
 		static int i = 1;
-		Order bid=data.GetBidOffer().GetBidOrder();
-		Order offer = data.GetBidOffer().GetOfferOrder();
-		if (offer.GetPrice() - bid.GetPrice() < 1 / 127)
+		const BidOffer& best = data.GetBidOffer();
+		const Order& bid = best.GetBidOrder();
+		const Order& offer = best.GetOfferOrder();
+		if (bid.GetQuantity() == 0 || offer.GetQuantity() == 0)
+			return;
+		if (offer.GetPrice() - bid.GetPrice() <= FixedPrice::FromTicks(2))
 		{
 			ExecutionOrder<T> order1(data.GetProduct(), OFFER, to_string(i), MARKET, bid.GetPrice(), bid.GetQuantity() / 3, bid.GetQuantity() - bid.GetQuantity() / 3, to_string(i), false);
 			i++;
@@ -95,10 +110,10 @@ public:
 	}
 
 	// Listener callback to process a remove event to the Service
-	virtual void ProcessRemove(OrderBook<T> &data) {}
+	virtual void ProcessRemove(TopOfBook<T> &data) {}
 
 	// Listener callback to process an update event to the Service
-	virtual void ProcessUpdate(OrderBook<T> &data) {}
+	virtual void ProcessUpdate(TopOfBook<T> &data) {}
 
 
 };
@@ -10,6 +10,9 @@
 #include <string>
 #include "soa.hpp"
 #include "marketdataservice.hpp"
+#include "latency.hpp"
+#include "recordwriter.hpp"
+#include "binaryrecords.hpp"
 //#include "executionAlgoservice.hpp"
 
 using namespace std;
@@ -17,8 +20,6 @@ using namespace std;
 
 enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
 
-enum Market { BROKERTEC, ESPEED, CME };
-
 /**
  * An execution order that can be placed on an exchange.
  * Type T is the product type.
@@ -30,7 +31,7 @@ class ExecutionOrder
 public:
 
   // ctor for an order
-  ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder);
+  ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, FixedPrice _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder);
   ExecutionOrder() = default;
   // Get the product
   const T& GetProduct() const;
@@ -40,16 +41,31 @@ public:
   }
 
   string order_to_string() {
-	  string s1 = product.GetProductId();
-	  string s2;
-	  if (side == BID)
-		  s2 = "BID";
-	  else
-		  s2 = "OFFER";
-	  return s1 + "," + s2 + "," + orderId + "," + "MARKET" + "," + to_string(price) + "," + to_string(visibleQuantity) + "," + to_string(hiddenQuantity) + "," + parentOrderId + "," + "FALSE";
-
+	  char buffer[256];
+	  RecordWriter out(buffer, sizeof(buffer));
+	  order_to_chars(out);
+	  return string(out.View());
+  }
 
+  // Write productId,side,orderId,MARKET,price,visibleQuantity,hiddenQuantity,parentOrderId,FALSE
+  void order_to_chars(RecordWriter &out) const {
+	  out.Text(product->GetProductId()).Text(side == BID ? ",BID," : ",OFFER,").Text(orderId).Text(",MARKET,")
+		  .Fixed(price.ToDouble()).Char(',').Fixed(visibleQuantity).Char(',').Fixed(hiddenQuantity).Char(',')
+		  .Text(parentOrderId).Text(",FALSE");
+  }
 
+  // Fill every field of a record but its time
+  void order_to_record(ExecutionRecord &record) const {
+	  SetRecordText(record.productId, product->GetProductId());
+	  SetRecordText(record.orderId, orderId);
+	  SetRecordText(record.parentOrderId, parentOrderId);
+	  record.price = price.ToDouble();
+	  record.visibleQuantity = visibleQuantity;
+	  record.hiddenQuantity = hiddenQuantity;
+	  record.side = uint8_t(side);
+	  record.orderType = uint8_t(orderType);
+	  record.isChildOrder = uint8_t(isChildOrder);
+	  memset(record.unused, 0, sizeof(record.unused));
   }
 
 
@@ -60,7 +76,7 @@ public:
   OrderType GetOrderType() const;
 
   // Get the price on this order
-  double GetPrice() const;
+  FixedPrice GetPrice() const;
 
   // Get the visible quantity on this order
   long GetVisibleQuantity() const;
@@ -75,11 +91,11 @@ public:
   bool IsChildOrder() const;
 
 private:
-  T product;
+  const T *product = nullptr;
   PricingSide side;
+  FixedPrice price;
   string orderId;
   OrderType orderType;
-  double price;
   double visibleQuantity;
   double hiddenQuantity;
   string parentOrderId;
@@ -103,7 +119,7 @@ template<typename T>
 class ExecutionService : public Service<string,ExecutionOrder <T> >
 {
 private:
-	map<string, ExecutionOrder<T>> ordermap;
+	ProductTable<ExecutionOrder<T>> ordermap;
 	vector<ServiceListener<ExecutionOrder<T>>*> listeners;
 	ExecutionListener<T>* listener;
 
@@ -111,7 +127,7 @@ public:
 	ExecutionService() {
 		listener = new ExecutionListener<T>(this);
 		listeners = vector<ServiceListener<ExecutionOrder<T>>*>();
-		ordermap = map<string, ExecutionOrder<T>>();
+		ordermap = ProductTable<ExecutionOrder<T>>();
 		
 	}
 	~ExecutionService() {
@@ -128,7 +144,7 @@ public:
 	// The callback that a Connector should invoke for any new or updated data
 	virtual void OnMessage(ExecutionOrder<T> &data)
 	{
-		ordermap[data.GetProduct().GetProductId()] = data;
+		ordermap[data.GetProduct().GetProductIndex()] = data;
 	}
 
 	// Add a listener to the Service for callbacks on add, remove, and update events
@@ -150,6 +166,8 @@ public:
 
   // Execute an order on a market
 	void ExecuteOrder( ExecutionOrder<T>& order, Market market) {
+		static const LatencyPoint hop("execution");
+		LatencyHop trace(hop);
 		for (auto& l : listeners)
 			l->ProcessAdd(order);
 
@@ -195,8 +213,8 @@ public:
 
 
 template<typename T>
-ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder) :
-  product(_product)
+ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, FixedPrice _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder) :
+  product(&_product)
 {
   side = _side;
   orderId = _orderId;
@@ -211,7 +229,7 @@ ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, string _
 template<typename T>
 const T& ExecutionOrder<T>::GetProduct() const
 {
-  return product;
+  return *product;
 }
 
 template<typename T>
@@ -227,7 +245,7 @@ OrderType ExecutionOrder<T>::GetOrderType() const
 }
 
 template<typename T>
-double ExecutionOrder<T>::GetPrice() const
+FixedPrice ExecutionOrder<T>::GetPrice() const
 {
   return price;
 }
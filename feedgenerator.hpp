@@ -0,0 +1,508 @@
+/**
+ * feedgenerator.hpp
+ * Defines a seeded generator of synthetic price, trade, market and inquiry feeds,
+ * and of reference data for their products.
+ */
+#ifndef FEED_GENERATOR_HPP
+#define FEED_GENERATOR_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "binaryrecords.hpp"
+#include "recordwriter.hpp"
+#include "pricingservice.hpp"
+#include "tradebookingservice.hpp"
+#include "marketdataservice.hpp"
+#include "inquiryservice.hpp"
+
+using namespace std;
+
+/**
+ * SplitMix64, a 64-bit generator with a single word of state. Any two seeds give
+ * unrelated streams, so a feed seeds one per block of messages from its own seed
+ * and the block's position, and each block can be drawn on any thread.
+ */
+class SplitMix64
+{
+
+public:
+  typedef uint64_t result_type;
+
+  explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+
+  result_type operator()()
+  {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  // Get a number in [0, n)
+  uint64_t Below(uint64_t n) { return (*this)() % n; }
+
+  // Get a number in [0, 1)
+  double Uniform() { return double((*this)() >> 11) * (1.0 / 9007199254740992.0); }
+
+  // Get a standard normal number
+  double Normal()
+  {
+    double u = 1.0 - Uniform();
+    return sqrt(-2.0 * log(u)) * cos(6.283185307179586 * Uniform());
+  }
+
+private:
+  uint64_t state;
+
+};
+
+/**
+ * How feeds are generated. Prices are whole numbers of 256ths, as the fractional
+ * notation of the feeds requires, and sizes are whole millions.
+ */
+struct FeedGeneratorConfig
+{
+  uint64_t seed = 1;
+  // Threads drawing and formatting messages; the output does not depend on it
+  size_t threads = 1;
+  RecordFormat format = TEXT_RECORDS;
+
+  // Every product starts at a mid drawn from [lowest, highest] 256ths. Each message
+  // moves its product's mid by a normal step of volatility 256ths, less reversion
+  // of its distance from the start, and keeps it in the band.
+  int64_t lowest = 99 * 256;
+  int64_t highest = 101 * 256 - 1;
+  double volatility = 2;
+  double reversion = 0.01;
+
+  // Bid/offer spread in 256ths, drawn from [minSpread, maxSpread]
+  int minSpread = 2;
+  int maxSpread = 4;
+
+  // Levels a side in each book; every level is levelStep 256ths wider than the one
+  // inside it and a million larger. With levelJitter, each level quotes its own mid,
+  // a normal distance of levelJitter 256ths from the book's, so books may cross.
+  size_t depth = 5;
+  int levelStep = 2;
+  double levelJitter = 0;
+
+  // Share of trades and of inquiries that are buys
+  double tradeBuyShare = 0.5;
+  double inquiryBuyShare = 0.5;
+
+  // Trade and inquiry sizes, drawn from 1 to maxSize millions
+  int maxSize = 5;
+
+  // Activity across products: the i-th product is picked with weight 1/(i+1)^skew,
+  // so 0 spreads messages evenly and 1 gives a few products most of them
+  double skew = 0;
+};
+
+/**
+ * Writes feeds in the formats the connectors read, as text or as binary records,
+ * for a list of products. The files depend only on the products, the configuration
+ * and the counts asked for: the same seed writes the same bytes on any number of
+ * threads.
+ *
+ * Messages are drawn in blocks of a fixed size, each block from its own generator,
+ * and a window of blocks is drawn in parallel. The walk of the mids then runs over
+ * the window in order on one thread, which is only an addition per message, and the
+ * window is formatted in parallel and written out in order.
+ */
+class FeedGenerator
+{
+
+public:
+
+  // ctor for a generator over the given products
+  FeedGenerator(const vector<string> &_products, const FeedGeneratorConfig &_config) :
+    products(_products), config(_config)
+  {
+    if (config.skew > 0)
+    {
+      double total = 0;
+      for (size_t i = 0; i < products.size(); i++)
+      {
+        total += 1.0 / pow(double(i + 1), config.skew);
+        cumulative.push_back(total);
+      }
+      for (double &weight : cumulative)
+        weight /= total;
+    }
+  }
+
+  // Get the identifier of the i-th synthetic product
+  static string SyntheticProductId(size_t i)
+  {
+    // "B" and the 20 digits of the largest size_t
+    char id[24];
+    snprintf(id, sizeof(id), "B%05zu", i);
+    return id;
+  }
+
+  // Get the identifiers of count synthetic products
+  static vector<string> SyntheticProducts(size_t count)
+  {
+    vector<string> ids;
+    for (size_t i = 0; i < count; i++)
+      ids.push_back(SyntheticProductId(i));
+    return ids;
+  }
+
+  // Get the product identifiers of reference data in the layout ProductRegistry::Load reads
+  static vector<string> ReadProductIds(ifstream &file)
+  {
+    vector<string> ids;
+    string line;
+    while (getline(file, line))
+      if (count(line.begin(), line.end(), ',') >= 4)
+        ids.push_back(line.substr(0, line.find(',')));
+    return ids;
+  }
+
+  // Write reference data for the products, in the layout ProductRegistry::Load reads
+  void WriteReference(const string &path) const
+  {
+    ofstream file(path);
+    for (size_t i = 0; i < products.size(); i++)
+    {
+      char line[96];
+      snprintf(line, sizeof(line), "%s,CUSIP,T,%.3f,%d-%02d-15\n", products[i].c_str(), 1 + double(i % 40) * 0.125,
+        2019 + int(i % 30), 1 + int(i % 12));
+      file << line;
+    }
+  }
+
+  // productId,mid,spread
+  void WritePrices(const string &path, size_t count)
+  {
+    Generate<PriceRecord>(path, count, [&](const Draw &draw, size_t, string &out) {
+      if (config.format == BINARY_RECORDS)
+      {
+        PriceRecord record = PriceRecord();
+        SetRecordText(record.productId, products[draw.product]);
+        record.mid = Price(draw.mid);
+        record.spread = Price(draw.spread);
+        Append(out, record);
+        return;
+      }
+      char line[128];
+      RecordWriter text(line, sizeof(line));
+      text.Text(products[draw.product]).Char(',').Fractional(Price(draw.mid)).Char(',')
+        .Fractional(Price(draw.spread)).Char('\n');
+      out.append(text.Data(), text.Size());
+    });
+  }
+
+  // productId,tradeId,price,quantity,book,side, with trade IDs numbered from 1
+  void WriteTrades(const string &path, size_t count)
+  {
+    static const char *books[] = { "TRSY1", "TRSY2", "TRSY3" };
+    Generate<TradeRecord>(path, count, [&](const Draw &draw, size_t index, string &out) {
+      long long quantity = 1000000LL * draw.size;
+      if (config.format == BINARY_RECORDS)
+      {
+        char tradeId[24];
+        TradeRecord record = TradeRecord();
+        SetRecordText(record.productId, products[draw.product]);
+        SetRecordText(record.tradeId, string_view(tradeId, size_t(snprintf(tradeId, sizeof(tradeId), "%zu", index + 1))));
+        SetRecordText(record.book, books[draw.book]);
+        record.price = Price(draw.mid);
+        record.quantity = quantity;
+        record.side = uint8_t(draw.buy ? BUY : SELL);
+        Append(out, record);
+        return;
+      }
+      char line[160];
+      RecordWriter text(line, sizeof(line));
+      text.Text(products[draw.product]).Char(',').Integer((long long)(index + 1)).Char(',')
+        .Fractional(Price(draw.mid)).Char(',').Integer(quantity).Char(',').Text(books[draw.book]).Char(',')
+        .Text(draw.buy ? "BUY" : "SELL").Char('\n');
+      out.append(text.Data(), text.Size());
+    });
+  }
+
+  // productId,mid,spread,quantity, depth lines to a book, widening from the inside
+  // level out
+  void WriteMarket(const string &path, size_t books)
+  {
+    Generate<MarketRecord>(path, books, [&](const Draw &draw, size_t, string &out) {
+      SplitMix64 levels(draw.noise);
+      for (size_t level = 0; level < config.depth; level++)
+      {
+        int64_t spread = draw.spread + int64_t(level) * config.levelStep;
+        int64_t mid = draw.mid;
+        if (config.levelJitter > 0)
+          mid += llround(levels.Normal() * config.levelJitter);
+        long long quantity = 1000000LL * (long long)(level + 1);
+        if (config.format == BINARY_RECORDS)
+        {
+          MarketRecord record = MarketRecord();
+          SetRecordText(record.productId, products[draw.product]);
+          record.mid = Price(mid);
+          record.spread = Price(spread);
+          record.quantity = quantity;
+          Append(out, record);
+          continue;
+        }
+        char line[128];
+        RecordWriter text(line, sizeof(line));
+        text.Text(products[draw.product]).Char(',').Fractional(Price(mid)).Char(',')
+          .Fractional(Price(spread)).Char(',').Integer(quantity).Char('\n');
+        out.append(text.Data(), text.Size());
+      }
+    });
+  }
+
+  // productId,action,side,price,quantity: the level changes that move each product's
+  // book, depth levels a side on a grid of levelStep, from its last mid and spread to
+  // the new ones. A product's first message adds its whole book, and a message that
+  // moves neither resizes one level. Returns the number of updates written.
+  size_t WriteMarketUpdates(const string &path, size_t count)
+  {
+    static const char *actions[] = { "ADD", "MODIFY", "DELETE" };
+    atomic<size_t> written(0);
+    int64_t step = max(config.levelStep, 1);
+    int64_t depth = int64_t(config.depth);
+    Generate<BookUpdateRecord>(path, count, [&](const Draw &draw, size_t, string &out) {
+      size_t lines = 0;
+      auto emit = [&](BookAction action, PricingSide side, int64_t price, long long quantity) {
+        lines++;
+        if (config.format == BINARY_RECORDS)
+        {
+          BookUpdateRecord record = BookUpdateRecord();
+          SetRecordText(record.productId, products[draw.product]);
+          record.price = Price(price);
+          record.quantity = quantity;
+          record.action = uint8_t(action);
+          record.side = uint8_t(side);
+          Append(out, record);
+          return;
+        }
+        char line[128];
+        RecordWriter text(line, sizeof(line));
+        text.Text(products[draw.product]).Char(',').Text(actions[action]).Char(',')
+          .Text(side == BID ? "BID" : "OFFER").Char(',').Fractional(Price(price)).Char(',')
+          .Integer(quantity).Char('\n');
+        out.append(text.Data(), text.Size());
+      };
+      // The k-th level of a side quotes the inside price, less k steps for bids and
+      // plus k steps for offers. Inside prices are rounded out to the grid, so a move
+      // only changes the levels it crosses. Level finds k for a price, or -1 off the book.
+      auto Grid = [&](int64_t price) { return price - ((price % step) + step) % step; };
+      int64_t bid = Grid(draw.mid - draw.spread / 2);
+      int64_t offer = Grid(draw.mid - draw.spread / 2 + draw.spread + step - 1);
+      int64_t lastBid = Grid(draw.lastMid - draw.lastSpread / 2);
+      int64_t lastOffer = Grid(draw.lastMid - draw.lastSpread / 2 + draw.lastSpread + step - 1);
+      auto Level = [&](PricingSide side, int64_t inside, int64_t price) -> int64_t {
+        int64_t distance = side == BID ? inside - price : price - inside;
+        return distance >= 0 && distance % step == 0 && distance / step < depth ? distance / step : -1;
+      };
+      for (PricingSide side : { BID, OFFER })
+      {
+        int64_t inside = side == BID ? bid : offer;
+        int64_t lastInside = side == BID ? lastBid : lastOffer;
+        int64_t direction = side == BID ? -1 : 1;
+        for (int64_t k = 0; k < depth && draw.lastSpread > 0; k++)
+          if (Level(side, inside, lastInside + direction * k * step) < 0)
+            emit(DELETE_LEVEL, side, lastInside + direction * k * step, 0);
+        for (int64_t k = 0; k < depth; k++)
+          if (draw.lastSpread == 0 || Level(side, lastInside, inside + direction * k * step) < 0)
+            emit(ADD_LEVEL, side, inside + direction * k * step, 1000000LL * (k + 1));
+      }
+      if (lines == 0 && depth > 0)
+      {
+        PricingSide side = draw.noise & 1 ? OFFER : BID;
+        int64_t k = int64_t((draw.noise >> 1) % uint64_t(depth));
+        int64_t price = side == BID ? bid - k * step : offer + k * step;
+        emit(MODIFY_LEVEL, side, price, 1000000LL * draw.size);
+      }
+      written.fetch_add(lines, memory_order_relaxed);
+    });
+    return written.load();
+  }
+
+  // productId,side,quantity,mid,spread,RECEIVED
+  void WriteInquiries(const string &path, size_t count)
+  {
+    Generate<InquiryRecord>(path, count, [&](const Draw &draw, size_t, string &out) {
+      long long quantity = 1000000LL * draw.size;
+      if (config.format == BINARY_RECORDS)
+      {
+        InquiryRecord record = InquiryRecord();
+        SetRecordText(record.productId, products[draw.product]);
+        record.quantity = quantity;
+        record.mid = Price(draw.mid);
+        record.spread = Price(draw.spread);
+        record.side = uint8_t(draw.inquiryBuy ? BUY : SELL);
+        record.state = uint8_t(RECEIVED);
+        Append(out, record);
+        return;
+      }
+      char line[160];
+      RecordWriter text(line, sizeof(line));
+      text.Text(products[draw.product]).Char(',').Text(draw.inquiryBuy ? "BUY" : "SELL").Char(',')
+        .Integer(quantity).Char(',').Fractional(Price(draw.mid)).Char(',').Fractional(Price(draw.spread))
+        .Text(",RECEIVED\n");
+      out.append(text.Data(), text.Size());
+    });
+  }
+
+private:
+  // Messages drawn from one generator
+  static const size_t BLOCK = 16384;
+
+  // The random part of one message; mid is filled in by the walk
+  struct Draw
+  {
+    uint32_t product;
+    int32_t step;
+    int64_t mid;
+    int64_t spread;
+    // The product's mid and spread in its message before, or a spread of 0 if none
+    int64_t lastMid;
+    int64_t lastSpread;
+    // Seeds any further draws the message needs, such as the levels of a book
+    uint64_t noise;
+    uint8_t book;
+    uint8_t size;
+    bool buy;
+    bool inquiryBuy;
+  };
+
+  vector<string> products;
+  FeedGeneratorConfig config;
+  // Cumulative pick weights when activity is skewed
+  vector<double> cumulative;
+
+  static double Price(int64_t ticks) { return double(ticks) / 256.0; }
+
+  template<typename R>
+  static void Append(string &out, const R &record)
+  {
+    out.append(reinterpret_cast<const char*>(&record), sizeof(record));
+  }
+
+  // Get the generator of a block of a feed; block ~0 is the feed's starting mids
+  SplitMix64 BlockGenerator(RecordType feed, uint64_t block) const
+  {
+    SplitMix64 mix(config.seed ^ (uint64_t(feed) << 56));
+    return SplitMix64(mix() + block * 0xd1b54a32d192ed03ULL);
+  }
+
+  uint32_t Pick(SplitMix64 &rng) const
+  {
+    if (cumulative.empty())
+      return uint32_t(rng.Below(products.size()));
+    size_t i = size_t(lower_bound(cumulative.begin(), cumulative.end(), rng.Uniform()) - cumulative.begin());
+    return uint32_t(min(i, products.size() - 1));
+  }
+
+  void DrawBlock(SplitMix64 rng, size_t count, vector<Draw> &draws) const
+  {
+    draws.resize(count);
+    int spreads = max(1, config.maxSpread - config.minSpread + 1);
+    for (Draw &draw : draws)
+    {
+      draw.product = Pick(rng);
+      draw.step = int32_t(llround(rng.Normal() * config.volatility));
+      draw.mid = 0;
+      draw.spread = config.minSpread + int64_t(rng.Below(uint64_t(spreads)));
+      draw.noise = rng();
+      draw.book = uint8_t(rng.Below(3));
+      draw.size = uint8_t(1 + rng.Below(uint64_t(max(1, config.maxSize))));
+      draw.buy = rng.Uniform() < config.tradeBuyShare;
+      draw.inquiryBuy = rng.Uniform() < config.inquiryBuyShare;
+    }
+  }
+
+  // Run work(i) for i in [0, count) on up to config.threads threads
+  template<typename Work>
+  void ParallelFor(size_t count, Work work) const
+  {
+    size_t threads = min(max<size_t>(config.threads, 1), count);
+    if (threads <= 1)
+    {
+      for (size_t i = 0; i < count; i++)
+        work(i);
+      return;
+    }
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; t++)
+      workers.emplace_back([&, t] {
+        for (size_t i = t; i < count; i += threads)
+          work(i);
+      });
+    for (auto &worker : workers)
+      worker.join();
+  }
+
+  // Write count messages of a feed of R records; format(draw, index, out) appends
+  // the message as text or binary
+  template<typename R, typename Format>
+  void Generate(const string &path, size_t count, Format format)
+  {
+    ofstream file(path, ios::binary);
+    if (config.format == BINARY_RECORDS)
+    {
+      RecordHeader header = MakeRecordHeader(R::TYPE, sizeof(R));
+      file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    if (products.empty())
+      return;
+
+    vector<int64_t> start(products.size());
+    SplitMix64 rng = BlockGenerator(R::TYPE, ~0ULL);
+    uint64_t band = uint64_t(max<int64_t>(config.highest - config.lowest + 1, 1));
+    for (int64_t &mid : start)
+      mid = config.lowest + int64_t(rng.Below(band));
+    vector<int64_t> mids(start);
+    vector<int64_t> spreads(products.size(), 0);
+
+    size_t blocks = (count + BLOCK - 1) / BLOCK;
+    size_t window = max<size_t>(config.threads, 1) * 4;
+    vector<vector<Draw>> draws(window);
+    vector<string> out(window);
+    for (size_t first = 0; first < blocks; first += window)
+    {
+      size_t n = min(window, blocks - first);
+      ParallelFor(n, [&](size_t i) {
+        size_t block = first + i;
+        DrawBlock(BlockGenerator(R::TYPE, block), min(BLOCK, count - block * BLOCK), draws[i]);
+      });
+      for (size_t i = 0; i < n; i++)
+        for (Draw &draw : draws[i])
+        {
+          int64_t &mid = mids[draw.product];
+          draw.lastMid = mid;
+          draw.lastSpread = spreads[draw.product];
+          spreads[draw.product] = draw.spread;
+          mid += draw.step - llround(double(mid - start[draw.product]) * config.reversion);
+          mid = min(max(mid, config.lowest), config.highest);
+          draw.mid = mid;
+        }
+      ParallelFor(n, [&](size_t i) {
+        size_t index = (first + i) * BLOCK;
+        out[i].clear();
+        for (const Draw &draw : draws[i])
+          format(draw, index++, out[i]);
+      });
+      for (size_t i = 0; i < n; i++)
+        file.write(out[i].data(), streamsize(out[i].size()));
+    }
+  }
+
+};
+
+#endif
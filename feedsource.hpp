@@ -0,0 +1,340 @@
+/**
+ * feedsource.hpp
+ * Defines line and block sources that connectors read feeds from, and helpers that
+ * split and parse lines in place.
+ */
+#ifndef FEED_SOURCE_HPP
+#define FEED_SOURCE_HPP
+
+#include <string>
+#include <string_view>
+#include <istream>
+#include <charconv>
+#include <cstring>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef NOGDI
+#define NOGDI
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+/**
+ * A feed read one line at a time, or for binary feeds one fixed-size block at a time.
+ * A line is handed out as a view without its line terminator, a block as a view of
+ * exactly the size asked for; either stays valid until the next call that reads.
+ */
+class FeedSource
+{
+
+public:
+
+  virtual ~FeedSource() {}
+
+  // Get the next line; false at the end of the feed
+  virtual bool NextLine(string_view &line) = 0;
+
+  // Get the next size bytes; false if fewer than that are left
+  virtual bool NextBlock(size_t size, string_view &block) = 0;
+
+  // Look at up to size bytes at the front of the feed without reading them
+  virtual string_view Peek(size_t size) = 0;
+
+  // Get whether the next line can be read without waiting for the feed to grow.
+  // Connectors that batch push what they hold when it cannot, so nothing sits in a
+  // part-filled block while a followed file is idle.
+  virtual bool Ready() { return true; }
+
+  // Get whether the next size bytes can be read without waiting, as Ready() does for
+  // a line
+  virtual bool BlockReady(size_t /*size*/) { return true; }
+
+  // Take the whole unread rest of the feed at once if it is all in memory, leaving
+  // nothing to read; false, with nothing taken, if it is not
+  virtual bool TakeRest(string_view &/*rest*/) { return false; }
+
+};
+
+/**
+ * Feed read from a stream with getline, one copy per line into a reused buffer.
+ * A binary feed must come from a stream opened with ios::binary.
+ */
+class StreamFeedSource : public FeedSource
+{
+
+public:
+
+  // ctor for a feed over an open stream
+  explicit StreamFeedSource(istream &_stream) :
+    stream(_stream)
+  {
+  }
+
+  // Get the next line; false at the end of the feed
+  virtual bool NextLine(string_view &line)
+  {
+    if (!pending.empty())
+    {
+      // Finish the line the peeked bytes start
+      size_t end = pending.find('\n');
+      if (end == string::npos)
+      {
+        string rest;
+        getline(stream, rest);
+        pending += rest;
+        end = pending.size();
+      }
+      buffer.assign(pending, 0, end);
+      pending.erase(0, end + 1);
+      line = buffer;
+      return true;
+    }
+    if (!getline(stream, buffer))
+      return false;
+    line = buffer;
+    return true;
+  }
+
+  // Get the next size bytes; false if fewer than that are left
+  virtual bool NextBlock(size_t size, string_view &block)
+  {
+    size_t have = pending.size() < size ? pending.size() : size;
+    buffer.assign(pending, 0, have);
+    pending.erase(0, have);
+    if (have < size)
+    {
+      buffer.resize(size);
+      stream.read(&buffer[have], streamsize(size - have));
+      if (size_t(stream.gcount()) != size - have)
+        return false;
+    }
+    block = buffer;
+    return true;
+  }
+
+  // Look at up to size bytes at the front of the feed without reading them
+  virtual string_view Peek(size_t size)
+  {
+    size_t have = pending.size();
+    if (have < size)
+    {
+      pending.resize(size);
+      stream.read(&pending[have], streamsize(size - have));
+      pending.resize(have + size_t(stream.gcount()));
+      // A short read leaves the stream failed; what was read is all in pending
+      if (!stream.bad())
+        stream.clear();
+    }
+    return string_view(pending).substr(0, size);
+  }
+
+private:
+  istream &stream;
+  string buffer;
+  // Bytes read ahead by Peek, handed out before anything more is read
+  string pending;
+
+};
+
+/**
+ * Feed read from a memory-mapped file.
+ * Lines and blocks are views straight into the mapping, so nothing is copied or
+ * allocated per line and ingest runs at the speed the pages can be scanned. Both LF and
+ * CRLF line ends are accepted. The file must not be truncated while it is mapped.
+ */
+class MappedFeedSource : public FeedSource
+{
+
+public:
+
+  // ctor for a feed over a file; check IsOpen() before reading
+  explicit MappedFeedSource(const string &path);
+  ~MappedFeedSource();
+
+  MappedFeedSource(const MappedFeedSource&) = delete;
+  MappedFeedSource& operator=(const MappedFeedSource&) = delete;
+
+  // Get whether the file was opened and mapped
+  bool IsOpen() const { return open; }
+
+  // Get the whole file
+  string_view GetData() const { return string_view(data, size); }
+
+  // Get the next line; false at the end of the feed
+  virtual bool NextLine(string_view &line)
+  {
+    if (offset >= size)
+      return false;
+    const char *start = data + offset;
+    const char *end = static_cast<const char*>(memchr(start, '\n', size - offset));
+    size_t length = end ? size_t(end - start) : size - offset;
+    offset += end ? length + 1 : length;
+    if (length > 0 && start[length - 1] == '\r')
+      length--;
+    line = string_view(start, length);
+    return true;
+  }
+
+  // Get the next size bytes; false if fewer than that are left
+  virtual bool NextBlock(size_t size, string_view &block)
+  {
+    if (size > size_t(this->size - offset))
+      return false;
+    block = string_view(data + offset, size);
+    offset += size;
+    return true;
+  }
+
+  // Look at up to size bytes at the front of the feed without reading them
+  virtual string_view Peek(size_t size)
+  {
+    return GetData().substr(offset, size);
+  }
+
+  // Take the whole unread rest of the mapping
+  virtual bool TakeRest(string_view &rest)
+  {
+    rest = GetData().substr(offset);
+    offset = size;
+    return true;
+  }
+
+private:
+  const char *data;
+  size_t size;
+  size_t offset;
+  bool open;
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+#else
+  int file;
+#endif
+
+};
+
+#ifdef _WIN32
+
+inline MappedFeedSource::MappedFeedSource(const string &path) :
+  data(nullptr), size(0), offset(0), open(false), file(INVALID_HANDLE_VALUE), mapping(nullptr)
+{
+  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return;
+  LARGE_INTEGER length;
+  if (!GetFileSizeEx(file, &length))
+    return;
+  size = size_t(length.QuadPart);
+  open = true;
+  // An empty file cannot be mapped, and has no lines anyway
+  if (size == 0)
+    return;
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping)
+    data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!data)
+  {
+    size = 0;
+    open = false;
+  }
+}
+
+inline MappedFeedSource::~MappedFeedSource()
+{
+  if (data)
+    UnmapViewOfFile(data);
+  if (mapping)
+    CloseHandle(mapping);
+  if (file != INVALID_HANDLE_VALUE)
+    CloseHandle(file);
+}
+
+#else
+
+inline MappedFeedSource::MappedFeedSource(const string &path) :
+  data(nullptr), size(0), offset(0), open(false), file(-1)
+{
+  file = ::open(path.c_str(), O_RDONLY);
+  if (file < 0)
+    return;
+  struct stat info;
+  if (fstat(file, &info) != 0)
+    return;
+  size = size_t(info.st_size);
+  open = true;
+  // An empty file cannot be mapped, and has no lines anyway
+  if (size == 0)
+    return;
+  void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+  if (mapped == MAP_FAILED)
+  {
+    size = 0;
+    open = false;
+    return;
+  }
+  data = static_cast<const char*>(mapped);
+  madvise(mapped, size, MADV_SEQUENTIAL);
+}
+
+inline MappedFeedSource::~MappedFeedSource()
+{
+  if (data)
+    munmap(const_cast<char*>(data), size);
+  if (file >= 0)
+    close(file);
+}
+
+#endif
+
+// Take the first line off a block of text, without its line end; false if the text
+// is empty
+inline bool TakeLine(string_view &text, string_view &line)
+{
+  if (text.empty())
+    return false;
+  size_t end = text.find('\n');
+  line = text.substr(0, end);
+  text.remove_prefix(end == string_view::npos ? text.size() : end + 1);
+  if (!line.empty() && line.back() == '\r')
+    line.remove_suffix(1);
+  return true;
+}
+
+// Split a line at each separator into at most max fields, without copying; returns
+// the number of fields. A trailing empty field is dropped, as getline would.
+inline size_t SplitFields(string_view line, char separator, string_view *fields, size_t max)
+{
+  size_t count = 0;
+  size_t start = 0;
+  while (count < max && start < line.size())
+  {
+    size_t end = line.find(separator, start);
+    if (end == string_view::npos)
+      end = line.size();
+    fields[count++] = line.substr(start, end - start);
+    start = end + 1;
+  }
+  return count;
+}
+
+// Get the integer at the start of a field; 0 if there is none
+inline long ParseLong(string_view field)
+{
+  long value = 0;
+  from_chars(field.data(), field.data() + field.size(), value);
+  return value;
+}
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * fixedprice.hpp
+ * Defines an exact price held as a whole number of fractions of a point.
+ */
+#ifndef FIXED_PRICE_HPP
+#define FIXED_PRICE_HPP
+
+#include <cstdint>
+#include <cmath>
+#include <functional>
+
+using namespace std;
+
+// Treasury prices move in 256ths of a point
+const int TICKS_PER_POINT = 256;
+
+/**
+ * A price as a whole number of half ticks, 512ths of a point, in 32 bits.
+ * Every price the feeds carry is a whole number of ticks; the half tick is there so
+ * a quote half a spread either side of a mid, as the streaming algo makes, is exact
+ * too. Prices compare, add and hash as integers, and become doubles only where they
+ * are written out or read from a binary record.
+ */
+class FixedPrice
+{
+
+public:
+
+  static const int32_t UNITS_PER_TICK = 2;
+  static const int32_t UNITS_PER_POINT = TICKS_PER_POINT * UNITS_PER_TICK;
+
+  // ctor for a zero price
+  constexpr FixedPrice() : units(0) {}
+
+  // Get the price of a number of half ticks
+  static constexpr FixedPrice FromUnits(int32_t units) { return FixedPrice(units); }
+
+  // Get the price of a number of ticks
+  static constexpr FixedPrice FromTicks(int64_t ticks) { return FixedPrice(int32_t(ticks * UNITS_PER_TICK)); }
+
+  // Get the nearest price to a decimal
+  static FixedPrice FromDouble(double price) { return FixedPrice(int32_t(llround(price * UNITS_PER_POINT))); }
+
+  // Get the number of half ticks
+  constexpr int32_t GetUnits() const { return units; }
+
+  // Get the number of ticks, rounding a half tick up
+  int64_t GetTicks() const
+  {
+    int64_t u = int64_t(units) + 1;
+    return u >= 0 ? u / UNITS_PER_TICK : -((-u + UNITS_PER_TICK - 1) / UNITS_PER_TICK);
+  }
+
+  // Get the price as a decimal, which it is exactly
+  double ToDouble() const { return double(units) / UNITS_PER_POINT; }
+
+  // Get half the price, rounded toward zero if it is an odd number of half ticks
+  constexpr FixedPrice Half() const { return FixedPrice(units / 2); }
+
+  constexpr FixedPrice operator+(FixedPrice other) const { return FixedPrice(units + other.units); }
+  constexpr FixedPrice operator-(FixedPrice other) const { return FixedPrice(units - other.units); }
+  constexpr FixedPrice operator-() const { return FixedPrice(-units); }
+  FixedPrice& operator+=(FixedPrice other) { units += other.units; return *this; }
+  FixedPrice& operator-=(FixedPrice other) { units -= other.units; return *this; }
+
+  constexpr bool operator==(FixedPrice other) const { return units == other.units; }
+  constexpr bool operator!=(FixedPrice other) const { return units != other.units; }
+  constexpr bool operator<(FixedPrice other) const { return units < other.units; }
+  constexpr bool operator<=(FixedPrice other) const { return units <= other.units; }
+  constexpr bool operator>(FixedPrice other) const { return units > other.units; }
+  constexpr bool operator>=(FixedPrice other) const { return units >= other.units; }
+
+private:
+  int32_t units;
+
+  explicit constexpr FixedPrice(int32_t _units) : units(_units) {}
+
+};
+
+namespace std
+{
+  template<>
+  struct hash<FixedPrice>
+  {
+    size_t operator()(FixedPrice price) const { return hash<int32_t>()(price.GetUnits()); }
+  };
+}
+
+#endif
@@ -0,0 +1,261 @@
+/**
+ * followfeedsource.hpp
+ * Defines a feed that follows a file as it grows, as tail -f does, so connectors
+ * keep reading what an upstream process appends.
+ */
+#ifndef FOLLOW_FEED_SOURCE_HPP
+#define FOLLOW_FEED_SOURCE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include "bufferedfeedsource.hpp"
+#ifndef _WIN32
+#include <poll.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#endif
+
+using namespace std;
+
+/**
+ * Feed read from a file that is still being written.
+ * Reads never report the end of the feed while the file may grow: when everything
+ * written so far has been read, a read first spins re-reading the file for a short
+ * while (SetSpin), so a line appended right behind the last one is picked up within
+ * microseconds, and then sleeps until the file changes. On Linux the sleep waits on
+ * inotify and wakes as soon as the file is written; elsewhere it polls, backing off
+ * from 50us to 10ms. A partly written last line is held back until its line end
+ * arrives.
+ *
+ * Stop() ends the feed from any thread: the lines already written are still read,
+ * then reads return false. A file that shrinks is taken to have been truncated and
+ * is read again from the start.
+ */
+class FollowFeedSource : public BufferedFeedSource
+{
+
+public:
+
+  // ctor for a feed over a file, read from the start; check IsOpen() before reading
+  explicit FollowFeedSource(const string &path);
+  ~FollowFeedSource();
+
+  FollowFeedSource(const FollowFeedSource&) = delete;
+  FollowFeedSource& operator=(const FollowFeedSource&) = delete;
+
+  // Get whether the file was opened
+  bool IsOpen() const { return open; }
+
+  // Set how long a read spins on the file before sleeping; zero sleeps at once
+  void SetSpin(chrono::nanoseconds _spin) { spin = _spin; }
+
+  // End the feed once what has been written is read; safe from any thread
+  void Stop();
+
+protected:
+
+  // Read what the file has beyond what was read
+  virtual long long ReadSome(char *buffer, size_t size)
+  {
+    if (!open)
+      return -1;
+    long long count = ReadMore(buffer, size);
+    if (count > 0)
+      position += uint64_t(count);
+    return count;
+  }
+
+  // Wait for the file to grow; true once it has been read further, false when stopped
+  virtual bool Wait()
+  {
+    if (!open)
+      return false;
+    auto deadline = chrono::steady_clock::now() + spin;
+    while (chrono::steady_clock::now() < deadline)
+    {
+      if (stopped.load(memory_order_acquire))
+        return Fill();
+      if (Fill())
+        return true;
+    }
+    chrono::microseconds backoff(50);
+    while (true)
+    {
+      if (stopped.load(memory_order_acquire))
+        return Fill();
+      if (Fill())
+        return true;
+      if (Truncated())
+      {
+        Rewind();
+        continue;
+      }
+      Idle(backoff);
+      if (backoff < chrono::milliseconds(10))
+        backoff *= 2;
+    }
+  }
+
+private:
+  // Bytes read from the file so far
+  uint64_t position;
+  bool open;
+  chrono::nanoseconds spin;
+  atomic<bool> stopped;
+#ifdef _WIN32
+  HANDLE file;
+#else
+  int file;
+  // Stop() writes to wake[1] to end a sleep in poll
+  int wake[2];
+  int watch;
+#endif
+
+  long long ReadMore(char *buffer, size_t size);
+  bool Truncated();
+  void Rewind();
+  void Idle(chrono::microseconds backoff);
+
+};
+
+#ifdef _WIN32
+
+inline FollowFeedSource::FollowFeedSource(const string &path) :
+  position(0), open(false), spin(chrono::microseconds(100)), stopped(false)
+{
+  // The writer keeps the file open for writing while it is followed
+  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+    nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  open = file != INVALID_HANDLE_VALUE;
+}
+
+inline FollowFeedSource::~FollowFeedSource()
+{
+  if (file != INVALID_HANDLE_VALUE)
+    CloseHandle(file);
+}
+
+inline void FollowFeedSource::Stop()
+{
+  stopped.store(true, memory_order_release);
+}
+
+inline long long FollowFeedSource::ReadMore(char *buffer, size_t size)
+{
+  DWORD count = 0;
+  if (!::ReadFile(file, buffer, DWORD(size), &count, nullptr))
+    return -1;
+  return (long long)count;
+}
+
+inline bool FollowFeedSource::Truncated()
+{
+  LARGE_INTEGER length;
+  return GetFileSizeEx(file, &length) && uint64_t(length.QuadPart) < position;
+}
+
+inline void FollowFeedSource::Rewind()
+{
+  LARGE_INTEGER zero;
+  zero.QuadPart = 0;
+  SetFilePointerEx(file, zero, nullptr, FILE_BEGIN);
+  Discard();
+  position = 0;
+}
+
+inline void FollowFeedSource::Idle(chrono::microseconds backoff)
+{
+  this_thread::sleep_for(backoff);
+}
+
+#else
+
+inline FollowFeedSource::FollowFeedSource(const string &path) :
+  position(0), open(false), spin(chrono::microseconds(100)), stopped(false),
+  file(-1), watch(-1)
+{
+  wake[0] = wake[1] = -1;
+  file = ::open(path.c_str(), O_RDONLY);
+  if (file < 0 || pipe(wake) != 0)
+    return;
+  fcntl(wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(wake[1], F_SETFL, O_NONBLOCK);
+#ifdef __linux__
+  // Without inotify the file is polled
+  watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch >= 0 && inotify_add_watch(watch, path.c_str(), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE) < 0)
+  {
+    close(watch);
+    watch = -1;
+  }
+#endif
+  open = true;
+}
+
+inline FollowFeedSource::~FollowFeedSource()
+{
+  for (int fd : { file, wake[0], wake[1], watch })
+    if (fd >= 0)
+      close(fd);
+}
+
+inline void FollowFeedSource::Stop()
+{
+  stopped.store(true, memory_order_release);
+  if (wake[1] >= 0)
+  {
+    char byte = 0;
+    ssize_t written = write(wake[1], &byte, 1);
+    (void)written;
+  }
+}
+
+inline long long FollowFeedSource::ReadMore(char *buffer, size_t size)
+{
+  return (long long)read(file, buffer, size);
+}
+
+inline bool FollowFeedSource::Truncated()
+{
+  struct stat info;
+  return fstat(file, &info) == 0 && uint64_t(info.st_size) < position;
+}
+
+inline void FollowFeedSource::Rewind()
+{
+  lseek(file, 0, SEEK_SET);
+  Discard();
+  position = 0;
+}
+
+inline void FollowFeedSource::Idle(chrono::microseconds backoff)
+{
+  if (watch < 0)
+  {
+    this_thread::sleep_for(backoff);
+    return;
+  }
+  // inotify wakes us when the file is written, and the pipe when we are stopped;
+  // the timeout only covers a file truncated in a way inotify does not report
+  pollfd fds[2];
+  fds[0].fd = watch;
+  fds[0].events = POLLIN;
+  fds[1].fd = wake[0];
+  fds[1].events = POLLIN;
+  if (poll(fds, 2, 100) > 0 && (fds[0].revents & POLLIN))
+  {
+    char events[4096];
+    while (read(watch, events, sizeof(events)) > 0)
+      ;
+  }
+}
+
+#endif
+
+#endif
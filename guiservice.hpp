@@ -9,7 +9,9 @@
 #include<sstream>
 #include "products.hpp"
 #include "pricingservice.hpp"
-#include<sys\timeb.h>
+#include "alloccounter.hpp"
+#include "latency.hpp"
+#include "recordwriter.hpp"
 
 
 
@@ -51,16 +53,18 @@ template<typename T>
 class GuiService:public Service<string,Price<T>>
 {
 private:
-	map<string, Price<T>> pricetable;
+	ProductTable<Price<T>> pricetable;
 	GuiConnector<T>* connector;
 	GuiListener<T>* listener;
 	long long throttle;
+	// Listeners are not supported, so GetListeners returns this empty list
+	vector<ServiceListener<Price<T>>*> listeners;
 
 public:
 	GuiService(long long _throttle=300)
 	{
 		
-		pricetable = map<string, Price<T>>();
+		pricetable = ProductTable<Price<T>>();
 		connector = new GuiConnector<T>();
 		listener = new GuiListener<T>(this);
 		throttle = _throttle;
@@ -78,6 +82,8 @@ public:
 
 	// The callback that a Connector should invoke for any new or updated data
 	virtual void OnMessage(Price<T> &data) {
+		static const LatencyPoint hop("gui");
+		LatencyHop trace(hop);
 		static int countshow = 0;
 		if (countshow == 100)
 		{
@@ -104,15 +110,12 @@ public:
 
 	// Get all listeners on the Service.
 	virtual const vector< ServiceListener<Price<T>>* >& GetListeners()const {
-		return vector<ServiceListener<Price<T>>*>();
+		return listeners;
 	}
 
 };
 
 
-string timestamp();
-
-
 template<typename T>
 class GuiConnector :public Connector<Price<T>>
 {
@@ -124,10 +127,17 @@ public:
 	// Publish data to the Connector
 	void Publish(Price<T> &data)
 	{
+		AllocationExempt exempt;
+		static const LatencyPoint sink("gui published");
+		LatencyTrace::End(sink);
+		char line[512];
+		RecordWriter out(line, sizeof(line));
+		out.Timestamp().Char(',');
+		data.Price_to_chars(out);
+		out.Char('\n');
 		ofstream file;
 		file.open("gui.txt", ios::app);
-		file << timestamp() << ",";
-		file << data.Price_to_string() << endl;
+		file.write(out.Data(), out.Size());
 	}
 
 
@@ -16,7 +16,12 @@
  * Type T is the data type to persist.
  */
 #include"streamingAlgoservice.hpp"
+#include <mutex>
 #include "soa.hpp"
+#include "alloccounter.hpp"
+#include "latency.hpp"
+#include "recordwriter.hpp"
+#include "binaryrecords.hpp"
 #include "positionservice.hpp"
 #include "riskservice.hpp"
 #include "executionservice.hpp"
@@ -35,6 +40,9 @@ class HistoricalDataServiceStream : Service<string,PriceStream<T>>
 private:
 	HisToStreamingListener<T>* listener;
 	HisToStreamingConnector<T>* connector;
+	// Nothing is kept here, so GetData and GetListeners return these empty members
+	PriceStream<T> empty;
+	vector<ServiceListener<PriceStream<T>>*> listeners;
 
 public:
 	HistoricalDataServiceStream() {
@@ -50,8 +58,7 @@ public:
 	// Get data on our service given a key
 	virtual PriceStream<T>& GetData(string key) 
 	{
-		PriceStream<T> x= PriceStream<T>();
-		return x;
+		return empty;
 	}
 
 	// The callback that a Connector should invoke for any new or updated data
@@ -67,13 +74,18 @@ public:
 	// Get all listeners on the Service.
 	virtual const vector< ServiceListener<PriceStream<T>>* >& GetListeners()const
 	{
-		return vector<ServiceListener<PriceStream<T>>*>();
+		return listeners;
 	}
 
 	HisToStreamingListener<T>* GetListener() {
 		return listener;
 	}
 
+	// Set whether streams are stored as text in streaming.txt or binary in streaming.bin
+	void SetFormat(RecordFormat format) {
+		connector->SetFormat(format);
+	}
+
   // Persist data to a store
 	void PersistData(string persistKey,  PriceStream<T>& data) {
 		
@@ -97,6 +109,13 @@ public:
 		service->PersistData("", data);
 	}
 
+	// Pipeline stage: persist, then pass the stream on
+	template<typename Next>
+	void Process(PriceStream<T> &data, Next &next) {
+		service->PersistData("", data);
+		next(data);
+	}
+
 	// Listener callback to process a remove event to the Service
 	virtual void ProcessRemove(PriceStream<T> &data) {}
 
@@ -106,18 +125,45 @@ public:
 template<typename T>
 class HisToStreamingConnector :public Connector<PriceStream<T>>
 {
+private:
+	RecordFormat format;
+
 public:
-	HisToStreamingConnector() {}
+	HisToStreamingConnector() : format(TEXT_RECORDS) {}
 	~HisToStreamingConnector() {}
+
+	// Set the format of the store
+	void SetFormat(RecordFormat _format) {
+		format = _format;
+	}
+
 	// Publish data to the Connector
 	void Publish(PriceStream<T> &data)
 	{
+		AllocationExempt exempt;
+		static const LatencyPoint sink("stream persisted");
+		LatencyTrace::End(sink);
 		
+		if (format == BINARY_RECORDS)
+		{
+			StreamRecord record;
+			record.time = timestamp_millis();
+			data.stream_to_record(record);
+			ofstream file;
+			OpenRecordStore<StreamRecord>(file, "streaming.bin");
+			WriteRecord(file, record);
+			return;
+		}
+		char line[512];
+		RecordWriter out(line, sizeof(line));
+		out.Timestamp().Char(',');
+		data.stream_to_chars_bid(out);
+		out.Char('\n').Timestamp().Char(',');
+		data.stream_to_chars_offer(out);
+		out.Char('\n');
 		ofstream file;
 		file.open("streaming.txt", ios::app);
-		file << timestamp() << ",";
-		file << data.stream_to_string_bid() << endl;
-		file <<timestamp() <<","<<data.stream_to_string_offer() << endl;
+		file.write(out.Data(), out.Size());
 	}
 
 	virtual void Subscribe(ifstream& file) {}
@@ -140,6 +186,9 @@ class HistoricalDataServicePosition : Service<string, Position<T>>
 private:
 	HisToPositionListener<T>* listener;
 	HisToPositionConnector<T>* connector;
+	// Nothing is kept here, so GetData and GetListeners return these empty members
+	Position<T> empty;
+	vector<ServiceListener<Position<T>>*> listeners;
 
 public:
 	HistoricalDataServicePosition() {
@@ -155,8 +204,7 @@ public:
 	// Get data on our service given a key
 	virtual Position<T>& GetData(string key)
 	{
-		Position<T> x = Position<T>();
-		return x;
+		return empty;
 	}
 
 	// The callback that a Connector should invoke for any new or updated data
@@ -172,19 +220,29 @@ public:
 	// Get all listeners on the Service.
 	virtual const vector< ServiceListener<Position<T>>* >& GetListeners()const
 	{
-		return vector<ServiceListener<Position<T>>*>();
+		return listeners;
 	}
 
 	HisToPositionListener<T>* GetListener() {
 		return listener;
 	}
 
+	// Set whether positions are stored as text in position.txt or binary in position.bin
+	void SetFormat(RecordFormat format) {
+		connector->SetFormat(format);
+	}
+
 	// Persist data to a store
 	void PersistData(string persistKey, Position<T>& data) {
 
 		connector->Publish(data);
 	}
 
+	// Persist a block of data to a store
+	void PersistDataBatch(Position<T>* data, size_t count) {
+		connector->PublishBatch(data, count);
+	}
+
 };
 
 
@@ -202,6 +260,11 @@ public:
 		service->PersistData("", data);
 	}
 
+	// Listener callback to process a block of add events to the Service
+	virtual void ProcessAddBatch(Position<T> *data, size_t count) {
+		service->PersistDataBatch(data, count);
+	}
+
 	// Listener callback to process a remove event to the Service
 	virtual void ProcessRemove(Position<T> &data) {}
 
@@ -211,20 +274,76 @@ public:
 template<typename T>
 class HisToPositionConnector :public Connector<Position<T>>
 {
+private:
+	// Positions for different products are published from several workers
+	mutex lock;
+	RecordFormat format;
+
 public:
-	HisToPositionConnector() {}
+	HisToPositionConnector() : format(TEXT_RECORDS) {}
 	~HisToPositionConnector() {}
+
+	// Set the format of the store
+	void SetFormat(RecordFormat _format) {
+		format = _format;
+	}
+
 	// Publish data to the Connector
 	void Publish(Position<T> &data)
 	{
-
+		if (format == BINARY_RECORDS)
+		{
+			PublishBatch(&data, 1);
+			return;
+		}
+		AllocationExempt exempt;
+		static const LatencyPoint sink("position persisted");
+		LatencyTrace::End(sink);
+		char line[512];
+		RecordWriter out(line, sizeof(line));
+		out.Timestamp().Char(',');
+		data.Position_to_chars(out);
+		out.Char('\n');
+		lock_guard<mutex> guard(lock);
 		ofstream file;
 		file.open("position.txt", ios::app);
-		file << timestamp() << ",";
-		file << data.Position_to_String() << endl;
+		file.write(out.Data(), out.Size());
 		
 	}
 
+	// Publish a block of data with one open of the store
+	void PublishBatch(Position<T> *data, size_t count)
+	{
+		AllocationExempt exempt;
+		static const LatencyPoint sink("position persisted");
+		LatencyTrace::End(sink);
+		lock_guard<mutex> guard(lock);
+		ofstream file;
+		if (format == BINARY_RECORDS)
+		{
+			OpenRecordStore<PositionRecord>(file, "position.bin");
+			PositionRecord record;
+			record.time = timestamp_millis();
+			for (size_t i = 0; i < count; i++)
+			{
+				data[i].Position_to_record(record);
+				WriteRecord(file, record);
+			}
+			return;
+		}
+		file.open("position.txt", ios::app);
+		char line[512];
+		RecordWriter out(line, sizeof(line));
+		for (size_t i = 0; i < count; i++)
+		{
+			out.Clear();
+			out.Timestamp().Char(',');
+			data[i].Position_to_chars(out);
+			out.Char('\n');
+			file.write(out.Data(), out.Size());
+		}
+	}
+
 	virtual void Subscribe(ifstream& file) {}
 
 
@@ -250,12 +369,17 @@ private:
 	HisToRiskConnector<T>* connector;
 	HisToRiskListenerB<T>* listenerb;
 	HisToRiskConnectorB<T>* connectorb;
+	// Nothing is kept here, so GetData and GetListeners return these empty members
+	PV01<T> empty;
+	vector<ServiceListener<PV01<T>>*> listeners;
+	// Both connectors append to the same store
+	mutex filelock;
 public:
 	HistoricalDataServiceRisk() {
 		listener = new HisToRiskListener<T>(this);
-		connector = new HisToRiskConnector<T>();
+		connector = new HisToRiskConnector<T>(filelock);
 		listenerb = new HisToRiskListenerB<T>(this);
-		connectorb = new HisToRiskConnectorB<T>();
+		connectorb = new HisToRiskConnectorB<T>(filelock);
 	}
 	~HistoricalDataServiceRisk() {
 		delete listener;
@@ -268,8 +392,7 @@ public:
 	// Get data on our service given a key
 	virtual PV01<T>& GetData(string key)
 	{
-		PV01<T> x = PV01<T>();
-		return x;
+		return empty;
 	}
 
 	// The callback that a Connector should invoke for any new or updated data
@@ -285,7 +408,7 @@ public:
 	// Get all listeners on the Service.
 	virtual const vector< ServiceListener<PV01<T>>* >& GetListeners()const
 	{
-		return vector<ServiceListener<PV01<T>>*>();
+		return listeners;
 	}
 
 	HisToRiskListener<T>* GetListener() {
@@ -295,6 +418,12 @@ public:
 		return listenerb;
 	}
 
+	// Set whether risk is stored as text in risk.txt or binary in risk.bin
+	void SetFormat(RecordFormat format) {
+		connector->SetFormat(format);
+		connectorb->SetFormat(format);
+	}
+
 	// Persist data to a store
 	void PersistData(string persistKey, PV01<T>& data) {
 
@@ -305,6 +434,14 @@ public:
 		connectorb->Publish(data);
 	}
 
+	// Persist a block of data to a store
+	void PersistDataBatch(PV01<T>* data, size_t count) {
+		connector->PublishBatch(data, count);
+	}
+	void PersistDataBatchB(PV01<BucketedSector<T>>* data, size_t count) {
+		connectorb->PublishBatch(data, count);
+	}
+
 };
 
 
@@ -322,6 +459,11 @@ public:
 		service->PersistData("", data);
 	}
 
+	// Listener callback to process a block of add events to the Service
+	virtual void ProcessAddBatch(PV01<T> *data, size_t count) {
+		service->PersistDataBatch(data, count);
+	}
+
 	// Listener callback to process a remove event to the Service
 	virtual void ProcessRemove(PV01<T> &data) {}
 
@@ -331,22 +473,75 @@ public:
 template<typename T>
 class HisToRiskConnector :public Connector<PV01<T>>
 {
+private:
+	mutex& lock;
+	RecordFormat format;
+
 public:
-	HisToRiskConnector() {}
+	HisToRiskConnector(mutex& _lock) : lock(_lock), format(TEXT_RECORDS) {}
 	~HisToRiskConnector() {}
+
+	// Set the format of the store
+	void SetFormat(RecordFormat _format) {
+		format = _format;
+	}
+
 	// Publish data to the Connector
 	void Publish(PV01<T> &data)
 	{
-		string s1 = data.GetProduct().GetProductId();
-		string s2 = to_string(data.GetPV01());
-		string s3 = to_string(data.GetQuantity());
+		if (format == BINARY_RECORDS)
+		{
+			PublishBatch(&data, 1);
+			return;
+		}
+		AllocationExempt exempt;
+		static const LatencyPoint sink("risk persisted");
+		LatencyTrace::End(sink);
+		char line[512];
+		RecordWriter out(line, sizeof(line));
+		out.Timestamp().Char(',').Text(data.GetProduct().GetProductId()).Char(',')
+			.Fixed(data.GetPV01()).Char(',').Integer(data.GetQuantity()).Char('\n');
+		lock_guard<mutex> guard(lock);
 		ofstream file;
 		file.open("risk.txt", ios::app);
-		file << timestamp() << ",";
-		file << s1<<","<<s2<<","<<s3 << endl;
+		file.write(out.Data(), out.Size());
 		
 	}
 
+	// Publish a block of data with one open of the store
+	void PublishBatch(PV01<T> *data, size_t count)
+	{
+		AllocationExempt exempt;
+		static const LatencyPoint sink("risk persisted");
+		LatencyTrace::End(sink);
+		lock_guard<mutex> guard(lock);
+		ofstream file;
+		if (format == BINARY_RECORDS)
+		{
+			OpenRecordStore<RiskRecord>(file, "risk.bin");
+			RiskRecord record;
+			record.time = timestamp_millis();
+			for (size_t i = 0; i < count; i++)
+			{
+				SetRecordText(record.name, data[i].GetProduct().GetProductId());
+				record.pv01 = data[i].GetPV01();
+				record.quantity = data[i].GetQuantity();
+				WriteRecord(file, record);
+			}
+			return;
+		}
+		file.open("risk.txt", ios::app);
+		char line[512];
+		RecordWriter out(line, sizeof(line));
+		for (size_t i = 0; i < count; i++)
+		{
+			out.Clear();
+			out.Timestamp().Char(',').Text(data[i].GetProduct().GetProductId()).Char(',')
+				.Fixed(data[i].GetPV01()).Char(',').Integer(data[i].GetQuantity()).Char('\n');
+			file.write(out.Data(), out.Size());
+		}
+	}
+
 	virtual void Subscribe(ifstream& file) {}
 
 
@@ -365,6 +560,11 @@ public:
 		service->PersistDataB("", data);
 	}
 
+	// Listener callback to process a block of add events to the Service
+	virtual void ProcessAddBatch(PV01<BucketedSector<T>> *data, size_t count) {
+		service->PersistDataBatchB(data, count);
+	}
+
 	// Listener callback to process a remove event to the Service
 	virtual void ProcessRemove(PV01<BucketedSector<T>> &data) {}
 
@@ -374,19 +574,72 @@ public:
 template<typename T>
 class HisToRiskConnectorB :public Connector<PV01<BucketedSector<T>>>
 {
+private:
+	mutex& lock;
+	RecordFormat format;
+
 public:
-	HisToRiskConnectorB() {}
+	HisToRiskConnectorB(mutex& _lock) : lock(_lock), format(TEXT_RECORDS) {}
 	~HisToRiskConnectorB() {}
+
+	// Set the format of the store
+	void SetFormat(RecordFormat _format) {
+		format = _format;
+	}
+
 	// Publish data to the Connector
 	void Publish(PV01<BucketedSector<T>> &data)
 	{
-		string s1 = data.GetProduct().GetName();
-		string s2 = to_string(data.GetPV01());
-		string s3 = to_string(data.GetQuantity());
+		if (format == BINARY_RECORDS)
+		{
+			PublishBatch(&data, 1);
+			return;
+		}
+		AllocationExempt exempt;
+		static const LatencyPoint sink("risk persisted");
+		LatencyTrace::End(sink);
+		char line[512];
+		RecordWriter out(line, sizeof(line));
+		out.Timestamp().Char(',').Text(data.GetProduct().GetName()).Char(',')
+			.Fixed(data.GetPV01()).Char(',').Integer(data.GetQuantity()).Char('\n');
+		lock_guard<mutex> guard(lock);
+		ofstream file;
+		file.open("risk.txt", ios::app);
+		file.write(out.Data(), out.Size());
+	}
+
+	// Publish a block of data with one open of the store
+	void PublishBatch(PV01<BucketedSector<T>> *data, size_t count)
+	{
+		AllocationExempt exempt;
+		static const LatencyPoint sink("risk persisted");
+		LatencyTrace::End(sink);
+		lock_guard<mutex> guard(lock);
 		ofstream file;
+		if (format == BINARY_RECORDS)
+		{
+			OpenRecordStore<RiskRecord>(file, "risk.bin");
+			RiskRecord record;
+			record.time = timestamp_millis();
+			for (size_t i = 0; i < count; i++)
+			{
+				SetRecordText(record.name, data[i].GetProduct().GetName());
+				record.pv01 = data[i].GetPV01();
+				record.quantity = data[i].GetQuantity();
+				WriteRecord(file, record);
+			}
+			return;
+		}
 		file.open("risk.txt", ios::app);
-		file << timestamp() << ",";
-		file << s1 << "," << s2 << "," << s3 << endl;
+		char line[512];
+		RecordWriter out(line, sizeof(line));
+		for (size_t i = 0; i < count; i++)
+		{
+			out.Clear();
+			out.Timestamp().Char(',').Text(data[i].GetProduct().GetName()).Char(',')
+				.Fixed(data[i].GetPV01()).Char(',').Integer(data[i].GetQuantity()).Char('\n');
+			file.write(out.Data(), out.Size());
+		}
 	}
 
 	virtual void Subscribe(ifstream& file) {}
@@ -411,6 +664,9 @@ class HistoricalDataServiceExecution : Service<string, ExecutionOrder<T>>
 private:
 	HisToExecutionListener<T>* listener;
 	HisToExecutionConnector<T>* connector;
+	// Nothing is kept here, so GetData and GetListeners return these empty members
+	ExecutionOrder<T> empty;
+	vector<ServiceListener<ExecutionOrder<T>>*> listeners;
 
 public:
 	HistoricalDataServiceExecution() {
@@ -426,8 +682,7 @@ public:
 	// Get data on our service given a key
 	virtual ExecutionOrder<T>& GetData(string key)
 	{
-		ExecutionOrder<T> x = ExecutionOrder<T>();
-		return x;
+		return empty;
 	}
 
 	// The callback that a Connector should invoke for any new or updated data
@@ -443,13 +698,18 @@ public:
 	// Get all listeners on the Service.
 	virtual const vector< ServiceListener<ExecutionOrder<T>>* >& GetListeners()const
 	{
-		return vector<ServiceListener<ExecutionOrder<T>>*>();
+		return listeners;
 	}
 
 	HisToExecutionListener<T>* GetListener() {
 		return listener;
 	}
 
+	// Set whether executions are stored as text in Execution.txt or binary in Execution.bin
+	void SetFormat(RecordFormat format) {
+		connector->SetFormat(format);
+	}
+
 	// Persist data to a store
 	void PersistData(string persistKey, ExecutionOrder<T>& data) {
 
@@ -482,17 +742,43 @@ public:
 template<typename T>
 class HisToExecutionConnector :public Connector<ExecutionOrder<T>>
 {
+private:
+	RecordFormat format;
+
 public:
-	HisToExecutionConnector() {}
+	HisToExecutionConnector() : format(TEXT_RECORDS) {}
 	~HisToExecutionConnector() {}
+
+	// Set the format of the store
+	void SetFormat(RecordFormat _format) {
+		format = _format;
+	}
+
 	// Publish data to the Connector
 	void Publish(ExecutionOrder<T> &data)
 	{
-
+		AllocationExempt exempt;
+		static const LatencyPoint sink("execution persisted");
+		LatencyTrace::End(sink);
+
+		if (format == BINARY_RECORDS)
+		{
+			ExecutionRecord record;
+			record.time = timestamp_millis();
+			data.order_to_record(record);
+			ofstream file;
+			OpenRecordStore<ExecutionRecord>(file, "Execution.bin");
+			WriteRecord(file, record);
+			return;
+		}
+		char line[512];
+		RecordWriter out(line, sizeof(line));
+		out.Timestamp().Char(',');
+		data.order_to_chars(out);
+		out.Char('\n');
 		ofstream file;
 		file.open("Execution.txt", ios::app);
-		file << timestamp() << ",";
-		file << data.order_to_string() << endl;
+		file.write(out.Data(), out.Size());
 
 	}
 
@@ -517,6 +803,9 @@ class HistoricalDataServiceInquiry : Service<string, Inquiry<T>>
 private:
 	HisToInquiryListener<T>* listener;
 	HisToInquiryConnector<T>* connector;
+	// Nothing is kept here, so GetData and GetListeners return these empty members
+	Inquiry<T> empty;
+	vector<ServiceListener<Inquiry<T>>*> listeners;
 
 public:
 	HistoricalDataServiceInquiry() {
@@ -532,8 +821,7 @@ public:
 	// Get data on our service given a key
 	virtual Inquiry<T>& GetData(string key)
 	{
-		Inquiry<T> x = Inquiry<T>();
-		return x;
+		return empty;
 	}
 
 	// The callback that a Connector should invoke for any new or updated data
@@ -549,13 +837,18 @@ public:
 	// Get all listeners on the Service.
 	virtual const vector< ServiceListener<Inquiry<T>>* >& GetListeners()const
 	{
-		return vector<ServiceListener<Inquiry<T>>*>();
+		return listeners;
 	}
 
 	HisToInquiryListener<T>* GetListener() {
 		return listener;
 	}
 
+	// Set whether inquiries are stored as text in allinquiries.txt or binary in allinquiries.bin
+	void SetFormat(RecordFormat format) {
+		connector->SetFormat(format);
+	}
+
 	// Persist data to a store
 	void PersistData(string persistKey, Inquiry<T>& data) {
 
@@ -588,17 +881,43 @@ public:
 template<typename T>
 class HisToInquiryConnector :public Connector<Inquiry<T>>
 {
+private:
+	RecordFormat format;
+
 public:
-	HisToInquiryConnector() {}
+	HisToInquiryConnector() : format(TEXT_RECORDS) {}
 	~HisToInquiryConnector() {}
+
+	// Set the format of the store
+	void SetFormat(RecordFormat _format) {
+		format = _format;
+	}
+
 	// Publish data to the Connector
 	void Publish(Inquiry<T> &data)
 	{
-
+		AllocationExempt exempt;
+		static const LatencyPoint sink("inquiry persisted");
+		LatencyTrace::End(sink);
+
+		if (format == BINARY_RECORDS)
+		{
+			InquiryHistoryRecord record;
+			record.time = timestamp_millis();
+			data.inquiry_to_record(record);
+			ofstream file;
+			OpenRecordStore<InquiryHistoryRecord>(file, "allinquiries.bin");
+			WriteRecord(file, record);
+			return;
+		}
+		char line[512];
+		RecordWriter out(line, sizeof(line));
+		out.Timestamp().Char(',');
+		data.inquiry_to_chars(out);
+		out.Char('\n');
 		ofstream file;
 		file.open("allinquiries.txt", ios::app);
-		file << timestamp() << ",";
-		file << data.inquiry_to_string() << endl;
+		file.write(out.Data(), out.Size());
 
 	}
 
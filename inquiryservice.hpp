@@ -9,6 +9,10 @@
 
 #include "soa.hpp"
 #include "tradebookingservice.hpp"
+#include "productregistry.hpp"
+#include "latency.hpp"
+#include "recordwriter.hpp"
+#include "binaryrecords.hpp"
 #include<map>
 
 // Various inqyury states
@@ -25,7 +29,7 @@ class Inquiry
 public:
 
   // ctor for an inquiry
-  Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state);
+  Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, FixedPrice _price, InquiryState _state);
   Inquiry() = default;
   // Get the inquiry ID
   const string& GetInquiryId() const;
@@ -40,7 +44,7 @@ public:
   long GetQuantity() const;
 
   // Get the price that we have responded back with
-  double GetPrice() const;
+  FixedPrice GetPrice() const;
 
   // Get the current state on the inquiry
   InquiryState GetState() const;
@@ -48,57 +52,71 @@ public:
   void SetState(InquiryState s) {
 	  state = s;
   }
-  void SetPrice(double p) {
+  void SetPrice(FixedPrice p) {
 	  price = p;
   }
   string inquiry_to_string() {
-	  string s2 = product.GetProductId();
-	  string s3;
+	  char buffer[256];
+	  RecordWriter out(buffer, sizeof(buffer));
+	  inquiry_to_chars(out);
+	  return string(out.View());
+  }
+
+  // Write inquiryId,productId,side,quantity,price,state
+  void inquiry_to_chars(RecordWriter &out) const {
+	  out.Text(inquiryId).Char(',').Text(product->GetProductId()).Char(',');
 	  switch (side)
 	  {
 	  case BUY:
-		  s3 = "BUY";
+		  out.Text("BUY");
 		  break;
 	  case SELL:
-		  s3 = "SELL";
+		  out.Text("SELL");
 		  break;
 	  default:
 		  break;
 	  }
-	  string s1 = inquiryId;
-	  string s4 = to_string(quantity);
-	  string s5 = to_string(price);
-	  string s6;
+	  out.Char(',').Integer(quantity).Char(',').Fixed(price.ToDouble()).Char(',');
 	  switch (state)
 	  {
 	  case RECEIVED:
-		  s6 = "RECEIVED";
+		  out.Text("RECEIVED");
 		  break;
 	  case QUOTED:
-		  s6 = "QUOTED";
+		  out.Text("QUOTED");
 		  break;
 	  case DONE:
-		  s6 = "DONE";
+		  out.Text("DONE");
 		  break;
 	  case REJECTED:
-		  s6 = "REJECTED";
+		  out.Text("REJECTED");
 		  break;
 	  case CUSTOMER_REJECTED:
-		  s6 = "CUSTOMER_REJECTED";
+		  out.Text("CUSTOMER_REJECTED");
 		  break;
 	  default:
 		  break;
 	  }
-	  return s1 + "," + s2 + "," + s3 + "," + s4 + "," + s5 + "," + s6;
+  }
+
+  // Fill every field of a record but its time
+  void inquiry_to_record(InquiryHistoryRecord &record) const {
+	  SetRecordText(record.inquiryId, inquiryId);
+	  SetRecordText(record.productId, product->GetProductId());
+	  record.quantity = quantity;
+	  record.price = price.ToDouble();
+	  record.side = uint8_t(side);
+	  record.state = uint8_t(state);
+	  memset(record.unused, 0, sizeof(record.unused));
   }
 
 
 private:
   string inquiryId;
-  T product;
+  const T *product = nullptr;
   Side side;
+  FixedPrice price;
   long quantity;
-  double price;
   InquiryState state;
 
 };
@@ -144,6 +162,8 @@ public:
 	// The callback that a Connector should invoke for any new or updated data
 	virtual void OnMessage(Inquiry<T> &data)
 	{
+		static const LatencyPoint hop("inquiry");
+		LatencyHop trace(hop);
 		T temp = data.GetProduct();
 		string stemp = data.GetInquiryId();
 		Inquiry<T> ptemp = data;
@@ -158,7 +178,7 @@ public:
 		}
 		else
 		{
-			data.SetPrice(100);
+			data.SetPrice(FixedPrice::FromTicks(100 * TICKS_PER_POINT));
 			connector->Publish(data);
 		}
 	}
@@ -179,7 +199,7 @@ public:
 public:
 
   // Send a quote back to the client
-	void SendQuote(const string &inquiryId, double price) {
+	void SendQuote(const string &inquiryId, FixedPrice price) {
 		Inquiry<T> inq = inquirytable[inquiryId];
 		inq.SetPrice(price);
 		connector->Publish(inq);
@@ -203,28 +223,47 @@ private:
 public:
 	InquiryConnector(InquiryService<T>* service) :service(service) { id = 1; }
 	~InquiryConnector() {}
-	void Subscribe(ifstream& file) {
-		string line;
-		stringstream linestream;
+	using Connector<Inquiry<T>>::Subscribe;
+
+	// Read inquiries, one per line: productId,side,quantity,mid,spread,state, or as
+	// InquiryRecords
+	void Subscribe(FeedSource& source) {
+		static const LatencyPoint feed("inquiry feed");
+		RecordReader<InquiryRecord> binary(source);
+		InquiryRecord record;
+		string_view line;
+		string_view component[6];
 		cout << "Inquiry data loading......" << endl;
-		while (getline(file, line))
+		while (binary ? binary.Next(record) : source.NextLine(line))
 		{
-			linestream.clear();
-			linestream.str(line);
-			string temp;
-			vector<string> component;
-			while (getline(linestream, temp, ','))
-				component.push_back(temp);
-			date d(2018, Nov, 25);
-			T bond(component[0], CUSIP, "T", 0, d);
-			double mid = convert(component[3]);
-			double spread = convert(component[4]);
-			double price;
-			long quantity = stol(component[2]);
-			string sidestr = component[5];
+			LatencyTrace::Begin(feed);
+			string_view productId;
+			FixedPrice mid, spread;
+			long quantity;
+			bool buy;
+			if (binary)
+			{
+				productId = GetRecordText(record.productId);
+				mid = FixedPrice::FromDouble(record.mid);
+				spread = FixedPrice::FromDouble(record.spread);
+				quantity = long(record.quantity);
+				buy = record.side == BUY;
+			}
+			else
+			{
+				if (SplitFields(line, ',', component, 6) < 6)
+					continue;
+				productId = component[0];
+				mid = ConvertPrice(component[3]);
+				spread = ConvertPrice(component[4]);
+				quantity = ParseLong(component[2]);
+				buy = component[1] == "BUY";
+			}
+			const T &bond = ProductRegistry<T>::Instance().Get(productId);
+			FixedPrice price;
 			Side side;
 			InquiryState state = RECEIVED;
-			if (sidestr == "BUY")
+			if (buy)
 			{
 				price = mid - spread;
 				side = BUY;
@@ -278,8 +317,8 @@ public:
 
 
 template<typename T>
-Inquiry<T>::Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state) :
-  product(_product)
+Inquiry<T>::Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, FixedPrice _price, InquiryState _state) :
+  product(&_product)
 {
   inquiryId = _inquiryId;
   side = _side;
@@ -297,7 +336,7 @@ const string& Inquiry<T>::GetInquiryId() const
 template<typename T>
 const T& Inquiry<T>::GetProduct() const
 {
-  return product;
+  return *product;
 }
 
 template<typename T>
@@ -313,7 +352,7 @@ long Inquiry<T>::GetQuantity() const
 }
 
 template<typename T>
-double Inquiry<T>::GetPrice() const
+FixedPrice Inquiry<T>::GetPrice() const
 {
   return price;
 }
@@ -0,0 +1,461 @@
+/**
+ * latency.hpp
+ * Defines tick-to-trade latency tracing: a TSC clock, log-linear latency
+ * histograms, and a per-thread trace context stamped at connector ingress
+ * and carried through each service hop.
+ */
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdio>
+#include <cstdint>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define TRADING_HAS_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRADING_HAS_RDTSC
+#endif
+
+using namespace std;
+
+/**
+ * High-resolution clock for latency stamps.
+ * On x86 it reads the time-stamp counter, which costs a few nanoseconds and is
+ * synchronized across cores on any CPU with an invariant TSC; elsewhere it falls
+ * back to steady_clock. Ticks are converted to nanoseconds only when reporting.
+ */
+class TickClock
+{
+
+public:
+
+  // Get the current tick count
+  static uint64_t Now()
+  {
+#ifdef TRADING_HAS_RDTSC
+    return __rdtsc();
+#else
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+  }
+
+  // Get the length of one tick in nanoseconds, calibrated against steady_clock
+  static double NanosPerTick()
+  {
+    Calibration &c = GetCalibration();
+    lock_guard<mutex> guard(c.lock);
+    // Calibrate over at least 10ms of wall time; later calls refine over the whole run
+    while (chrono::steady_clock::now() - c.wall < chrono::milliseconds(10))
+      this_thread::sleep_for(chrono::milliseconds(1));
+    uint64_t ticks = Now();
+    double nanos = double(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - c.wall).count());
+    return ticks > c.ticks ? nanos / double(ticks - c.ticks) : 1.0;
+  }
+
+  // Start calibrating; call once early so the first report is accurate
+  static void Calibrate() { GetCalibration(); }
+
+private:
+  struct Calibration
+  {
+    mutex lock;
+    uint64_t ticks = TickClock::Now();
+    chrono::steady_clock::time_point wall = chrono::steady_clock::now();
+  };
+
+  static Calibration& GetCalibration()
+  {
+    static Calibration calibration;
+    return calibration;
+  }
+
+};
+
+/**
+ * Latency histogram with log-linear buckets, in the style of an HDR histogram.
+ * Values below 128 ticks get a bucket each; above that every power of two is split
+ * into 64 buckets, so any recorded value is reported within 1/64 (about 1.6%).
+ * Values are capped at 2^48 ticks. Recording is lock-free and may happen from
+ * any number of threads; percentiles can be read at any time.
+ */
+class LatencyHistogram
+{
+
+public:
+
+  LatencyHistogram() : count(0), max(0)
+  {
+    for (auto &bucket : buckets)
+      bucket.store(0, memory_order_relaxed);
+  }
+
+  // Record one latency, in ticks
+  void Record(uint64_t ticks)
+  {
+    if (ticks > MAX_VALUE)
+      ticks = MAX_VALUE;
+    buckets[Index(ticks)].fetch_add(1, memory_order_relaxed);
+    count.fetch_add(1, memory_order_relaxed);
+    uint64_t seen = max.load(memory_order_relaxed);
+    while (ticks > seen && !max.compare_exchange_weak(seen, ticks, memory_order_relaxed));
+  }
+
+  // Get the number of recorded values
+  uint64_t GetCount() const { return count.load(memory_order_relaxed); }
+
+  // Get the largest recorded value, in ticks
+  uint64_t GetMax() const { return max.load(memory_order_relaxed); }
+
+  // Forget every recorded value
+  void Reset()
+  {
+    for (auto &bucket : buckets)
+      bucket.store(0, memory_order_relaxed);
+    count.store(0, memory_order_relaxed);
+    max.store(0, memory_order_relaxed);
+  }
+
+  // Get the value at a percentile (0-100), in ticks: the top of the bucket holding it
+  uint64_t GetPercentile(double percentile) const
+  {
+    uint64_t total = GetCount();
+    if (total == 0)
+      return 0;
+    uint64_t rank = uint64_t(percentile / 100.0 * double(total) + 0.5);
+    if (rank < 1)
+      rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+      seen += buckets[i].load(memory_order_relaxed);
+      if (seen >= rank)
+      {
+        uint64_t top = Top(i);
+        return top < GetMax() ? top : GetMax();
+      }
+    }
+    return GetMax();
+  }
+
+private:
+  static const int SUB_BITS = 6;
+  static const uint64_t SUB_COUNT = uint64_t(1) << SUB_BITS;
+  static const int MAX_BITS = 48;
+  static const uint64_t MAX_VALUE = (uint64_t(1) << MAX_BITS) - 1;
+  static const size_t BUCKETS = size_t(2 * SUB_COUNT + (MAX_BITS - SUB_BITS - 1) * SUB_COUNT);
+
+  atomic<uint64_t> buckets[BUCKETS];
+  atomic<uint64_t> count;
+  atomic<uint64_t> max;
+
+  static int HighestBit(uint64_t value)
+  {
+    int bit = 0;
+    while (value >>= 1)
+      bit++;
+    return bit;
+  }
+
+  static size_t Index(uint64_t value)
+  {
+    if (value < 2 * SUB_COUNT)
+      return size_t(value);
+    int shift = HighestBit(value) - SUB_BITS;
+    return size_t(2 * SUB_COUNT + (shift - 1) * SUB_COUNT + ((value >> shift) - SUB_COUNT));
+  }
+
+  static uint64_t Top(size_t index)
+  {
+    if (index < 2 * SUB_COUNT)
+      return uint64_t(index);
+    size_t k = index - 2 * SUB_COUNT;
+    int shift = int(k / SUB_COUNT) + 1;
+    uint64_t sub = SUB_COUNT + k % SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+  }
+
+};
+
+/**
+ * Trace state for the event a thread is working on: when it entered at a connector,
+ * which feed it came from, and when the enclosing hop started.
+ * It lives in a thread-local and is copied onto asynchronous edges so the
+ * trace follows the event to the consumer thread.
+ */
+struct LatencyContext
+{
+  uint64_t ingress = 0;
+  uint64_t last = 0;
+  int source = -1;
+};
+
+/**
+ * Registry and report for every hop and end-to-end path.
+ * Hops, feeds and sinks are registered by name once; each hop gets a histogram of the
+ * time from the hop that called it, and each feed -> sink pair gets an end-to-end
+ * histogram from connector ingress. Report() can be called at any time, and
+ * RequestReport() is safe to call from a signal handler.
+ */
+class LatencyTracer
+{
+
+public:
+
+  // Get the process-wide tracer
+  static LatencyTracer& Instance()
+  {
+    static LatencyTracer tracer;
+    return tracer;
+  }
+
+  // Get the id for a hop, feed or sink name, registering it on first use
+  int Register(const string &name)
+  {
+    lock_guard<mutex> guard(lock);
+    for (size_t i = 0; i < names.size(); i++)
+      if (names[i] == name)
+        return int(i);
+    if (names.size() == MAX_POINTS)
+      return -1;
+    names.push_back(name);
+    storage.emplace_back();
+    hops[names.size() - 1].store(&storage.back(), memory_order_release);
+    return int(names.size() - 1);
+  }
+
+  // Get the histogram for a registered hop
+  LatencyHistogram& GetHop(int hop)
+  {
+    return *hops[hop].load(memory_order_acquire);
+  }
+
+  // Get the end-to-end histogram from a feed to a sink, creating it on first use
+  LatencyHistogram& GetEndToEnd(int source, int sink)
+  {
+    atomic<LatencyHistogram*> &slot = paths[source][sink];
+    LatencyHistogram *histogram = slot.load(memory_order_acquire);
+    if (!histogram)
+    {
+      lock_guard<mutex> guard(lock);
+      histogram = slot.load(memory_order_relaxed);
+      if (!histogram)
+      {
+        storage.emplace_back();
+        histogram = &storage.back();
+        slot.store(histogram, memory_order_release);
+      }
+    }
+    return *histogram;
+  }
+
+  // Call visit(name, histogram) for every hop, then every feed -> sink path, that has recorded values
+  template<typename F>
+  void Visit(F visit)
+  {
+    lock_guard<mutex> guard(lock);
+    for (size_t i = 0; i < names.size(); i++)
+      if (hops[i].load(memory_order_relaxed)->GetCount() > 0)
+        visit(names[i], *hops[i].load(memory_order_relaxed));
+    for (size_t s = 0; s < names.size(); s++)
+      for (size_t k = 0; k < names.size(); k++)
+      {
+        LatencyHistogram *histogram = paths[s][k].load(memory_order_acquire);
+        if (histogram && histogram->GetCount() > 0)
+          visit(names[s] + " -> " + names[k], *histogram);
+      }
+  }
+
+  // Clear every histogram, keeping the registered names
+  void Reset()
+  {
+    lock_guard<mutex> guard(lock);
+    for (auto &histogram : storage)
+      histogram.Reset();
+  }
+
+  // Write p50/p99/p99.9/max per hop and end to end, in microseconds
+  void Report(ostream &out)
+  {
+    double scale = TickClock::NanosPerTick() / 1000.0;
+    char line[160];
+    snprintf(line, sizeof(line), "%-44s %10s %10s %10s %10s %10s\n", "latency (us)", "count", "p50", "p99", "p99.9", "max");
+    out << line;
+    Visit([&](const string &name, const LatencyHistogram &histogram) { Write(out, "  " + name, histogram, scale); });
+    out.flush();
+  }
+
+  // Ask for a report; whoever polls ReportRequested() writes it
+  void RequestReport() { requested.store(true, memory_order_relaxed); }
+
+  // Get and clear a pending report request
+  bool ReportRequested() { return requested.exchange(false, memory_order_relaxed); }
+
+private:
+  static const size_t MAX_POINTS = 64;
+
+  mutex lock;
+  vector<string> names;
+  // Histograms never move once created, so recorders hold plain pointers to them
+  deque<LatencyHistogram> storage;
+  atomic<LatencyHistogram*> hops[MAX_POINTS];
+  atomic<LatencyHistogram*> paths[MAX_POINTS][MAX_POINTS];
+  atomic<bool> requested;
+
+  LatencyTracer() : requested(false)
+  {
+    for (auto &slot : hops)
+      slot.store(nullptr, memory_order_relaxed);
+    for (auto &row : paths)
+      for (auto &slot : row)
+        slot.store(nullptr, memory_order_relaxed);
+    TickClock::Calibrate();
+  }
+
+  static void Write(ostream &out, const string &name, const LatencyHistogram &histogram, double scale)
+  {
+    char line[200];
+    snprintf(line, sizeof(line), "%-44s %10llu %10.2f %10.2f %10.2f %10.2f\n", name.c_str(),
+      (unsigned long long)histogram.GetCount(),
+      histogram.GetPercentile(50) * scale, histogram.GetPercentile(99) * scale,
+      histogram.GetPercentile(99.9) * scale, histogram.GetMax() * scale);
+    out << line;
+  }
+
+};
+
+/**
+ * A named hop, feed or sink. Declare one as a function-local static where it is
+ * used, so the name is registered once.
+ */
+class LatencyPoint
+{
+
+public:
+
+  explicit LatencyPoint(const string &name) :
+    id(LatencyTracer::Instance().Register(name))
+  {
+  }
+
+  // Get the registered id; -1 if the registry was full
+  int GetId() const { return id; }
+
+private:
+  int id;
+
+};
+
+/**
+ * Access to the calling thread's trace context.
+ */
+class LatencyTrace
+{
+
+public:
+
+  // Get this thread's context
+  static LatencyContext& Current()
+  {
+    static thread_local LatencyContext context;
+    return context;
+  }
+
+  // Stamp connector ingress for the next event read from a feed
+  static void Begin(const LatencyPoint &feed)
+  {
+    LatencyContext &context = Current();
+    context.ingress = context.last = TickClock::Now();
+    context.source = feed.GetId();
+  }
+
+  // Drop the current event, so calls made outside a feed are not traced
+  static void Clear()
+  {
+    Current() = LatencyContext();
+  }
+
+  // Record the end-to-end latency of the current event reaching a sink
+  static void End(const LatencyPoint &sink)
+  {
+    LatencyContext &context = Current();
+    if (context.ingress == 0 || context.source < 0 || sink.GetId() < 0)
+      return;
+    LatencyTracer::Instance().GetEndToEnd(context.source, sink.GetId()).Record(TickClock::Now() - context.ingress);
+  }
+
+};
+
+/**
+ * Scope for one service hop: records the time since the calling hop started, then
+ * makes this hop the reference for the hops it calls. The caller's reference is
+ * restored on exit, so sibling listeners are each timed from their common parent.
+ * Nothing is recorded for events that did not pass a traced connector.
+ */
+class LatencyHop
+{
+
+public:
+
+  explicit LatencyHop(const LatencyPoint &hop) :
+    context(LatencyTrace::Current()), previous(context.last)
+  {
+    if (context.ingress == 0 || hop.GetId() < 0)
+      return;
+    uint64_t now = TickClock::Now();
+    LatencyTracer::Instance().GetHop(hop.GetId()).Record(now - previous);
+    context.last = now;
+  }
+
+  ~LatencyHop()
+  {
+    context.last = previous;
+  }
+
+  LatencyHop(const LatencyHop&) = delete;
+  LatencyHop& operator=(const LatencyHop&) = delete;
+
+private:
+  LatencyContext &context;
+  uint64_t previous;
+
+};
+
+/**
+ * Scope that installs a context captured on another thread, for the consumer
+ * side of an asynchronous edge, and restores this thread's own on exit.
+ */
+class LatencyResume
+{
+
+public:
+
+  explicit LatencyResume(const LatencyContext &captured) :
+    context(LatencyTrace::Current()), saved(context)
+  {
+    context = captured;
+  }
+
+  ~LatencyResume()
+  {
+    context = saved;
+  }
+
+  LatencyResume(const LatencyResume&) = delete;
+  LatencyResume& operator=(const LatencyResume&) = delete;
+
+private:
+  LatencyContext &context;
+  LatencyContext saved;
+
+};
+
+#endif
@@ -10,7 +10,11 @@
 #include <string>
 #include <vector>
 #include "soa.hpp"
-#include<unordered_map>
+#include "productregistry.hpp"
+#include "alloccounter.hpp"
+#include "latency.hpp"
+#include "binaryrecords.hpp"
+#include "priceladder.hpp"
 
 
 using namespace std;
@@ -18,6 +22,27 @@ using namespace std;
 // Side for market data
 enum PricingSide { BID, OFFER };
 
+// Venue quoting a book
+enum Market { BROKERTEC, ESPEED, CME };
+
+// Number of venues
+const int MARKETS = 3;
+
+// Get the venue a name such as CME stands for; false if it names none
+inline bool ParseVenue(string_view name, Market &venue)
+{
+	static const char* names[MARKETS] = { "BROKERTEC", "ESPEED", "CME" };
+	for (int i = 0; i < MARKETS; i++)
+	{
+		if (name == names[i])
+		{
+			venue = Market(i);
+			return true;
+		}
+	}
+	return false;
+}
+
 /**
  * A market data order with price, quantity, and side.
  */
@@ -27,10 +52,10 @@ class Order
 public:
 
   // ctor for an order
-  Order(double _price, long _quantity, PricingSide _side);
+  Order(FixedPrice _price, long _quantity, PricingSide _side);
   Order() = default;
   // Get the price on the order
-  double GetPrice() const;
+  FixedPrice GetPrice() const;
 
   // Get the quantity on the order
   long GetQuantity() const;
@@ -39,8 +64,8 @@ public:
   PricingSide GetSide() const;
 
 private:
-  double price;
   long quantity;
+  FixedPrice price;
   PricingSide side;
 
 };
@@ -68,8 +93,98 @@ private:
 
 };
 
+// Get whether two best bid/offers quote the same prices and sizes
+inline bool operator==(const BidOffer &left, const BidOffer &right)
+{
+  const Order &lb = left.GetBidOrder(), &rb = right.GetBidOrder();
+  const Order &lo = left.GetOfferOrder(), &ro = right.GetOfferOrder();
+  return lb.GetPrice() == rb.GetPrice() && lb.GetQuantity() == rb.GetQuantity() &&
+    lo.GetPrice() == ro.GetPrice() && lo.GetQuantity() == ro.GetQuantity();
+}
+
+inline bool operator!=(const BidOffer &left, const BidOffer &right)
+{
+  return !(left == right);
+}
+
+// Change made to one level of an order book
+enum BookAction { ADD_LEVEL, MODIFY_LEVEL, DELETE_LEVEL };
+
+/**
+ * An incremental market data message: one price level of a product's book added,
+ * resized or deleted. The level's side and price say which level it is, and its
+ * quantity is the new size, unused by a delete.
+ * Type T is the product type.
+ */
+template<typename T>
+class OrderBookUpdate
+{
+
+public:
+
+  // ctor for an update to a venue's book
+  OrderBookUpdate(const T &_product, BookAction _action, const Order &_level, Market _venue = BROKERTEC);
+  OrderBookUpdate() = default;
+
+  // Get the product
+  const T& GetProduct() const;
+
+  // Get what is done to the level
+  BookAction GetAction() const;
+
+  // Get the level
+  const Order& GetLevel() const;
+
+  // Get the venue whose book is updated
+  Market GetVenue() const;
+
+private:
+  const T *product = nullptr;
+  BookAction action = ADD_LEVEL;
+  Market venue = BROKERTEC;
+  Order level;
+
+};
+
+/**
+ * The top of a product's book: its best bid and offer across venues as they stood
+ * when either moved in price or size, and which venues quoted them.
+ * Type T is the product type.
+ */
+template<typename T>
+class TopOfBook
+{
+
+public:
+
+  // ctor for a top of book
+  TopOfBook(const T &_product, const BidOffer &_bidOffer, unsigned _bidVenues = 0, unsigned _offerVenues = 0);
+  TopOfBook() = default;
+
+  // Get the product
+  const T& GetProduct() const;
+
+  // Get the best bid and offer
+  const BidOffer& GetBidOffer() const;
+
+  // Get the venues at the best bid, bit 1 << venue for each
+  unsigned GetBidVenues() const;
+
+  // Get the venues at the best offer, bit 1 << venue for each
+  unsigned GetOfferVenues() const;
+
+private:
+  const T *product = nullptr;
+  BidOffer bidOffer;
+  uint8_t bidVenues = 0;
+  uint8_t offerVenues = 0;
+
+};
+
 /**
- * Order book with a bid and offer stack.
+ * Order book with a bid and offer stack, each held as a price ladder of the total
+ * quantity quoted at each tick (priceladder.hpp). Orders at the same price make one
+ * level.
  * Type T is the product type.
  */
 template<typename T>
@@ -78,50 +193,99 @@ class OrderBook
 
 public:
 
-  // ctor for the order book
-  OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack);
+  // ctor for the order book of a venue
+  OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack, Market _venue = BROKERTEC);
   OrderBook() = default;
   // Get the product
   const T& GetProduct() const;
 
-  // Get the bid stack
-  const vector<Order>& GetBidStack() const;
+  // Get the venue quoting the book
+  Market GetVenue() const { return venue; }
 
-  // Get the offer stack
-  const vector<Order>& GetOfferStack() const;
-  const BidOffer& GetBidOffer() const {
-	  double priceb = 0;
-	  double priceo = 200;
-	  Order bid;
-	  Order offer;
-	  for (auto& b : bidStack)
-	  {
-		  if (b.GetPrice() > priceb)
-		  {
-			  bid = b;
-			  priceb = b.GetPrice();
-		  }
-	  }
-	  for (auto& o : offerStack)
-	  {
-		  if (o.GetPrice() < priceo)
-		  {
-			  offer = o;
-			  priceb = o.GetPrice();
-		  }
-	  }
-
-	  return BidOffer(bid, offer);
+  // Get the bid stack, one order per level, best first
+  vector<Order> GetBidStack() const;
 
+  // Get the offer stack, one order per level, best first
+  vector<Order> GetOfferStack() const;
 
+  // Get the bid and offer ladders
+  const PriceLadder& GetBids() const { return bids; }
+  const PriceLadder& GetOffers() const { return offers; }
 
+  // Apply an update to the level it names, in place: an add inserts the level or
+  // resizes it if the price is already quoted, a modify resizes it and a delete
+  // removes it. False if a modify or delete names a level the book does not have.
+  bool Apply(const OrderBookUpdate<T> &update);
 
-  }
+  // Add quantity to the level at a tick, or take it away if negative; a level left
+  // with none is removed
+  void AddLevel(const T &_product, PricingSide side, int64_t tick, long quantity);
+
+  // Add every level of another book to this one, or take them away if sign is
+  // negative, as a consolidated book follows the books it sums
+  void AddBook(const OrderBook<T> &book, long sign);
+
+  // Make both ladders cover the ticks from low to high, so levels quoted there do not
+  // grow them
+  void Reserve(int64_t low, int64_t high);
+
+  // Take the product, venue and levels of another book, keeping this book's ladder
+  // windows
+  void Assign(const OrderBook<T> &book);
+
+  // Get the best bid and offer, in constant time; an empty side gives an order of
+  // price and quantity 0
+  BidOffer GetBidOffer() const;
+
+private:
+  const T *product = nullptr;
+  Market venue = BROKERTEC;
+  PriceLadder bids = PriceLadder(true);
+  PriceLadder offers = PriceLadder(false);
+
+  // Add the orders of a stack to a ladder
+  static void Quote(const vector<Order> &stack, PriceLadder &ladder);
+
+  // Get the orders of a ladder, best first
+  static vector<Order> Levels(const PriceLadder &ladder, PricingSide side);
+
+};
+
+/**
+ * Aggregated depth of a product's book: the total quantity at each of the best few
+ * prices of each side, best first. The service keeps one per product to its Depth
+ * as books and updates arrive, in storage reserved once, so reading it is a walk of
+ * the levels. An update behind the deepest level shown leaves it as it is.
+ * Type T is the product type.
+ */
+template<typename T>
+class MarketDepth
+{
+
+public:
+
+  // Get the product
+  const T& GetProduct() const;
+
+  // Get the bid levels, best first
+  const vector<Order>& GetBidStack() const;
+
+  // Get the offer levels, best first
+  const vector<Order>& GetOfferStack() const;
+
+  // Take the best depth levels of each side of a book
+  void Build(const OrderBook<T> &book, size_t depth);
+
+  // Follow an update that has been applied to a book
+  void Update(const OrderBook<T> &book, const OrderBookUpdate<T> &update, size_t depth);
 
 private:
-  T product;
-  vector<Order> bidStack;
-  vector<Order> offerStack;
+  const T *product = nullptr;
+  vector<Order> bids;
+  vector<Order> offers;
+
+  // Refill a stack with the best depth levels of a ladder
+  static void Take(const PriceLadder &ladder, PricingSide side, size_t depth, vector<Order> &stack);
 
 };
 
@@ -137,17 +301,136 @@ template<typename T>
 class MarketDataService : public Service<string,OrderBook <T> >
 {
 private:
-	map<string, OrderBook<T>> markettable;
+	// Consolidated book of each product, the sum of its venues' books
+	ProductTable<OrderBook<T>> markettable;
+	// Book of each product at each venue
+	ProductTable<OrderBook<T>> venuetables[MARKETS];
 	MarketConnector<T>* connector;
 	vector<ServiceListener<OrderBook<T>>*> listeners;
+	vector<ServiceListener<OrderBookUpdate<T>>*> updatelisteners;
+	vector<ServiceListener<TopOfBook<T>>*> toplisteners;
+	// Best bid/offer of each book as last sent to the top listeners
+	ProductTable<BidOffer> toptable;
+	// Venues at the best bid, and shifted by MARKETS at the best offer, as last sent
+	ProductTable<unsigned> topvenues;
+	// Tops that moved in the block being processed
+	vector<TopOfBook<T>> topchanges;
+	// Aggregated depth of each book, to Depth levels a side
+	ProductTable<MarketDepth<T>> depthtable;
 	int Depth;
+	// Ticks either side of its first price that a book kept here covers from the start
+	int64_t reservedTicks;
+
+	size_t GetDepthLevels() const
+	{
+		return Depth > 0 ? size_t(Depth) : 0;
+	}
+
+	// Reserve the ladders of a book kept here around a tick, the first time it is used
+	void Prepare(OrderBook<T> &book, int64_t tick)
+	{
+		if (reservedTicks > 0 && book.GetBids().GetWindow() == 0)
+			book.Reserve(tick - reservedTicks, tick + reservedTicks);
+	}
+
+	// Store a venue's book, moving the consolidated book off its last one and onto it
+	void Consolidate(const OrderBook<T> &book)
+	{
+		ProductIndex index = book.GetProduct().GetProductIndex();
+		OrderBook<T> &venuebook = venuetables[book.GetVenue()][index];
+		OrderBook<T> &inside = markettable[index];
+		if (!book.GetBids().Empty() || !book.GetOffers().Empty())
+		{
+			int64_t tick = book.GetBids().Empty() ? book.GetOffers().GetBestTick() : book.GetBids().GetBestTick();
+			Prepare(venuebook, tick);
+			Prepare(inside, tick);
+		}
+		inside.AddBook(venuebook, -1);
+		inside.AddBook(book, 1);
+		venuebook.Assign(book);
+	}
+
+	// Apply an update to its venue's book and the same change to the consolidated
+	// book; false if it names a level the venue's book does not have
+	bool Consolidate(const OrderBookUpdate<T> &update)
+	{
+		ProductIndex index = update.GetProduct().GetProductIndex();
+		OrderBook<T> &venuebook = venuetables[update.GetVenue()][index];
+		const Order &level = update.GetLevel();
+		const PriceLadder &ladder = level.GetSide() == BID ? venuebook.GetBids() : venuebook.GetOffers();
+		int64_t tick = level.GetPrice().GetTicks();
+		Prepare(venuebook, tick);
+		Prepare(markettable[index], tick);
+		long before = ladder.GetQuantity(tick);
+		if (!venuebook.Apply(update))
+			return false;
+		markettable[index].AddLevel(update.GetProduct(), level.GetSide(), tick, ladder.GetQuantity(tick) - before);
+		return true;
+	}
+
+	// Get the venues whose best level on a side is the consolidated best
+	unsigned TopVenues(ProductIndex index, PricingSide side)
+	{
+		const OrderBook<T> &inside = markettable[index];
+		const PriceLadder &best = side == BID ? inside.GetBids() : inside.GetOffers();
+		unsigned venues = 0;
+		if (best.Empty())
+			return venues;
+		for (int venue = 0; venue < MARKETS; venue++)
+		{
+			const OrderBook<T> &book = venuetables[venue][index];
+			const PriceLadder &ladder = side == BID ? book.GetBids() : book.GetOffers();
+			if (!ladder.Empty() && ladder.GetBestTick() == best.GetBestTick())
+				venues |= 1u << venue;
+		}
+		return venues;
+	}
+
+	// Note a consolidated book's top if it, or the venues quoting it, moved since it
+	// was last noted; true if it did
+	bool Retop(const OrderBook<T> &book)
+	{
+		BidOffer best = book.GetBidOffer();
+		ProductIndex index = book.GetProduct().GetProductIndex();
+		unsigned bidVenues = TopVenues(index, BID);
+		unsigned offerVenues = TopVenues(index, OFFER);
+		unsigned venues = bidVenues | offerVenues << MARKETS;
+		BidOffer &noted = toptable[index];
+		unsigned &notedVenues = topvenues[index];
+		if (best == noted && venues == notedVenues)
+			return false;
+		noted = best;
+		notedVenues = venues;
+		topchanges.push_back(TopOfBook<T>(book.GetProduct(), best, bidVenues, offerVenues));
+		return true;
+	}
+
+	// Send the tops that moved to the top listeners
+	void FlushTops()
+	{
+		if (topchanges.empty())
+			return;
+		if (topchanges.size() == 1)
+		{
+			for (auto& listener : toplisteners)
+				listener->ProcessAdd(topchanges[0]);
+		}
+		else
+		{
+			for (auto& listener : toplisteners)
+				listener->ProcessAddBatch(topchanges.data(), topchanges.size());
+		}
+		topchanges.clear();
+	}
 
 public:
 	MarketDataService() {
-		markettable = map<string, OrderBook<T>>();
+		markettable = ProductTable<OrderBook<T>>();
 		connector = new MarketConnector<T>(this);
 		listeners = vector<ServiceListener<OrderBook<T>>*>();
+		topchanges.reserve(64);
 		Depth = 5;
+		reservedTicks = 0;
 	}
 	~MarketDataService() { delete connector; }
 	MarketConnector<T>* GetConnector() {
@@ -155,21 +438,96 @@ public:
 	}
 
 
-	// Get data on our service given a key
+	// Get the consolidated book of a product
 	virtual OrderBook<T>& GetData(string key)
 	{
 		return markettable[key];
 	}
 
-	// The callback that a Connector should invoke for any new or updated data
+	// The callback that a Connector should invoke for a venue's book: it replaces the
+	// venue's last book, and the consolidated book follows
 	virtual void OnMessage(OrderBook<T> &data)
 	{
-		T temp = data.GetProduct();
-		string stemp = temp.GetProductId();
-		OrderBook<T> ptemp = data;
-		markettable[stemp] = ptemp;
+		static const LatencyPoint hop("market data");
+		LatencyHop trace(hop);
+		ProductIndex index = data.GetProduct().GetProductIndex();
+		Consolidate(data);
+		depthtable[index].Build(markettable[index], GetDepthLevels());
+		for (auto& listener : listeners)
+			listener->ProcessAdd(data);
+		Retop(markettable[index]);
+		FlushTops();
+	}
+
+	// The callback that a Connector should invoke for a block of new or updated data
+	virtual void OnMessageBatch(OrderBook<T> *data, size_t count)
+	{
+		static const LatencyPoint hop("market data");
+		LatencyHop trace(hop);
+		for (size_t i = 0; i < count; i++)
+		{
+			ProductIndex index = data[i].GetProduct().GetProductIndex();
+			Consolidate(data[i]);
+			depthtable[index].Build(markettable[index], GetDepthLevels());
+			Retop(markettable[index]);
+		}
 		for (auto& listener : listeners)
+			listener->ProcessAddBatch(data, count);
+		FlushTops();
+	}
+
+	// The callback that a Connector should invoke for an incremental update: the
+	// venue's book and the consolidated book are changed in place, and only the
+	// update goes to the update listeners
+	virtual void OnUpdate(OrderBookUpdate<T> &data)
+	{
+		static const LatencyPoint hop("market data");
+		LatencyHop trace(hop);
+		if (!Consolidate(data))
+			return;
+		OrderBook<T> &book = markettable[data.GetProduct().GetProductIndex()];
+		depthtable[data.GetProduct().GetProductIndex()].Update(book, data, GetDepthLevels());
+		for (auto& listener : updatelisteners)
 			listener->ProcessAdd(data);
+		Retop(book);
+		FlushTops();
+	}
+
+	// The callback that a Connector should invoke for a block of updates; updates that
+	// do not apply are dropped from the block before it goes to the update listeners.
+	// The top is noted after each update, so the top listeners see every move in it.
+	virtual void OnUpdateBatch(OrderBookUpdate<T> *data, size_t count)
+	{
+		static const LatencyPoint hop("market data");
+		LatencyHop trace(hop);
+		size_t applied = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!Consolidate(data[i]))
+				continue;
+			OrderBook<T> &book = markettable[data[i].GetProduct().GetProductIndex()];
+			depthtable[data[i].GetProduct().GetProductIndex()].Update(book, data[i], GetDepthLevels());
+			Retop(book);
+			data[applied++] = data[i];
+		}
+		if (applied > 0)
+		{
+			for (auto& listener : updatelisteners)
+				listener->ProcessAddBatch(data, applied);
+		}
+		FlushTops();
+	}
+
+	// Get the consolidated book of a product, without copying it
+	const OrderBook<T>& GetBook(const T &product)
+	{
+		return markettable[product.GetProductIndex()];
+	}
+
+	// Get the book of a product at one venue
+	const OrderBook<T>& GetBook(const T &product, Market venue)
+	{
+		return venuetables[venue][product.GetProductIndex()];
 	}
 
 	// Add a listener to the Service for callbacks on add, remove, and update events
@@ -185,46 +543,94 @@ public:
 		return listeners;
 	}
 
+	// Add a listener for incremental updates, called once each update is applied
+	virtual void AddUpdateListener(ServiceListener<OrderBookUpdate<T>> *listener)
+	{
+		updatelisteners.push_back(listener);
+	}
+
+	// Get the listeners for incremental updates
+	virtual const vector< ServiceListener<OrderBookUpdate<T>>* >& GetUpdateListeners()const
+	{
+		return updatelisteners;
+	}
+
+	// Add a listener for the top of book, called only when a product's best bid or
+	// offer moves in price or size, by a book or an update
+	virtual void AddTopListener(ServiceListener<TopOfBook<T>> *listener)
+	{
+		toplisteners.push_back(listener);
+	}
+
+	// Get the listeners for the top of book
+	virtual const vector< ServiceListener<TopOfBook<T>>* >& GetTopListeners()const
+	{
+		return toplisteners;
+	}
+
 
 
 
 
 
 
-  // Get the best bid/offer order
-	virtual const BidOffer& GetBestBidOffer(const string &productId) {
-		return  markettable[productId].GetBidOffer();
+  // Get the best bid/offer order, kept as books and updates arrive; a product
+  // with no book gives orders of price and quantity 0
+	virtual BidOffer GetBestBidOffer(const string &productId) {
+		ProductIndex index = ProductInterner::Find(productId);
+		if (index < 0 || size_t(index) >= toptable.size())
+			return BidOffer();
+		return toptable.at(index);
   }
 
-  // Aggregate the order book
-	virtual const OrderBook<T>& AggregateDepth(const string &productId) {
-		T p=markettable[productId].GetProduct();		
-		unordered_map<double,long> bidmap;
-		unordered_map<double, long> offermap;
-		for (auto& bid : markettable[productId].GetBidStack())
-		{
-			bidmap[bid.GetPrice()] += bid.GetQuantity();
-		}
-		for (auto& offer : markettable[productId].GetOfferStack())
-		{
-			offermap[offer.GetPrice()] += offer.GetQuantity();
-		}
-		vector<Order> bidbook;
-		vector<Order> offerbook;
-		for (auto& bid : bidmap)
-		{
-			Order order(bid.first, bid.second, BID);
-			bidbook.push_back(order);
-		}
-		for (auto& offer : offermap)
+  // Get the best bid/offer order of a product
+	const BidOffer& GetBestBidOffer(const T &product) {
+		return toptable[product.GetProductIndex()];
+  }
+
+  // Get the number of levels a side aggregated depth is kept to
+	int GetDepth() const {
+		return Depth;
+	}
+
+  // Set the number of levels a side aggregated depth is kept to; depth already kept
+  // is taken again from the stored books
+	void SetDepth(int depth) {
+		Depth = depth;
+		for (size_t i = 0; i < markettable.size(); i++)
 		{
-			Order order(offer.first, offer.second, OFFER);
-			offerbook.push_back(order);
+			const OrderBook<T> &book = markettable.at(ProductIndex(i));
+			if (!book.GetBids().Empty() || !book.GetOffers().Empty())
+				depthtable[ProductIndex(i)].Build(book, GetDepthLevels());
 		}
+	}
+
+  // Set how many ticks either side of a product's first price the books kept for it
+  // cover from the start, so prices moving within them never grow a ladder; 0, the
+  // default, grows ladders as prices arrive. Wider windows cost scans over more empty
+  // ticks. Books already kept keep their windows.
+	void SetReservedTicks(int64_t ticks) {
+		reservedTicks = ticks;
+	}
 
+  // Get the number of ticks the books kept here reserve either side of their first price
+	int64_t GetReservedTicks() const {
+		return reservedTicks;
+	}
 
-		return OrderBook<T>(p, bidbook, offerbook);
+  // Get the aggregated depth of a product, the best Depth levels of each side; a
+  // product with no book gives no levels
+	virtual const MarketDepth<T>& AggregateDepth(const string &productId) {
+		static const MarketDepth<T> empty;
+		ProductIndex index = ProductInterner::Find(productId);
+		if (index < 0 || size_t(index) >= depthtable.size())
+			return empty;
+		return depthtable.at(index);
+  }
 
+  // Get the aggregated depth of a product
+	const MarketDepth<T>& AggregateDepth(const T &product) {
+		return depthtable[product.GetProductIndex()];
   }
 
 
@@ -237,48 +643,177 @@ template<typename T>
 class MarketConnector :public Connector<OrderBook<T>> {
 private:
 	MarketDataService<T>* service;
+	size_t batchSize;
+	Market venue;
 public:
-	MarketConnector(MarketDataService<T>* service) :service(service) {}
+	MarketConnector(MarketDataService<T>* service) :service(service), batchSize(64), venue(BROKERTEC) {}
 	~MarketConnector() {}
-	void Subscribe(ifstream& file) {
-		string line;
-		stringstream linestream;
+
+	// Set the number of order books pushed to the service per block
+	void SetBatchSize(size_t size) {
+		batchSize = size;
+	}
+
+	// Set the venue the books read are quoted at, and updates that name none
+	void SetVenue(Market _venue) {
+		venue = _venue;
+	}
+
+	using Connector<OrderBook<T>>::Subscribe;
+
+	// Read order book levels, one per line: productId,mid,spread,quantity, or as
+	// MarketRecords; every five levels make one book. Lines of five or six fields,
+	// productId,ADD|MODIFY|DELETE,BID|OFFER,price,quantity[,venue], or
+	// BookUpdateRecords, are incremental updates to one level of a venue's book.
+	void Subscribe(FeedSource& source) {
+		static const LatencyPoint feed("market feed");
 		cout << "Market data loading......" << endl;
+		RecordHeader header;
+		if (PeekRecordHeader(source, header) && header.type == BOOK_UPDATE_RECORD)
+		{
+			SubscribeUpdates(source);
+			cout << "market data loaded......" << endl;
+			return;
+		}
+		RecordReader<MarketRecord> binary(source);
+		MarketRecord record;
+		string_view line;
+		string_view component[6];
 		
 		static long number = 0;
 		vector<Order> bidstack;
 		vector<Order> offerstack;
-		while (getline(file, line))
+		vector<OrderBook<T>> block;
+		block.reserve(batchSize);
+		vector<OrderBookUpdate<T>> updates;
+		updates.reserve(batchSize);
+		while (binary ? binary.Next(record) : source.NextLine(line))
 		{
-			linestream.clear();
-			linestream.str(line);
-			string temp;
-			vector<string> component;
-			while (getline(linestream, temp, ','))
-				component.push_back(temp);
-			date d(2018, Nov, 25);
-			T bond(component[0], CUSIP, "T", 0, d);
-			double mid = convert(component[1]);
-			double spread =  1.0 / 256.0 * (8 - abs(number % 6 - 3) * 2);
-			long quantity = stol(component[3]);
-			Order ordero(mid + spread / 2, quantity, OFFER);
-			Order orderb(mid - spread / 2, quantity, BID);
+			// A block is as old as the first line of its first book or update
+			if (block.empty() && bidstack.empty() && updates.empty())
+				LatencyTrace::Begin(feed);
+			string_view productId;
+			FixedPrice mid;
+			long quantity;
+			if (binary)
+			{
+				productId = GetRecordText(record.productId);
+				mid = FixedPrice::FromDouble(record.mid);
+				quantity = long(record.quantity);
+			}
+			else
+			{
+				size_t fields = SplitFields(line, ',', component, 6);
+				if (fields >= 5)
+				{
+					// Books already read go first, so the update applies on top of them
+					OrderBookUpdate<T> update;
+					if (!ParseUpdate(component, fields, update))
+						continue;
+					Flush(block);
+					updates.push_back(update);
+					if (updates.size() >= batchSize || !source.Ready())
+						FlushUpdates(updates);
+					continue;
+				}
+				if (fields < 4)
+					continue;
+				productId = component[0];
+				mid = ConvertPrice(component[1]);
+				quantity = ParseLong(component[3]);
+			}
+			const T &bond = ProductRegistry<T>::Instance().Get(productId);
+			FixedPrice spread = FixedPrice::FromTicks(8 - abs(number % 6 - 3) * 2);
+			Order ordero(mid + spread.Half(), quantity, OFFER);
+			Order orderb(mid - spread.Half(), quantity, BID);
 			bidstack.push_back(orderb);
 			offerstack.push_back(ordero);
 			number++;
 			
 			if (number % 5 == 0) {
-				OrderBook<T> book(bond, bidstack, offerstack);
-
-				service->OnMessage(book);
+				FlushUpdates(updates);
+				block.push_back(OrderBook<T>(bond, bidstack, offerstack, venue));
 				bidstack.clear();
 				offerstack.clear();
-
+				if (block.size() >= batchSize)
+					Flush(block);
 			}
+			// A book spans several lines, so whole books are pushed whenever the next
+			// line has not arrived, not only as a book completes
+			if (!(binary ? binary.Ready() : source.Ready()))
+				Flush(block);
 		}
+		Flush(block);
+		FlushUpdates(updates);
 		cout << "market data loaded......" << endl;
 
 	}
+
+	// Read incremental updates from a feed of BookUpdateRecords
+	void SubscribeUpdates(FeedSource& source) {
+		static const LatencyPoint feed("market feed");
+		RecordReader<BookUpdateRecord> binary(source);
+		BookUpdateRecord record;
+		vector<OrderBookUpdate<T>> updates;
+		updates.reserve(batchSize);
+		while (binary.Next(record))
+		{
+			if (record.action > DELETE_LEVEL || record.side > OFFER || record.venue >= MARKETS)
+				continue;
+			if (updates.empty())
+				LatencyTrace::Begin(feed);
+			const T &bond = ProductRegistry<T>::Instance().Get(GetRecordText(record.productId));
+			Order level(FixedPrice::FromDouble(record.price), long(record.quantity), PricingSide(record.side));
+			updates.push_back(OrderBookUpdate<T>(bond, BookAction(record.action), level, Market(record.venue)));
+			if (updates.size() >= batchSize || !binary.Ready())
+				FlushUpdates(updates);
+		}
+		FlushUpdates(updates);
+	}
+
+private:
+	// Push a block of books to the service, if there are any
+	void Flush(vector<OrderBook<T>> &block) {
+		if (block.empty())
+			return;
+		AllocationRegion region;
+		service->OnMessageBatch(block.data(), block.size());
+		block.clear();
+	}
+
+	// Push a block of updates to the service, if there are any
+	void FlushUpdates(vector<OrderBookUpdate<T>> &updates) {
+		if (updates.empty())
+			return;
+		AllocationRegion region;
+		service->OnUpdateBatch(updates.data(), updates.size());
+		updates.clear();
+	}
+
+	// Parse productId,action,side,price,quantity and an optional venue; false if the
+	// action, side or venue is unknown
+	bool ParseUpdate(const string_view *fields, size_t count, OrderBookUpdate<T> &update) {
+		BookAction action;
+		if (fields[1] == "ADD")
+			action = ADD_LEVEL;
+		else if (fields[1] == "MODIFY")
+			action = MODIFY_LEVEL;
+		else if (fields[1] == "DELETE")
+			action = DELETE_LEVEL;
+		else
+			return false;
+		if (fields[2] != "BID" && fields[2] != "OFFER")
+			return false;
+		PricingSide side = fields[2] == "BID" ? BID : OFFER;
+		Market market = venue;
+		if (count > 5 && !ParseVenue(fields[5], market))
+			return false;
+		const T &bond = ProductRegistry<T>::Instance().Get(fields[0]);
+		update = OrderBookUpdate<T>(bond, action, Order(ConvertPrice(fields[3]), ParseLong(fields[4]), side), market);
+		return true;
+	}
+
+public:
 	void Publish(OrderBook<T> &data) {}
 
 
@@ -314,14 +849,14 @@ public:
 
 
 
-Order::Order(double _price, long _quantity, PricingSide _side)
+Order::Order(FixedPrice _price, long _quantity, PricingSide _side)
 {
   price = _price;
   quantity = _quantity;
   side = _side;
 }
 
-double Order::GetPrice() const
+FixedPrice Order::GetPrice() const
 {
   return price;
 }
@@ -352,27 +887,237 @@ const Order& BidOffer::GetOfferOrder() const
 }
 
 template<typename T>
-OrderBook<T>::OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack) :
-  product(_product), bidStack(_bidStack), offerStack(_offerStack)
+OrderBookUpdate<T>::OrderBookUpdate(const T &_product, BookAction _action, const Order &_level, Market _venue) :
+  product(&_product), action(_action), venue(_venue), level(_level)
+{
+}
+
+template<typename T>
+Market OrderBookUpdate<T>::GetVenue() const
+{
+  return venue;
+}
+
+template<typename T>
+const T& OrderBookUpdate<T>::GetProduct() const
+{
+  return *product;
+}
+
+template<typename T>
+BookAction OrderBookUpdate<T>::GetAction() const
+{
+  return action;
+}
+
+template<typename T>
+const Order& OrderBookUpdate<T>::GetLevel() const
+{
+  return level;
+}
+
+template<typename T>
+TopOfBook<T>::TopOfBook(const T &_product, const BidOffer &_bidOffer, unsigned _bidVenues, unsigned _offerVenues) :
+  product(&_product), bidOffer(_bidOffer), bidVenues(uint8_t(_bidVenues)), offerVenues(uint8_t(_offerVenues))
+{
+}
+
+template<typename T>
+unsigned TopOfBook<T>::GetBidVenues() const
+{
+  return bidVenues;
+}
+
+template<typename T>
+unsigned TopOfBook<T>::GetOfferVenues() const
+{
+  return offerVenues;
+}
+
+template<typename T>
+const T& TopOfBook<T>::GetProduct() const
+{
+  return *product;
+}
+
+template<typename T>
+const BidOffer& TopOfBook<T>::GetBidOffer() const
+{
+  return bidOffer;
+}
+
+template<typename T>
+const T& MarketDepth<T>::GetProduct() const
+{
+  return *product;
+}
+
+template<typename T>
+const vector<Order>& MarketDepth<T>::GetBidStack() const
+{
+  return bids;
+}
+
+template<typename T>
+const vector<Order>& MarketDepth<T>::GetOfferStack() const
+{
+  return offers;
+}
+
+template<typename T>
+void MarketDepth<T>::Build(const OrderBook<T> &book, size_t depth)
+{
+  product = &book.GetProduct();
+  Take(book.GetBids(), BID, depth, bids);
+  Take(book.GetOffers(), OFFER, depth, offers);
+}
+
+template<typename T>
+void MarketDepth<T>::Update(const OrderBook<T> &book, const OrderBookUpdate<T> &update, size_t depth)
+{
+  product = &update.GetProduct();
+  PricingSide side = update.GetLevel().GetSide();
+  const PriceLadder &ladder = side == BID ? book.GetBids() : book.GetOffers();
+  vector<Order> &stack = side == BID ? bids : offers;
+  int64_t tick = update.GetLevel().GetPrice().GetTicks();
+  if (depth > 0 && stack.size() >= depth)
+  {
+    int64_t deepest = stack.back().GetPrice().GetTicks();
+    if (side == BID ? tick < deepest : tick > deepest)
+      return;
+  }
+  // A level shown that is still quoted is resized where it is
+  long quantity = ladder.GetQuantity(tick);
+  if (quantity > 0)
+  {
+    for (Order &order : stack)
+    {
+      if (order.GetPrice().GetTicks() == tick)
+      {
+        order = Order(order.GetPrice(), quantity, side);
+        return;
+      }
+    }
+  }
+  Take(ladder, side, depth, stack);
+}
+
+template<typename T>
+void MarketDepth<T>::Take(const PriceLadder &ladder, PricingSide side, size_t depth, vector<Order> &stack)
+{
+  if (stack.capacity() < depth)
+    stack.reserve(depth);
+  stack.clear();
+  ladder.ForBest(depth, [&](int64_t tick, long quantity) { stack.push_back(Order(FixedPrice::FromTicks(tick), quantity, side)); });
+}
+
+template<typename T>
+OrderBook<T>::OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack, Market _venue) :
+  product(&_product), venue(_venue)
 {
+  Quote(_bidStack, bids);
+  Quote(_offerStack, offers);
+}
+
+template<typename T>
+void OrderBook<T>::Quote(const vector<Order> &stack, PriceLadder &ladder)
+{
+  if (stack.empty())
+    return;
+  // One window for the whole stack
+  int64_t low = stack[0].GetPrice().GetTicks();
+  int64_t high = low;
+  for (const Order &order : stack)
+  {
+    low = min(low, order.GetPrice().GetTicks());
+    high = max(high, order.GetPrice().GetTicks());
+  }
+  ladder.Reserve(low, high);
+  for (const Order &order : stack)
+    ladder.Add(order.GetPrice().GetTicks(), order.GetQuantity());
 }
 
 template<typename T>
 const T& OrderBook<T>::GetProduct() const
 {
-  return product;
+  return *product;
+}
+
+template<typename T>
+vector<Order> OrderBook<T>::GetBidStack() const
+{
+  return Levels(bids, BID);
+}
+
+template<typename T>
+vector<Order> OrderBook<T>::GetOfferStack() const
+{
+  return Levels(offers, OFFER);
+}
+
+template<typename T>
+vector<Order> OrderBook<T>::Levels(const PriceLadder &ladder, PricingSide side)
+{
+  vector<Order> stack;
+  stack.reserve(ladder.GetLevels());
+  ladder.ForEach([&](int64_t tick, long quantity) { stack.push_back(Order(FixedPrice::FromTicks(tick), quantity, side)); });
+  return stack;
+}
+
+template<typename T>
+bool OrderBook<T>::Apply(const OrderBookUpdate<T> &update)
+{
+  // A product's first update may come before any book of it
+  product = &update.GetProduct();
+  const Order &level = update.GetLevel();
+  PriceLadder &ladder = level.GetSide() == BID ? bids : offers;
+  int64_t tick = level.GetPrice().GetTicks();
+  if (update.GetAction() != ADD_LEVEL && ladder.GetQuantity(tick) == 0)
+    return false;
+  ladder.Set(tick, update.GetAction() == DELETE_LEVEL ? 0 : level.GetQuantity());
+  return true;
+}
+
+template<typename T>
+void OrderBook<T>::AddLevel(const T &_product, PricingSide side, int64_t tick, long quantity)
+{
+  product = &_product;
+  if (quantity != 0)
+    (side == BID ? bids : offers).Add(tick, quantity);
+}
+
+template<typename T>
+void OrderBook<T>::AddBook(const OrderBook<T> &book, long sign)
+{
+  // An empty book may have no product yet
+  if (book.product)
+    product = book.product;
+  book.bids.ForEach([&](int64_t tick, long quantity) { bids.Add(tick, sign * quantity); });
+  book.offers.ForEach([&](int64_t tick, long quantity) { offers.Add(tick, sign * quantity); });
+}
+
+template<typename T>
+void OrderBook<T>::Reserve(int64_t low, int64_t high)
+{
+  bids.Reserve(low, high);
+  offers.Reserve(low, high);
 }
 
 template<typename T>
-const vector<Order>& OrderBook<T>::GetBidStack() const
+void OrderBook<T>::Assign(const OrderBook<T> &book)
 {
-  return bidStack;
+  product = book.product;
+  venue = book.venue;
+  bids.Assign(book.bids);
+  offers.Assign(book.offers);
 }
 
 template<typename T>
-const vector<Order>& OrderBook<T>::GetOfferStack() const
+BidOffer OrderBook<T>::GetBidOffer() const
 {
-  return offerStack;
+  Order bid(bids.Empty() ? FixedPrice() : FixedPrice::FromTicks(bids.GetBestTick()), bids.GetBestQuantity(), BID);
+  Order offer(offers.Empty() ? FixedPrice() : FixedPrice::FromTicks(offers.GetBestTick()), offers.GetBestQuantity(), OFFER);
+  return BidOffer(bid, offer);
 }
 
 #endif
@@ -0,0 +1,84 @@
+/**
+ * objectpool.hpp
+ * Defines a per-type pool that recycles message objects between events.
+ */
+#ifndef OBJECT_POOL_HPP
+#define OBJECT_POOL_HPP
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+/**
+ * Pool of a fixed number of reusable objects of one type, all created up front.
+ * Released objects are not destroyed: they go back on a free list as they are and
+ * the next Acquire hands them out again, so members such as strings and vectors keep
+ * their capacity and refilling them does not allocate. The pool never touches the
+ * heap after construction. When every object is in use, Acquire waits for one to be
+ * released, so a producer that runs ahead of its consumers is held back rather than
+ * growing the pool; objects must therefore be released by threads other than one
+ * waiting in Acquire.
+ * Acquire and Release may be called from different threads.
+ * Type T is the pooled type and must be default-constructible.
+ */
+template<typename T>
+class ObjectPool
+{
+
+public:
+
+  // ctor for a pool of the given number of objects
+  explicit ObjectPool(size_t _capacity = 256) :
+    capacity(_capacity == 0 ? 1 : _capacity), objects(new T[capacity]), waiting(0)
+  {
+    freelist.reserve(capacity);
+    for (size_t i = 0; i < capacity; i++)
+      freelist.push_back(&objects[i]);
+  }
+
+  // Get an object, in the state it was last released in or default-constructed;
+  // waits while every object is in use
+  T* Acquire()
+  {
+    unique_lock<mutex> guard(lock);
+    while (freelist.empty())
+    {
+      waiting++;
+      released.wait(guard);
+      waiting--;
+    }
+    T *object = freelist.back();
+    freelist.pop_back();
+    return object;
+  }
+
+  // Return an object to the pool
+  void Release(T *object)
+  {
+    lock_guard<mutex> guard(lock);
+    freelist.push_back(object);
+    if (waiting > 0)
+      released.notify_one();
+  }
+
+  // Get the number of objects in the pool
+  size_t Size() const
+  {
+    return capacity;
+  }
+
+private:
+  size_t capacity;
+  unique_ptr<T[]> objects;
+  mutex lock;
+  condition_variable released;
+  size_t waiting;
+  // Room for every object the pool owns, so Release never reallocates
+  vector<T*> freelist;
+
+};
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * pipeline.hpp
+ * Defines a statically composed chain of listeners fixed at compile time.
+ */
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "soa.hpp"
+
+using namespace std;
+
+/**
+ * A chain of pipeline stages held by reference.
+ * Each stage type S provides a non-virtual
+ *   template<typename Next> void Process(In &data, Next &next)
+ * that does its own work and hands its output to next(out). Because every
+ * hop is a direct call on a known type the compiler can inline the whole chain.
+ */
+template<typename... Stages>
+class PipelineChain;
+
+// End of a chain: swallows the output of the last stage
+template<>
+class PipelineChain<>
+{
+
+public:
+
+  template<typename U>
+  void operator()(U &data) {}
+
+};
+
+template<typename Head, typename... Tail>
+class PipelineChain<Head, Tail...>
+{
+
+public:
+
+  // ctor for a chain over the given stages
+  PipelineChain(Head &_head, Tail&... _tail) :
+    head(_head), tail(_tail...)
+  {
+  }
+
+  // Run data through this stage and the rest of the chain
+  template<typename U>
+  void operator()(U &data)
+  {
+    head.Process(data, tail);
+  }
+
+private:
+  Head &head;
+  PipelineChain<Tail...> tail;
+
+};
+
+/**
+ * A listener that runs a compile-time chain of stages.
+ * Registering it on a Service costs one virtual call at the entry; every hop
+ * after that is static. Use it for fixed hot paths and keep AddListener for
+ * wiring that has to change at runtime.
+ * Type V is the data type delivered by the upstream Service.
+ */
+template<typename V, typename... Stages>
+class StaticPipeline : public ServiceListener<V>
+{
+
+public:
+
+  // ctor for a pipeline over the given stages, in order
+  StaticPipeline(Stages&... stages) :
+    chain(stages...)
+  {
+  }
+
+  // Listener callback to process an add event to the Service
+  virtual void ProcessAdd(V &data)
+  {
+    chain(data);
+  }
+
+  // Listener callback to process a remove event to the Service
+  virtual void ProcessRemove(V &data) {}
+
+  // Listener callback to process an update event to the Service
+  virtual void ProcessUpdate(V &data) {}
+
+private:
+  PipelineChain<Stages...> chain;
+
+};
+
+#endif
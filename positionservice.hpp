@@ -10,9 +10,14 @@
 
 #include <string>
 #include <map>
+#include <mutex>
+#include <algorithm>
 #include "soa.hpp"
 #include "tradebookingservice.hpp"
 #include "products.hpp"
+#include "latency.hpp"
+#include "recordwriter.hpp"
+#include "binaryrecords.hpp"
 
 using namespace std;
 
@@ -30,21 +35,31 @@ public:
   Position(const T &_product);
   Position() = default;
   Position(const T &_product, long q1, long q2, long q3) :
-	  product(_product) 
+	  product(&_product) 
   {
-	  positions = map<string, long>();
-	  positions["TRSY1"] = q1;
-	  positions["TRSY2"] = q2;
-	  positions["TRSY3"] = q3;
+	  positions[0] = q1;
+	  positions[1] = q2;
+	  positions[2] = q3;
   }
   string Position_to_String() {
-	  string s1 = product.GetProductId();
-	  string s2 = to_string(positions["TRSY1"]);
-	  string s3 = to_string(positions["TRSY2"]);
-	  string s4 = to_string(positions["TRSY3"]);
-	  string s5 = to_string(GetAggregatePosition());
-	  return s1 + "," + s2 + "," + s3 + "," + s4 + "," + s5;
+	  char buffer[256];
+	  RecordWriter out(buffer, sizeof(buffer));
+	  Position_to_chars(out);
+	  return string(out.View());
+  }
+
+  // Write productId,TRSY1,TRSY2,TRSY3,aggregate
+  void Position_to_chars(RecordWriter &out) const {
+	  out.Text(product->GetProductId()).Char(',').Integer(positions[0]).Char(',').Integer(positions[1])
+		  .Char(',').Integer(positions[2]).Char(',').Integer(positions[0] + positions[1] + positions[2]);
+  }
 
+  // Fill every field of a record but its time
+  void Position_to_record(PositionRecord &record) const {
+	  SetRecordText(record.productId, product->GetProductId());
+	  for (int i = 0; i < 3; i++)
+		  record.positions[i] = positions[i];
+	  record.aggregate = positions[0] + positions[1] + positions[2];
   }
 
 
@@ -58,8 +73,13 @@ public:
   long GetAggregatePosition();
 
 private:
-  T product;
-  map<string,long> positions;
+  const T *product = nullptr;
+  // Quantity per book: TRSY1, TRSY2, TRSY3. The books are fixed, so an inline
+  // array replaces the map and copying a position never allocates.
+  long positions[3] = { 0, 0, 0 };
+
+  // Get the slot for a book; -1 if it is not one of ours
+  static int BookSlot(const string &book);
 
 };
 template<typename T>
@@ -84,6 +104,12 @@ public:
 		service->AddTrade(data);
 	}
 
+	// Listener callback to process a block of add events to the Service
+	void ProcessAddBatch(Trade<T> *data, size_t count)
+	{
+		service->AddTradeBatch(data, count);
+	}
+
 	// Listener callback to process a remove event to the Service
 	virtual void ProcessRemove(Trade<T> &data) {}
 
@@ -95,48 +121,56 @@ public:
 /**
  * Position Service to manage positions across multiple books and secruties.
  * Keyed on product identifier.
+ * Safe under concurrent producers: each product is guarded by one of a fixed set of
+ * striped locks, so updates to one product and their notifications are serialized
+ * while different products proceed in parallel.
  * Type T is the product type.
  */
 template<typename T>
 class PositionService : public Service<string,Position <T> >
 {
 private:
-	map<string, Position<T>> position;
+	ProductTable<Position<T>> position;
 	vector<ServiceListener<Position<T>>*> listeners;
 	PositionToBookingListener<T>* listener;
 
+	static const size_t STRIPES = 64;
+	mutex stripes[STRIPES];
+
+	// Get the lock guarding a product
+	mutex& Stripe(ProductIndex index) { return stripes[size_t(index) % STRIPES]; }
+
+	// Net quantity per book accumulated for one product over a block of trades
+	struct BookDelta
+	{
+		long quantity[3];
+		const T* product;
+	};
+
 public:
 	PositionService() {
-		position = map<string, Position<T>>();
+		position = ProductTable<Position<T>>();
 		listeners = vector<ServiceListener<Position<T>>*>();
 		listener =new PositionToBookingListener<T>(this);
-		date d(2018, Nov, 25);
-		T bond1("2Y", CUSIP, "T", 0, d);
-		position["2Y"] = Position<T>(bond1);
-		T bond2("3Y", CUSIP, "T", 0, d);
-		position["3Y"] = Position<T>(bond2);
-		T bond3("5Y", CUSIP, "T", 0, d);
-		position["5Y"] = Position<T>(bond3);
-		T bond4("7Y", CUSIP, "T", 0, d);
-		position["7Y"] = Position<T>(bond4);
-		T bond5("10Y", CUSIP, "T", 0, d);
-		position["10Y"] = Position<T>(bond5);
-		T bond6("30Y", CUSIP, "T", 0, d);
-		position["30Y"] = Position<T>(bond6);
+		ProductRegistry<T>& registry = ProductRegistry<T>::Instance();
+		for (const char* bond : { "2Y", "3Y", "5Y", "7Y", "10Y", "30Y" })
+			position[bond] = Position<T>(registry.Get(bond));
 
 
   }
 	~PositionService() { delete listener; }
   // Add a trade to the service
 	virtual void AddTrade(const Trade<T> &trade) {
+		static const LatencyPoint hop("position");
+		LatencyHop trace(hop);
+		const T& product = trade.GetProduct();
+		lock_guard<mutex> guard(Stripe(product.GetProductIndex()));
 		string book = trade.GetBook();
-		T product = trade.GetProduct();
-		string bond = product.GetProductId();
 		long quantity = trade.GetQuantity();
 		Side side = trade.GetSide();
 		if (side == SELL)
 			quantity = -quantity;
-		vector<long> q(3, 0);
+		long q[3] = { 0, 0, 0 };
 		if (book == "TRSY1")
 			q[0] += quantity;
 		else if (book == "TRSY2")
@@ -147,14 +181,74 @@ public:
 		string s2("TRSY2");
 		string s3("TRSY3");
 
-		Position<T> p(product, q[0]+position[bond].GetPosition(s1), q[1]+position[bond].GetPosition(s2), q[2]+position[bond].GetPosition(s3));
-		position[bond] = p;
+		Position<T>& current = position[product.GetProductIndex()];
+		Position<T> p(product, q[0]+current.GetPosition(s1), q[1]+current.GetPosition(s2), q[2]+current.GetPosition(s3));
+		current = p;
 		for (auto& l : listeners)
 			l->ProcessAdd(p);
   }
+
+  // Add a block of trades: net them per product and book, then update each
+  // product's position once and notify the listeners with one block of positions
+	virtual void AddTradeBatch(const Trade<T> *trades, size_t count) {
+		static const LatencyPoint hop("position");
+		LatencyHop trace(hop);
+		// A block from a sharded edge holds one product, so a short list beats a table here.
+		// Scratch is per thread and keeps its capacity, so steady-state blocks do not allocate.
+		static thread_local vector<BookDelta> deltas;
+		static thread_local vector<size_t> held;
+		static thread_local vector<Position<T>> updated;
+		deltas.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			const Trade<T>& trade = trades[i];
+			size_t d = 0;
+			while (d < deltas.size() && deltas[d].product != &trade.GetProduct())
+				d++;
+			if (d == deltas.size())
+				deltas.push_back(BookDelta{ { 0, 0, 0 }, &trade.GetProduct() });
+			BookDelta& delta = deltas[d];
+			long quantity = trade.GetQuantity();
+			if (trade.GetSide() == SELL)
+				quantity = -quantity;
+			if (trade.GetBook() == "TRSY1")
+				delta.quantity[0] += quantity;
+			else if (trade.GetBook() == "TRSY2")
+				delta.quantity[1] += quantity;
+			else
+				delta.quantity[2] += quantity;
+		}
+		string s1("TRSY1");
+		string s2("TRSY2");
+		string s3("TRSY3");
+
+		// Take every stripe the block touches, in ascending order so concurrent blocks cannot deadlock
+		held.clear();
+		for (const BookDelta& delta : deltas)
+			held.push_back(size_t(delta.product->GetProductIndex()) % STRIPES);
+		sort(held.begin(), held.end());
+		held.erase(unique(held.begin(), held.end()), held.end());
+		for (size_t s : held)
+			stripes[s].lock();
+
+		updated.clear();
+		for (const BookDelta& delta : deltas)
+		{
+			Position<T>& current = position[delta.product->GetProductIndex()];
+			current = Position<T>(*delta.product, delta.quantity[0]+current.GetPosition(s1), delta.quantity[1]+current.GetPosition(s2), delta.quantity[2]+current.GetPosition(s3));
+			updated.push_back(current);
+		}
+		for (auto& l : listeners)
+			l->ProcessAddBatch(updated.data(), updated.size());
+
+		for (size_t s : held)
+			stripes[s].unlock();
+  }
 	// Get data on our service given a key
 	Position<T>& GetData(string key) {
-		return position[key];
+		ProductIndex index = ProductInterner::Intern(key);
+		lock_guard<mutex> guard(Stripe(index));
+		return position[index];
 	}
 
 	// The callback that a Connector should invoke for any new or updated data
@@ -185,31 +279,40 @@ public:
 
 template<typename T>
 Position<T>::Position(const T &_product) :
-  product(_product)
+  product(&_product)
+{
+}
+
+template<typename T>
+int Position<T>::BookSlot(const string &book)
 {
-	positions = map<string, long>();
-	positions["TRSY1"] = 0;
-	positions["TRSY2"] = 0;
-	positions["TRSY3"] = 0;
+	if (book == "TRSY1")
+		return 0;
+	if (book == "TRSY2")
+		return 1;
+	if (book == "TRSY3")
+		return 2;
+	return -1;
 }
 
 template<typename T>
 const T& Position<T>::GetProduct() const
 {
-  return product;
+  return *product;
 }
 
 template<typename T>
 long Position<T>::GetPosition(string &book)
 {
-  return positions[book];
+  int slot = BookSlot(book);
+  return slot < 0 ? 0 : positions[slot];
 }
 
 template<typename T>
 long Position<T>::GetAggregatePosition()
 {
   // No-op implementation - should be filled out for implementations
-	return positions["TRSY1"] + positions["TRSY2"] + positions["TRSY3"];
+	return positions[0] + positions[1] + positions[2];
 }
 
 #endif
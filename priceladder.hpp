@@ -0,0 +1,265 @@
+/**
+ * priceladder.hpp
+ * Defines one side of an order book as a ladder of price levels indexed by tick.
+ */
+#ifndef PRICE_LADDER_HPP
+#define PRICE_LADDER_HPP
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "fixedprice.hpp"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+// Get the position of the lowest set bit of a nonzero word
+inline int LowestBit(uint64_t word)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, word);
+  return int(index);
+#else
+  return __builtin_ctzll(word);
+#endif
+}
+
+// Get the position of the highest set bit of a nonzero word
+inline int HighestBit(uint64_t word)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanReverse64(&index, word);
+  return int(index);
+#else
+  return 63 - __builtin_clzll(word);
+#endif
+}
+
+/**
+ * One side of an order book: the quantity quoted at each price, in a contiguous
+ * array indexed by tick over a window of the ladder, with a bitmap of the ticks that
+ * are quoted. The best level is tracked as levels come and go, so the top of the
+ * book is read in constant time.
+ *
+ * Quoting, resizing or removing a level is constant time, except that removing the
+ * best level looks for the next one through the bitmap, 64 ticks a word, which for a
+ * book of adjacent levels is the next word at most. A tick outside the window grows
+ * it, at least doubling it, so growth is amortized over the levels quoted.
+ */
+class PriceLadder
+{
+
+public:
+
+  // ctor for the bid side, whose best level is its highest, or the offer side, whose
+  // best level is its lowest
+  explicit PriceLadder(bool _bid = true) : bid(_bid), base(0), best(-1), levels(0) {}
+
+  // Get whether no level is quoted
+  bool Empty() const { return levels == 0; }
+
+  // Get the number of levels quoted
+  size_t GetLevels() const { return levels; }
+
+  // Get the number of ticks the window covers, 0 before anything is quoted or reserved
+  size_t GetWindow() const { return quantities.size(); }
+
+  // Get the tick of the best level; the ladder must not be empty
+  int64_t GetBestTick() const { return base + best; }
+
+  // Get the quantity at the best level, or 0 if the ladder is empty
+  long GetBestQuantity() const { return levels ? quantities[size_t(best)] : 0; }
+
+  // Get the quantity at a tick, or 0 if it is not quoted
+  long GetQuantity(int64_t tick) const
+  {
+    if (tick < base || tick >= base + int64_t(quantities.size()))
+      return 0;
+    return quantities[size_t(tick - base)];
+  }
+
+  // Set the quantity at a tick; zero or less removes the level
+  void Set(int64_t tick, long quantity)
+  {
+    if (quantity <= 0)
+    {
+      Remove(tick);
+      return;
+    }
+    Reserve(tick, tick);
+    int64_t slot = tick - base;
+    uint64_t &word = occupied[size_t(slot / 64)];
+    uint64_t bit = 1ULL << (slot % 64);
+    if (!(word & bit))
+    {
+      word |= bit;
+      levels++;
+      if (best < 0 || (bid ? slot > best : slot < best))
+        best = slot;
+    }
+    quantities[size_t(slot)] = quantity;
+  }
+
+  // Add to the quantity at a tick
+  void Add(int64_t tick, long quantity)
+  {
+    Set(tick, GetQuantity(tick) + quantity);
+  }
+
+  // Remove the level at a tick, if it is quoted
+  void Remove(int64_t tick)
+  {
+    int64_t slot = tick - base;
+    if (slot < 0 || slot >= int64_t(quantities.size()))
+      return;
+    uint64_t &word = occupied[size_t(slot / 64)];
+    uint64_t bit = 1ULL << (slot % 64);
+    if (!(word & bit))
+      return;
+    word &= ~bit;
+    quantities[size_t(slot)] = 0;
+    levels--;
+    if (slot == best)
+      best = levels ? NextBest(slot) : -1;
+  }
+
+  // Quote exactly the levels of another ladder of the same side, keeping this
+  // ladder's window, which only grows for a level outside it
+  void Assign(const PriceLadder &other)
+  {
+    // Only the words with levels in them are touched
+    for (size_t w = 0; w < occupied.size() && levels > 0; w++)
+    {
+      uint64_t word = occupied[w];
+      while (word)
+      {
+        int b = LowestBit(word);
+        word &= word - 1;
+        quantities[w * 64 + size_t(b)] = 0;
+        levels--;
+      }
+      occupied[w] = 0;
+    }
+    best = -1;
+    levels = 0;
+    other.ForEach([&](int64_t tick, long quantity) { Set(tick, quantity); });
+  }
+
+  // Remove every level, keeping the window
+  void Clear()
+  {
+    fill(quantities.begin(), quantities.end(), 0);
+    fill(occupied.begin(), occupied.end(), 0);
+    best = -1;
+    levels = 0;
+  }
+
+  // Make the window cover the ticks from low to high, so quoting them does not grow it
+  void Reserve(int64_t low, int64_t high)
+  {
+    int64_t size = int64_t(quantities.size());
+    if (size > 0 && low >= base && high < base + size)
+      return;
+    int64_t from = Align(low);
+    int64_t to = Align(high) + 64;
+    if (size > 0)
+    {
+      // Grow by at least the current size, on the side that ran out
+      if (from < base)
+        from = min(from, base - size);
+      else
+        from = base;
+      if (to > base + size)
+        to = max(to, base + 2 * size);
+      else
+        to = base + size;
+    }
+    vector<long> grown(size_t(to - from), 0);
+    vector<uint64_t> grownOccupied(size_t((to - from) / 64), 0);
+    int64_t offset = base - from;
+    if (size > 0)
+    {
+      copy(quantities.begin(), quantities.end(), grown.begin() + offset);
+      copy(occupied.begin(), occupied.end(), grownOccupied.begin() + offset / 64);
+      if (best >= 0)
+        best += offset;
+    }
+    quantities.swap(grown);
+    occupied.swap(grownOccupied);
+    base = from;
+  }
+
+  // Call f(tick, quantity) for each level quoted, best first
+  template<typename F>
+  void ForEach(F f) const
+  {
+    ForBest(levels, f);
+  }
+
+  // Call f(tick, quantity) for each of the best count levels, best first; returns
+  // how many there were
+  template<typename F>
+  size_t ForBest(size_t count, F f) const
+  {
+    size_t visited = 0;
+    if (levels == 0)
+      return 0;
+    // No level is better than the best, so the scan starts at its word
+    int64_t words = int64_t(occupied.size());
+    for (int64_t w = best / 64; w >= 0 && w < words && visited < count; w += bid ? -1 : 1)
+    {
+      uint64_t word = occupied[size_t(w)];
+      while (word && visited < count)
+      {
+        int b = bid ? HighestBit(word) : LowestBit(word);
+        word &= ~(1ULL << b);
+        int64_t slot = w * 64 + b;
+        f(base + slot, quantities[size_t(slot)]);
+        visited++;
+      }
+    }
+    return visited;
+  }
+
+private:
+  bool bid;
+  // Tick of the first slot, a multiple of 64 so each bitmap word covers aligned ticks
+  int64_t base;
+  vector<long> quantities;
+  vector<uint64_t> occupied;
+  // Slot of the best level, or -1 when empty
+  int64_t best;
+  size_t levels;
+
+  static int64_t Align(int64_t tick)
+  {
+    return tick - ((tick % 64) + 64) % 64;
+  }
+
+  // Find the best level after one removed from a slot: the next lower for bids, the
+  // next higher for offers
+  int64_t NextBest(int64_t slot) const
+  {
+    int64_t w = slot / 64;
+    int b = int(slot % 64);
+    if (bid)
+    {
+      uint64_t word = b ? occupied[size_t(w)] & (~0ULL >> (64 - b)) : 0;
+      while (!word && --w >= 0)
+        word = occupied[size_t(w)];
+      return w * 64 + HighestBit(word);
+    }
+    uint64_t word = occupied[size_t(w)] & ((~0ULL << b) << 1);
+    int64_t words = int64_t(occupied.size());
+    while (!word && ++w < words)
+      word = occupied[size_t(w)];
+    return w * 64 + LowestBit(word);
+  }
+
+};
+
+#endif
@@ -0,0 +1,145 @@
+/**
+ * priceparser.hpp
+ * Allocation-free parsing of fractional Treasury prices such as 99-16+ and 100-042,
+ * one at a time with SWAR or a column at a time with SSE2.
+ */
+#ifndef PRICE_PARSER_HPP
+#define PRICE_PARSER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRADING_HAS_SSE2
+#endif
+
+using namespace std;
+
+/**
+ * Parser for prices in 32nds with a trailing eighth of a 32nd: handle-TTe, where the
+ * handle has one to three digits, TT is two digits of 32nds and e is a digit of
+ * 256ths or '+' for a half 32nd (4/256).
+ *
+ * Every such price is a whole number of 256ths, so it is computed exactly as
+ * (handle * 256 + TT * 8 + e) / 256. convert() sums handle + TT/32 + e/256, each
+ * term of which is also exact, so the two agree to the bit.
+ *
+ * A price is read as one little-endian 64-bit word: the handle is right-aligned into
+ * bytes 0-2, so '-' always lands in byte 3, TT in bytes 4-5 and e in byte 6. The
+ * digits are then checked and weighed all at once, with no loop or branch per digit.
+ */
+class PriceParser
+{
+
+public:
+
+  // Parse a price into 256ths; false if the text is not in handle-TTe form
+  static bool ParseTicks(const char *text, size_t length, int64_t &ticks)
+  {
+    uint64_t word;
+    if (!Normalize(text, length, word))
+      return false;
+    if (!AllDigits(word))
+      return false;
+    uint64_t d = word - DIGIT_ZEROS;
+    ticks = int64_t(Byte(d, 0) * 25600 + Byte(d, 1) * 2560 + Byte(d, 2) * 256
+      + Byte(d, 4) * 80 + Byte(d, 5) * 8 + Byte(d, 6));
+    return true;
+  }
+
+  // Parse a price; false if the text is not in handle-TTe form
+  static bool Parse(string_view text, double &price)
+  {
+    int64_t ticks;
+    if (!ParseTicks(text.data(), text.size(), ticks))
+      return false;
+    price = double(ticks) / 256.0;
+    return true;
+  }
+
+  // Parse a column of prices. Returns the number parsed; a price that is not in
+  // handle-TTe form stops the batch, leaving its index in the return value.
+  static size_t ParseBatch(const string_view *texts, double *prices, size_t count)
+  {
+    size_t i = 0;
+#ifdef TRADING_HAS_SSE2
+    // Two prices per register: check their digits and weigh them together
+    const __m128i zeros = _mm_set1_epi64x(int64_t(DIGIT_ZEROS));
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i digitbytes = _mm_set1_epi64x(int64_t(DIGIT_BYTES));
+    const __m128i weights = _mm_setr_epi16(25600, 2560, 256, 0, 80, 8, 1, 0);
+    const __m128i scale = _mm_castpd_si128(_mm_set1_pd(1.0 / 256.0));
+    for (; i + 2 <= count; i += 2)
+    {
+      uint64_t first, second;
+      if (!Normalize(texts[i].data(), texts[i].size(), first) || !Normalize(texts[i + 1].data(), texts[i + 1].size(), second))
+        break;
+      __m128i words = _mm_set_epi64x(int64_t(second), int64_t(first));
+      // Bytes that are not digits come out above 9 (unsigned) after taking '0' off
+      __m128i d = _mm_and_si128(_mm_sub_epi8(words, zeros), digitbytes);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, nine), d)) != 0xFFFF)
+        break;
+      __m128i zero = _mm_setzero_si128();
+      __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(d, zero), weights);
+      __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(d, zero), weights);
+      // Horizontal sums: lo holds four partial sums of the first price, hi of the second
+      __m128i sums = _mm_add_epi32(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+      sums = _mm_add_epi32(sums, _mm_srli_epi64(sums, 32));
+      sums = _mm_shuffle_epi32(sums, _MM_SHUFFLE(3, 3, 2, 0));
+      __m128d values = _mm_mul_pd(_mm_cvtepi32_pd(sums), _mm_castsi128_pd(scale));
+      _mm_storeu_pd(prices + i, values);
+    }
+#endif
+    for (; i < count; i++)
+      if (!Parse(texts[i], prices[i]))
+        break;
+    return i;
+  }
+
+private:
+  // '0' in each digit byte: the handle, the 32nds and the eighth
+  static const uint64_t DIGIT_ZEROS = 0x0030303000303030ULL;
+  // The digit bytes
+  static const uint64_t DIGIT_BYTES = 0x00FFFFFF00FFFFFFULL;
+
+  static uint64_t Byte(uint64_t word, int index)
+  {
+    return (word >> (8 * index)) & 0xFF;
+  }
+
+  // Load a price into the fixed layout: handle digits in bytes 0-2 (zero padded),
+  // 0 in byte 3 where the '-' was, the 32nds in 4-5 and the eighth, '+' read as 4, in 6
+  static bool Normalize(const char *text, size_t length, uint64_t &word)
+  {
+    if (length < 5 || length > 7)
+      return false;
+    size_t handle = length - 4;
+    word = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t i = 0; i < length; i++)
+      word |= uint64_t(uint8_t(text[i])) << (8 * i);
+#else
+    memcpy(&word, text, length);
+#endif
+    size_t shift = 8 * (3 - handle);
+    word = (word << shift) | (0x303030ULL & ((uint64_t(1) << shift) - 1));
+    if (Byte(word, 3) != '-')
+      return false;
+    word += uint64_t(Byte(word, 6) == '+') * (uint64_t('4' - '+') << 48);
+    word &= ~(uint64_t(0xFF) << 24);
+    return true;
+  }
+
+  // Get whether every digit byte holds '0'-'9'
+  static bool AllDigits(uint64_t word)
+  {
+    // A byte is a digit if its high nibble is 3 and adding 6 keeps it there
+    const uint64_t high = 0xF0F0F000F0F0F0ULL;
+    return (word & high) == (DIGIT_ZEROS & high)
+      && ((word + 0x0006060600060606ULL) & high) == (DIGIT_ZEROS & high);
+  }
+
+};
+
+#endif
@@ -12,30 +12,45 @@
 #include<map>
 #include<sstream>
 #include "products.hpp"
-
-
-double convert(string& s) {
-	stringstream ss(s);
-	string temp;
-	vector<string> strings;
-	while (getline(ss, temp, '-'))
-	{
-		strings.push_back(temp);
-	}
-	string s1 = strings[0];
-	string s2 = strings[1].substr(0, 2);
-	string s3 = strings[1].substr(2, 1);
-	double x1 = stoi(s1);
-	double x2 = double(stoi(s2)) / 32.0;
+#include "productregistry.hpp"
+#include "alloccounter.hpp"
+#include "latency.hpp"
+#include "priceparser.hpp"
+#include "fixedprice.hpp"
+#include "recordwriter.hpp"
+#include "binaryrecords.hpp"
+#include "chunkedingest.hpp"
+
+
+// Convert a price in fractional notation (99-16+, 100-042) to a decimal
+double convert(string_view s) {
+	double price;
+	if (PriceParser::Parse(s, price))
+		return price;
+	// Anything else, such as a handle of four or more digits, is read field by field
+	size_t dash = s.find('-');
+	string_view s1 = s.substr(0, dash);
+	string_view s2 = s.substr(dash + 1, 2);
+	string_view s3 = s.substr(dash + 3, 1);
+	double x1 = ParseLong(s1);
+	double x2 = double(ParseLong(s2)) / 32.0;
 	double x3;
 	if (s3 == "+")
 		x3 = 4.0 / 256.0;
 	else
-		x3 = (double(stoi(s3))) / 256.0;
+		x3 = (double(ParseLong(s3))) / 256.0;
 
 	return x1 + x2 + x3;
 }
 
+// Convert a price in fractional notation to an exact price
+inline FixedPrice ConvertPrice(string_view s) {
+	int64_t ticks;
+	if (PriceParser::ParseTicks(s.data(), s.size(), ticks))
+		return FixedPrice::FromTicks(ticks);
+	return FixedPrice::FromDouble(convert(s));
+}
+
 
 
 
@@ -51,47 +66,37 @@ class Price
 public:
 
   // ctor for a price
-  Price(const T &_product, double _mid, double _bidOfferSpread);
+  Price(const T &_product, FixedPrice _mid, FixedPrice _bidOfferSpread);
   Price() = default;
   // Get the product
   const T& GetProduct() const;
 
   // Get the mid price
-  double GetMid() const;
+  FixedPrice GetMid() const;
 
   // Get the bid/offer spread around the mid
-  double GetBidOfferSpread() const;
+  FixedPrice GetBidOfferSpread() const;
   string Price_to_string() {
-	  int x1 = int(mid);
-	  int x2 = int((mid-x1)*32);
-	  int x3 = int((mid-x1-(double(x2)/32.0))*256);
-	  string s1 = to_string(x1) + '-';
-	  string s2, s3;
-	  if (x2 < 10)
-		  s2 = '0' + to_string(x2);
-	  else
-		  s2 = to_string(x2);
-	  if (x3 == 4)
-		  s3 = "+";
-	  else
-		  s3 = to_string(x3);
-	  string _mid = s1 + s2 + s3;
-	  int x4 = int(bidOfferSpread * 256);
-	  string _spread;
+	  char buffer[256];
+	  RecordWriter out(buffer, sizeof(buffer));
+	  Price_to_chars(out);
+	  return string(out.View());
+  }
+
+  // Write productId,mid,spread with the prices in fractional notation
+  void Price_to_chars(RecordWriter &out) const {
+	  out.Text(GetProduct().GetProductId()).Char(',').Fractional(mid.ToDouble()).Char(',');
+	  int x4 = int(bidOfferSpread.GetTicks());
 	  if (x4 == 4)
-		  _spread = "0-00+";
+		  out.Text("0-00+");
 	  else
-		  _spread = "0-00" + to_string(x4);
-	  return GetProduct().GetProductId() + "," + _mid + "," + _spread;
-	
-
-
+		  out.Text("0-00").Integer(x4);
   }
 
 private:
-  T product;
-  double mid;
-  double bidOfferSpread;
+  const T *product = nullptr;
+  FixedPrice mid;
+  FixedPrice bidOfferSpread;
 
 };
 
@@ -110,12 +115,12 @@ template<typename T>
 class PricingService : public Service<string,Price <T> >
 {
 private:
-	map<string, Price<T>> pricetable;
+	ProductTable<Price<T>> pricetable;
 	PricingConnector<T>* connector;
 	vector<ServiceListener<Price<T>>*> listeners;
 public:
 	PricingService() {
-		pricetable = map<string, Price<T>>();
+		pricetable = ProductTable<Price<T>>();
 		connector = new PricingConnector<T>(this);
 		listeners = vector<ServiceListener<Price<T>>*>();
 	}
@@ -136,14 +141,24 @@ public:
 	// The callback that a Connector should invoke for any new or updated data
 	virtual void OnMessage(Price<T> &data)
 	{
-		T temp = data.GetProduct();
-		string stemp = temp.GetProductId();
-		Price<T> ptemp = data;
-		pricetable[stemp] = ptemp;
+		static const LatencyPoint hop("pricing");
+		LatencyHop trace(hop);
+		pricetable[data.GetProduct().GetProductIndex()] = data;
 		for (auto& listener : listeners)
 			listener->ProcessAdd(data);
 	}
 
+	// The callback that a Connector should invoke for a block of new or updated data
+	virtual void OnMessageBatch(Price<T> *data, size_t count)
+	{
+		static const LatencyPoint hop("pricing");
+		LatencyHop trace(hop);
+		for (size_t i = 0; i < count; i++)
+			pricetable[data[i].GetProduct().GetProductIndex()] = data[i];
+		for (auto& listener : listeners)
+			listener->ProcessAddBatch(data, count);
+	}
+
 	// Add a listener to the Service for callbacks on add, remove, and update events
 	// for data to the Service.
 	virtual void AddListener(ServiceListener<Price<T>> *listener)
@@ -172,31 +187,106 @@ template<typename T>
 class PricingConnector :public Connector<Price<T>> {
 private:
 	PricingService<T>* service;
+	size_t batchSize;
+	size_t parseThreads;
 public:
-	PricingConnector(PricingService<T>* service) :service(service) {}
+	PricingConnector(PricingService<T>* service) :service(service), batchSize(64), parseThreads(1) {}
 	~PricingConnector(){}
-	void Subscribe(ifstream& file) {
-		string line;
-		stringstream linestream;
+
+	// Set the number of prices pushed to the service per block
+	void SetBatchSize(size_t size) {
+		batchSize = size;
+	}
+
+	// Set the number of threads that parse a text feed held wholly in memory, such as
+	// a memory-mapped file; with more than one, the feed is parsed in chunks in
+	// parallel and the prices still reach the service in feed order
+	void SetParseThreads(size_t threads) {
+		parseThreads = threads;
+	}
+
+	using Connector<Price<T>>::Subscribe;
+
+	// Read prices, one per line: productId,mid,spread, or as PriceRecords
+	void Subscribe(FeedSource& source) {
+		static const LatencyPoint feed("price feed");
+		RecordReader<PriceRecord> binary(source);
+		PriceRecord record;
+		string_view line;
+		string_view component[3];
+		vector<Price<T>> block;
+		block.reserve(batchSize);
 		cout << "price data loading......" << endl;
-		while (getline(file, line))
+		string_view text;
+		if (!binary && parseThreads > 1 && source.TakeRest(text))
 		{
-			linestream.clear();
-			linestream.str(line);
-			string temp;
-			vector<string> component;
-			while (getline(linestream, temp, ','))
-				component.push_back(temp);
-			date d(2018, Nov, 25);
-			T bond(component[0], CUSIP, "T", 0, d);
-			double mid = convert(component[1]);
-			double spread = convert(component[2]);
-			Price<T> data(bond, mid, spread);
-			service->OnMessage(data);
+			SubscribeChunks(text, feed);
+			cout << "price data loaded......" << endl;
+			return;
+		}
+		while (binary ? binary.Next(record) : source.NextLine(line))
+		{
+			// A block is as old as its first line
+			if (block.empty())
+				LatencyTrace::Begin(feed);
+			string_view productId;
+			FixedPrice mid, spread;
+			if (binary)
+			{
+				productId = GetRecordText(record.productId);
+				mid = FixedPrice::FromDouble(record.mid);
+				spread = FixedPrice::FromDouble(record.spread);
+			}
+			else
+			{
+				if (SplitFields(line, ',', component, 3) < 3)
+					continue;
+				productId = component[0];
+				mid = ConvertPrice(component[1]);
+				spread = ConvertPrice(component[2]);
+			}
+			const T &bond = ProductRegistry<T>::Instance().Get(productId);
+			block.push_back(Price<T>(bond, mid, spread));
+			if (block.size() >= batchSize || !(binary ? binary.Ready() : source.Ready()))
+			{
+				AllocationRegion region;
+				service->OnMessageBatch(block.data(), block.size());
+				block.clear();
+			}
+		}
+		if (!block.empty())
+		{
+			AllocationRegion region;
+			service->OnMessageBatch(block.data(), block.size());
 		}
 		cout << "price data loaded......" << endl;
 
 	}
+
+	// Parse a whole text feed on parseThreads threads and push it in feed order
+	void SubscribeChunks(string_view text, const LatencyPoint &feed) {
+		ParallelIngest<Price<T>>(text, parseThreads,
+			[](string_view chunk, vector<Price<T>> &prices) {
+				string_view line;
+				string_view component[3];
+				while (TakeLine(chunk, line))
+				{
+					if (SplitFields(line, ',', component, 3) < 3)
+						continue;
+					const T &bond = ProductRegistry<T>::Instance().Get(component[0]);
+					prices.push_back(Price<T>(bond, ConvertPrice(component[1]), ConvertPrice(component[2])));
+				}
+			},
+			[&](vector<Price<T>> &prices) {
+				for (size_t i = 0; i < prices.size(); i += batchSize)
+				{
+					LatencyTrace::Begin(feed);
+					AllocationRegion region;
+					service->OnMessageBatch(prices.data() + i, min(batchSize, prices.size() - i));
+				}
+			});
+	}
+
 	void Publish(Price<T> &data) {}
 
 
@@ -220,8 +310,8 @@ public:
 
 
 template<typename T>
-Price<T>::Price(const T &_product, double _mid, double _bidOfferSpread) :
-  product(_product)
+Price<T>::Price(const T &_product, FixedPrice _mid, FixedPrice _bidOfferSpread) :
+  product(&_product)
 {
   mid = _mid;
   bidOfferSpread = _bidOfferSpread;
@@ -230,17 +320,17 @@ Price<T>::Price(const T &_product, double _mid, double _bidOfferSpread) :
 template<typename T>
  const T& Price<T>::GetProduct() const
 {
-  return product;
+  return *product;
 }
 
 template<typename T>
-double Price<T>::GetMid() const
+FixedPrice Price<T>::GetMid() const
 {
   return mid;
 }
 
 template<typename T>
-double Price<T>::GetBidOfferSpread() const
+FixedPrice Price<T>::GetBidOfferSpread() const
 {
   return bidOfferSpread;
 }
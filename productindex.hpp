@@ -0,0 +1,300 @@
+/**
+ * productindex.hpp
+ * Interns product identifiers into dense integer indices and defines
+ * flat per-product tables indexed by them.
+ */
+#ifndef PRODUCT_INDEX_HPP
+#define PRODUCT_INDEX_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+using namespace std;
+
+// Dense integer handle for a product identifier
+typedef int ProductIndex;
+
+/**
+ * Process-wide table mapping product identifiers to dense indices 0, 1, 2, ...
+ * A product is interned once, when it is first constructed at ingest; after that
+ * services address it by index and never compare strings.
+ *
+ * Lookups take no lock. Identifiers live in an open-addressed hash table whose
+ * slots are published with release stores, and by index in chunks installed the
+ * same way, so readers on any thread see an entry whole or not at all. Only a new
+ * identifier takes the lock, to add its entry; a full table is copied into one
+ * twice the size, which is published in its place. Entries and earlier tables are
+ * kept for the life of the process, since readers may still be using them.
+ */
+class ProductInterner
+{
+
+public:
+
+  // Get the index for a product identifier, assigning the next free index on first sight
+  static ProductIndex Intern(string_view productId)
+  {
+    Table &table = GetTable();
+    size_t hash = std::hash<string_view>()(productId);
+    ProductIndex index = Lookup(table, productId, hash);
+    if (index >= 0)
+      return index;
+    lock_guard<mutex> guard(table.lock);
+    index = Lookup(table, productId, hash);
+    return index >= 0 ? index : Insert(table, productId, hash);
+  }
+
+  // Get the index for a product identifier without interning it; -1 if unknown
+  static ProductIndex Find(string_view productId)
+  {
+    return Lookup(GetTable(), productId, std::hash<string_view>()(productId));
+  }
+
+  // Get the product identifier for an index; throws out_of_range if none has it
+  static const string& GetProductId(ProductIndex index)
+  {
+    Table &table = GetTable();
+    if (index < 0 || size_t(index) >= table.count.load(memory_order_acquire))
+      throw out_of_range("no product has index " + to_string(index));
+    const Entry *entry = table.chunks[size_t(index) / CHUNK_SIZE].load(memory_order_acquire)[size_t(index) % CHUNK_SIZE];
+    return entry->productId;
+  }
+
+  // Get the number of interned products
+  static size_t Size()
+  {
+    return GetTable().count.load(memory_order_acquire);
+  }
+
+private:
+  static const size_t CHUNK_SIZE = 1024;
+  static const size_t MAX_CHUNKS = 1024;
+
+  struct Entry
+  {
+    string productId;
+    size_t hash;
+    ProductIndex index;
+  };
+
+  // Open-addressed slots, a power of two of them, at most half full
+  struct Slots
+  {
+    size_t mask;
+    unique_ptr<atomic<const Entry*>[]> entries;
+
+    explicit Slots(size_t size) : mask(size - 1), entries(new atomic<const Entry*>[size])
+    {
+      for (size_t i = 0; i < size; i++)
+        entries[i].store(nullptr, memory_order_relaxed);
+    }
+  };
+
+  struct Table
+  {
+    // Held only to add an identifier
+    mutex lock;
+    atomic<Slots*> slots;
+    atomic<size_t> count;
+    // Entries by index, CHUNK_SIZE to a chunk
+    atomic<const Entry**> chunks[MAX_CHUNKS];
+    // Owners of every entry, chunk and table ever published
+    deque<Entry> entries;
+    vector<unique_ptr<const Entry*[]>> ownedChunks;
+    vector<unique_ptr<Slots>> ownedSlots;
+
+    Table() : count(0)
+    {
+      ownedSlots.emplace_back(new Slots(1024));
+      slots.store(ownedSlots.back().get(), memory_order_relaxed);
+      for (auto &chunk : chunks)
+        chunk.store(nullptr, memory_order_relaxed);
+    }
+  };
+
+  static Table& GetTable()
+  {
+    static Table table;
+    return table;
+  }
+
+  static ProductIndex Lookup(Table &table, string_view productId, size_t hash)
+  {
+    const Slots *slots = table.slots.load(memory_order_acquire);
+    for (size_t i = hash & slots->mask; ; i = (i + 1) & slots->mask)
+    {
+      const Entry *entry = slots->entries[i].load(memory_order_acquire);
+      if (!entry)
+        return -1;
+      if (entry->hash == hash && entry->productId == productId)
+        return entry->index;
+    }
+  }
+
+  static void Place(Slots &slots, const Entry *entry)
+  {
+    size_t i = entry->hash & slots.mask;
+    while (slots.entries[i].load(memory_order_relaxed))
+      i = (i + 1) & slots.mask;
+    slots.entries[i].store(entry, memory_order_release);
+  }
+
+  // Add an identifier; the caller holds the lock and has found it missing
+  static ProductIndex Insert(Table &table, string_view productId, size_t hash)
+  {
+    size_t count = table.count.load(memory_order_relaxed);
+    if (count / CHUNK_SIZE >= MAX_CHUNKS)
+      throw out_of_range("too many products to intern");
+    Slots *slots = table.slots.load(memory_order_relaxed);
+    if ((count + 1) * 2 > slots->mask + 1)
+    {
+      Slots *grown = new Slots((slots->mask + 1) * 2);
+      table.ownedSlots.emplace_back(grown);
+      for (const Entry &entry : table.entries)
+        Place(*grown, &entry);
+      table.slots.store(grown, memory_order_release);
+      slots = grown;
+    }
+    table.entries.push_back(Entry{ string(productId), hash, ProductIndex(count) });
+    const Entry *entry = &table.entries.back();
+    const Entry **chunk = table.chunks[count / CHUNK_SIZE].load(memory_order_relaxed);
+    if (!chunk)
+    {
+      table.ownedChunks.emplace_back(new const Entry*[CHUNK_SIZE]());
+      chunk = table.ownedChunks.back().get();
+      table.chunks[count / CHUNK_SIZE].store(chunk, memory_order_release);
+    }
+    chunk[count % CHUNK_SIZE] = entry;
+    // The count publishes the chunk entry to GetProductId, the slot to lookups
+    table.count.store(count + 1, memory_order_release);
+    Place(*slots, entry);
+    return entry->index;
+  }
+
+};
+
+/**
+ * Table of values indexed by ProductIndex, replacing map<string, V> in the services.
+ * Entries live in fixed-size chunks reached through one array lookup, so indexing
+ * stays O(1) and contiguous within a chunk. Chunks are installed atomically and never
+ * move, so the table can grow while other threads use it and references to entries
+ * stay valid. Indexing default-constructs missing entries, like map::operator[].
+ * String keys are accepted at the API edge and are interned once per call.
+ * Type V is the value type.
+ */
+template<typename V>
+class ProductTable
+{
+
+public:
+
+  ProductTable() : count(0)
+  {
+    for (auto &chunk : chunks)
+      chunk.store(nullptr, memory_order_relaxed);
+  }
+
+  ProductTable(const ProductTable<V> &other) : ProductTable()
+  {
+    *this = other;
+  }
+
+  ~ProductTable()
+  {
+    for (auto &chunk : chunks)
+      delete[] chunk.load(memory_order_relaxed);
+  }
+
+  ProductTable<V>& operator=(const ProductTable<V> &other)
+  {
+    if (this == &other)
+      return *this;
+    for (auto &chunk : chunks)
+      delete[] chunk.exchange(nullptr, memory_order_relaxed);
+    count.store(0, memory_order_relaxed);
+    for (size_t i = 0; i < other.size(); i++)
+      (*this)[ProductIndex(i)] = other.values(ProductIndex(i));
+    return *this;
+  }
+
+  // Get the entry for a product index, creating it if needed; throws out_of_range for
+  // a negative index, such as a default-constructed product's, or one past capacity
+  V& operator[](ProductIndex index)
+  {
+    if (index < 0 || size_t(index) / CHUNK_SIZE >= MAX_CHUNKS)
+      throw out_of_range("product index " + to_string(index) + " outside the table");
+    V *chunk = chunks[size_t(index) / CHUNK_SIZE].load(memory_order_acquire);
+    if (!chunk)
+      chunk = AddChunk(size_t(index) / CHUNK_SIZE);
+    size_t n = count.load(memory_order_relaxed);
+    while (n <= size_t(index) && !count.compare_exchange_weak(n, size_t(index) + 1, memory_order_relaxed));
+    return chunk[size_t(index) % CHUNK_SIZE];
+  }
+
+  // Get the entry for a product identifier, creating it if needed
+  V& operator[](const string &productId)
+  {
+    return (*this)[ProductInterner::Intern(productId)];
+  }
+
+  // Get an existing entry; throws out_of_range if the product has no entry
+  const V& at(ProductIndex index) const
+  {
+    if (index < 0 || size_t(index) >= size())
+      throw out_of_range("no entry for product index " + to_string(index));
+    return values(index);
+  }
+
+  // Get an existing entry by identifier; throws out_of_range if the product has no entry
+  const V& at(const string &productId) const
+  {
+    ProductIndex index = ProductInterner::Find(productId);
+    if (index < 0)
+      throw out_of_range("unknown product " + productId);
+    return at(index);
+  }
+
+  // Get the number of entries (one past the highest index used)
+  size_t size() const
+  {
+    return count.load(memory_order_relaxed);
+  }
+
+private:
+  static const size_t CHUNK_SIZE = 1024;
+  static const size_t MAX_CHUNKS = 1024;
+
+  atomic<V*> chunks[MAX_CHUNKS];
+  atomic<size_t> count;
+
+  // Get an entry below size(); its chunk may not exist yet if it was never written
+  const V& values(ProductIndex index) const
+  {
+    static const V empty = V();
+    V *chunk = chunks[size_t(index) / CHUNK_SIZE].load(memory_order_acquire);
+    return chunk ? chunk[size_t(index) % CHUNK_SIZE] : empty;
+  }
+
+  V* AddChunk(size_t slot)
+  {
+    V *chunk = new V[CHUNK_SIZE]();
+    V *expected = nullptr;
+    if (!chunks[slot].compare_exchange_strong(expected, chunk, memory_order_acq_rel))
+    {
+      // Another thread installed this chunk first
+      delete[] chunk;
+      return expected;
+    }
+    return chunk;
+  }
+
+};
+
+#endif
@@ -0,0 +1,132 @@
+/**
+ * productregistry.hpp
+ * Defines the shared, immutable reference-data registry for products.
+ */
+#ifndef PRODUCT_REGISTRY_HPP
+#define PRODUCT_REGISTRY_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include "products.hpp"
+
+using namespace std;
+
+/**
+ * Registry holding one instance of every product, indexed by ProductIndex.
+ * Reference data is loaded once at startup; connectors then resolve each
+ * message's identifier to a product here, and every message object refers to
+ * that instance instead of carrying its own copy. Products are never changed,
+ * moved or freed once registered, so references handed out stay valid, and
+ * unchanging, for the life of the process.
+ *
+ * Looking up a registered product takes no lock: the identifier is found by the
+ * lock-free ProductInterner and the product read from a table of pointers
+ * published with release stores. Only registering a product takes the lock.
+ * Type T is the product type.
+ */
+template<typename T>
+class ProductRegistry
+{
+
+public:
+
+  // Get the process-wide registry
+  static ProductRegistry<T>& Instance()
+  {
+    static ProductRegistry<T> registry;
+    return registry;
+  }
+
+  // Add reference data for a product. This is for loading reference data before the
+  // feeds start: a product already registered, including a placeholder given out by
+  // Get, is kept as it is and returned, since other threads may hold it.
+  const T& Add(const T &product);
+
+  // Get the product for an identifier. Identifiers without reference data get a
+  // placeholder (ticker "T", zero coupon, no maturity) so feeds keep flowing.
+  const T& Get(string_view productId);
+
+  // Load reference data, one product per line: productId,idType,ticker,coupon(%),maturity(yyyy-mm-dd)
+  // Call this before the feeds start.
+  void Load(ifstream &file);
+
+  // Get the number of registered products
+  size_t Size();
+
+private:
+  ProductRegistry() = default;
+
+  // Held only to register a product
+  mutex lock;
+  ProductTable<atomic<const T*>> products;
+  // Owners of the registered products
+  vector<unique_ptr<T>> owned;
+
+  // Register a product at its index unless one is there; the caller holds the lock
+  const T& Register(ProductIndex index, unique_ptr<T> product);
+
+};
+
+template<typename T>
+const T& ProductRegistry<T>::Register(ProductIndex index, unique_ptr<T> product)
+{
+  atomic<const T*> &slot = products[index];
+  const T *registered = slot.load(memory_order_relaxed);
+  if (registered)
+    return *registered;
+  owned.push_back(move(product));
+  slot.store(owned.back().get(), memory_order_release);
+  return *owned.back();
+}
+
+template<typename T>
+const T& ProductRegistry<T>::Add(const T &product)
+{
+  lock_guard<mutex> guard(lock);
+  return Register(product.GetProductIndex(), unique_ptr<T>(new T(product)));
+}
+
+template<typename T>
+const T& ProductRegistry<T>::Get(string_view productId)
+{
+  ProductIndex index = ProductInterner::Intern(productId);
+  const T *product = products[index].load(memory_order_acquire);
+  if (product)
+    return *product;
+  lock_guard<mutex> guard(lock);
+  return Register(index, unique_ptr<T>(new T(string(productId), CUSIP, "T", 0, date())));
+}
+
+template<typename T>
+void ProductRegistry<T>::Load(ifstream &file)
+{
+  string line;
+  while (getline(file, line))
+  {
+    stringstream linestream(line);
+    string temp;
+    vector<string> component;
+    while (getline(linestream, temp, ','))
+      component.push_back(temp);
+    if (component.size() < 5)
+      continue;
+    BondIdType idType = component[1] == "ISIN" ? ISIN : CUSIP;
+    float coupon = stof(component[3]);
+    date maturity = from_simple_string(component[4]);
+    Add(T(component[0], idType, component[2], coupon, maturity));
+  }
+}
+
+template<typename T>
+size_t ProductRegistry<T>::Size()
+{
+  lock_guard<mutex> guard(lock);
+  return owned.size();
+}
+
+#endif
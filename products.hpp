@@ -11,6 +11,7 @@
 #include <string>
 
 #include "boost/date_time/gregorian/gregorian.hpp"
+#include "productindex.hpp"
 
 using namespace std;
 using namespace boost::gregorian;
@@ -35,9 +36,13 @@ public:
   // Ge the product type
   ProductType GetProductType() const;
 
+  // Get the dense index interned for the product identifier
+  ProductIndex GetProductIndex() const;
+
 private:
   string productId;
   ProductType productType;
+  ProductIndex productIndex = -1;
 
 };
 
@@ -171,6 +176,7 @@ Product::Product(string _productId, ProductType _productType)
 {
   productId = _productId;
   productType = _productType;
+  productIndex = ProductInterner::Intern(_productId);
 }
 
 const string& Product::GetProductId() const
@@ -183,6 +189,11 @@ ProductType Product::GetProductType() const
   return productType;
 }
 
+ProductIndex Product::GetProductIndex() const
+{
+  return productIndex;
+}
+
 Bond::Bond(string _productId, BondIdType _bondIdType, string _ticker, float _coupon, date _maturityDate) : Product(_productId, BOND)
 {
 	productId = _productId;
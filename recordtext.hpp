@@ -0,0 +1,360 @@
+/**
+ * recordtext.hpp
+ * Defines how each binary record type is laid out as text, for reading and writing
+ * the text feeds and historical stores record by record.
+ */
+#ifndef RECORD_TEXT_HPP
+#define RECORD_TEXT_HPP
+
+#include <string_view>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include "binaryrecords.hpp"
+#include "recordwriter.hpp"
+#include "timestamp.hpp"
+#include "pricingservice.hpp"
+
+using namespace std;
+
+// Names of the enum values the records carry, indexed by value
+static const char* SIDES[] = { "BUY", "SELL" };
+static const char* PRICING_SIDES[] = { "BID", "OFFER" };
+static const char* ORDER_TYPES[] = { "FOK", "IOC", "MARKET", "LIMIT", "STOP" };
+static const char* INQUIRY_STATES[] = { "RECEIVED", "QUOTED", "DONE", "REJECTED", "CUSTOMER_REJECTED" };
+static const char* BOOK_ACTIONS[] = { "ADD", "MODIFY", "DELETE" };
+static const char* VENUES[] = { "BROKERTEC", "ESPEED", "CME" };
+
+// Get the index of a name in a table; false if it is not there
+template<size_t N>
+inline bool FindName(const char* (&names)[N], string_view name, uint8_t &index)
+{
+  for (size_t i = 0; i < N; i++)
+    if (name == names[i])
+    {
+      index = uint8_t(i);
+      return true;
+    }
+  return false;
+}
+
+// Get the name of an index in a table, or "?" if it is out of range
+template<size_t N>
+inline const char* NameOf(const char* (&names)[N], uint8_t index)
+{
+  return index < N ? names[index] : "?";
+}
+
+// Parse a decimal such as written by RecordWriter::Fixed
+inline bool ParseDouble(string_view field, double &value)
+{
+  char copy[64];
+  if (field.empty() || field.size() >= sizeof(copy))
+    return false;
+  memcpy(copy, field.data(), field.size());
+  copy[field.size()] = 0;
+  char *end;
+  value = strtod(copy, &end);
+  return end == copy + field.size();
+}
+
+inline bool ParseInteger(string_view field, int64_t &value)
+{
+  from_chars_result result = from_chars(field.data(), field.data() + field.size(), value);
+  return result.ec == errc() && result.ptr == field.data() + field.size();
+}
+
+/**
+ * How each record type is laid out as text. Parse fills a record from the given
+ * line of it (every type but StreamRecord takes one line); Write appends the record
+ * as text, line ends included.
+ */
+template<typename R>
+struct RecordText;
+
+template<>
+struct RecordText<PriceRecord>
+{
+  static const size_t LINES = 1;
+
+  static bool Parse(const string_view *fields, size_t count, size_t, PriceRecord &record)
+  {
+    if (count != 3)
+      return false;
+    SetRecordText(record.productId, fields[0]);
+    record.mid = convert(fields[1]);
+    record.spread = convert(fields[2]);
+    return true;
+  }
+
+  static void Write(const PriceRecord &record, RecordWriter &out)
+  {
+    out.Text(GetRecordText(record.productId)).Char(',').Fractional(record.mid).Char(',')
+      .Fractional(record.spread).Char('\n');
+  }
+};
+
+template<>
+struct RecordText<TradeRecord>
+{
+  static const size_t LINES = 1;
+
+  static bool Parse(const string_view *fields, size_t count, size_t, TradeRecord &record)
+  {
+    if (count != 6 || !ParseInteger(fields[3], record.quantity) || !FindName(SIDES, fields[5], record.side))
+      return false;
+    SetRecordText(record.productId, fields[0]);
+    SetRecordText(record.tradeId, fields[1]);
+    record.price = convert(fields[2]);
+    SetRecordText(record.book, fields[4]);
+    return true;
+  }
+
+  static void Write(const TradeRecord &record, RecordWriter &out)
+  {
+    out.Text(GetRecordText(record.productId)).Char(',').Text(GetRecordText(record.tradeId)).Char(',')
+      .Fractional(record.price).Char(',').Integer(record.quantity).Char(',')
+      .Text(GetRecordText(record.book)).Char(',').Text(NameOf(SIDES, record.side)).Char('\n');
+  }
+};
+
+template<>
+struct RecordText<MarketRecord>
+{
+  static const size_t LINES = 1;
+
+  static bool Parse(const string_view *fields, size_t count, size_t, MarketRecord &record)
+  {
+    if (count != 4 || !ParseInteger(fields[3], record.quantity))
+      return false;
+    SetRecordText(record.productId, fields[0]);
+    record.mid = convert(fields[1]);
+    record.spread = convert(fields[2]);
+    return true;
+  }
+
+  static void Write(const MarketRecord &record, RecordWriter &out)
+  {
+    out.Text(GetRecordText(record.productId)).Char(',').Fractional(record.mid).Char(',')
+      .Fractional(record.spread).Char(',').Integer(record.quantity).Char('\n');
+  }
+};
+
+template<>
+struct RecordText<InquiryRecord>
+{
+  static const size_t LINES = 1;
+
+  static bool Parse(const string_view *fields, size_t count, size_t, InquiryRecord &record)
+  {
+    if (count != 6 || !FindName(SIDES, fields[1], record.side) || !ParseInteger(fields[2], record.quantity)
+      || !FindName(INQUIRY_STATES, fields[5], record.state))
+      return false;
+    SetRecordText(record.productId, fields[0]);
+    record.mid = convert(fields[3]);
+    record.spread = convert(fields[4]);
+    return true;
+  }
+
+  static void Write(const InquiryRecord &record, RecordWriter &out)
+  {
+    out.Text(GetRecordText(record.productId)).Char(',').Text(NameOf(SIDES, record.side)).Char(',')
+      .Integer(record.quantity).Char(',').Fractional(record.mid).Char(',').Fractional(record.spread).Char(',')
+      .Text(NameOf(INQUIRY_STATES, record.state)).Char('\n');
+  }
+};
+
+template<>
+struct RecordText<StreamRecord>
+{
+  // The bid line, then the offer line
+  static const size_t LINES = 2;
+
+  static bool Parse(const string_view *fields, size_t count, size_t line, StreamRecord &record)
+  {
+    const char *side = line == 0 ? "BID" : "OFFER";
+    double price;
+    int64_t visible, hidden;
+    if (count != 6 || fields[5] != side || !ParseDouble(fields[2], price)
+      || !ParseInteger(fields[3], visible) || !ParseInteger(fields[4], hidden))
+      return false;
+    if (line == 0)
+    {
+      if (!timestamp_from_chars(fields[0], record.time))
+        return false;
+      SetRecordText(record.productId, fields[1]);
+      record.bidPrice = price;
+      record.bidVisibleQuantity = visible;
+      record.bidHiddenQuantity = hidden;
+    }
+    else
+    {
+      record.offerPrice = price;
+      record.offerVisibleQuantity = visible;
+      record.offerHiddenQuantity = hidden;
+    }
+    return true;
+  }
+
+  static void Write(const StreamRecord &record, RecordWriter &out)
+  {
+    string_view productId = GetRecordText(record.productId);
+    out.Timestamp(record.time).Char(',').Text(productId).Char(',').Fixed(record.bidPrice).Char(',')
+      .Integer(record.bidVisibleQuantity).Char(',').Integer(record.bidHiddenQuantity).Text(",BID\n");
+    out.Timestamp(record.time).Char(',').Text(productId).Char(',').Fixed(record.offerPrice).Char(',')
+      .Integer(record.offerVisibleQuantity).Char(',').Integer(record.offerHiddenQuantity).Text(",OFFER\n");
+  }
+};
+
+template<>
+struct RecordText<PositionRecord>
+{
+  static const size_t LINES = 1;
+
+  static bool Parse(const string_view *fields, size_t count, size_t, PositionRecord &record)
+  {
+    if (count != 6 || !timestamp_from_chars(fields[0], record.time))
+      return false;
+    SetRecordText(record.productId, fields[1]);
+    for (size_t i = 0; i < 3; i++)
+      if (!ParseInteger(fields[2 + i], record.positions[i]))
+        return false;
+    return ParseInteger(fields[5], record.aggregate);
+  }
+
+  static void Write(const PositionRecord &record, RecordWriter &out)
+  {
+    out.Timestamp(record.time).Char(',').Text(GetRecordText(record.productId));
+    for (size_t i = 0; i < 3; i++)
+      out.Char(',').Integer(record.positions[i]);
+    out.Char(',').Integer(record.aggregate).Char('\n');
+  }
+};
+
+template<>
+struct RecordText<RiskRecord>
+{
+  static const size_t LINES = 1;
+
+  static bool Parse(const string_view *fields, size_t count, size_t, RiskRecord &record)
+  {
+    if (count != 4 || !timestamp_from_chars(fields[0], record.time) || !ParseDouble(fields[2], record.pv01)
+      || !ParseInteger(fields[3], record.quantity))
+      return false;
+    SetRecordText(record.name, fields[1]);
+    return true;
+  }
+
+  static void Write(const RiskRecord &record, RecordWriter &out)
+  {
+    out.Timestamp(record.time).Char(',').Text(GetRecordText(record.name)).Char(',').Fixed(record.pv01).Char(',')
+      .Integer(record.quantity).Char('\n');
+  }
+};
+
+template<>
+struct RecordText<ExecutionRecord>
+{
+  static const size_t LINES = 1;
+
+  static bool Parse(const string_view *fields, size_t count, size_t, ExecutionRecord &record)
+  {
+    if (count != 10 || !timestamp_from_chars(fields[0], record.time) || !FindName(PRICING_SIDES, fields[2], record.side)
+      || !FindName(ORDER_TYPES, fields[4], record.orderType) || !ParseDouble(fields[5], record.price)
+      || !ParseDouble(fields[6], record.visibleQuantity) || !ParseDouble(fields[7], record.hiddenQuantity)
+      || (fields[9] != "TRUE" && fields[9] != "FALSE"))
+      return false;
+    SetRecordText(record.productId, fields[1]);
+    SetRecordText(record.orderId, fields[3]);
+    SetRecordText(record.parentOrderId, fields[8]);
+    record.isChildOrder = fields[9] == "TRUE";
+    return true;
+  }
+
+  static void Write(const ExecutionRecord &record, RecordWriter &out)
+  {
+    out.Timestamp(record.time).Char(',').Text(GetRecordText(record.productId)).Char(',')
+      .Text(NameOf(PRICING_SIDES, record.side)).Char(',').Text(GetRecordText(record.orderId)).Char(',')
+      .Text(NameOf(ORDER_TYPES, record.orderType)).Char(',').Fixed(record.price).Char(',')
+      .Fixed(record.visibleQuantity).Char(',').Fixed(record.hiddenQuantity).Char(',')
+      .Text(GetRecordText(record.parentOrderId)).Text(record.isChildOrder ? ",TRUE\n" : ",FALSE\n");
+  }
+};
+
+template<>
+struct RecordText<InquiryHistoryRecord>
+{
+  static const size_t LINES = 1;
+
+  static bool Parse(const string_view *fields, size_t count, size_t, InquiryHistoryRecord &record)
+  {
+    if (count != 7 || !timestamp_from_chars(fields[0], record.time) || !FindName(SIDES, fields[3], record.side)
+      || !ParseInteger(fields[4], record.quantity) || !ParseDouble(fields[5], record.price)
+      || !FindName(INQUIRY_STATES, fields[6], record.state))
+      return false;
+    SetRecordText(record.inquiryId, fields[1]);
+    SetRecordText(record.productId, fields[2]);
+    return true;
+  }
+
+  static void Write(const InquiryHistoryRecord &record, RecordWriter &out)
+  {
+    out.Timestamp(record.time).Char(',').Text(GetRecordText(record.inquiryId)).Char(',')
+      .Text(GetRecordText(record.productId)).Char(',').Text(NameOf(SIDES, record.side)).Char(',')
+      .Integer(record.quantity).Char(',').Fixed(record.price).Char(',')
+      .Text(NameOf(INQUIRY_STATES, record.state)).Char('\n');
+  }
+};
+
+template<>
+struct RecordText<GuiRecord>
+{
+  static const size_t LINES = 1;
+
+  static bool Parse(const string_view *fields, size_t count, size_t, GuiRecord &record)
+  {
+    if (count != 4 || !timestamp_from_chars(fields[0], record.time))
+      return false;
+    SetRecordText(record.productId, fields[1]);
+    record.mid = convert(fields[2]);
+    record.spread = convert(fields[3]);
+    return true;
+  }
+
+  static void Write(const GuiRecord &record, RecordWriter &out)
+  {
+    out.Timestamp(record.time).Char(',').Text(GetRecordText(record.productId)).Char(',')
+      .Fractional(record.mid).Char(',').Fractional(record.spread).Char('\n');
+  }
+};
+
+// productId,action,side,price,quantity
+template<>
+struct RecordText<BookUpdateRecord>
+{
+  static const size_t LINES = 1;
+
+  static bool Parse(const string_view *fields, size_t count, size_t, BookUpdateRecord &record)
+  {
+    record.venue = 0;
+    if (count < 5 || count > 6 || !FindName(BOOK_ACTIONS, fields[1], record.action) || !FindName(PRICING_SIDES, fields[2], record.side)
+      || !ParseInteger(fields[4], record.quantity) || (count == 6 && !FindName(VENUES, fields[5], record.venue)))
+      return false;
+    SetRecordText(record.productId, fields[0]);
+    record.price = convert(fields[3]);
+    return true;
+  }
+
+  static void Write(const BookUpdateRecord &record, RecordWriter &out)
+  {
+    out.Text(GetRecordText(record.productId)).Char(',').Text(NameOf(BOOK_ACTIONS, record.action)).Char(',')
+      .Text(NameOf(PRICING_SIDES, record.side)).Char(',').Fractional(record.price).Char(',')
+      .Integer(record.quantity);
+    // BROKERTEC is the venue of a line that names none
+    if (record.venue != 0)
+      out.Char(',').Text(NameOf(VENUES, record.venue));
+    out.Char('\n');
+  }
+};
+
+#endif
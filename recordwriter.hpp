@@ -0,0 +1,172 @@
+/**
+ * recordwriter.hpp
+ * Defines allocation-free formatting of output records into a caller's buffer.
+ */
+#ifndef RECORD_WRITER_HPP
+#define RECORD_WRITER_HPP
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include "timestamp.hpp"
+
+using namespace std;
+
+/**
+ * The fractional part of a price in 256ths, 0-255, as the three characters written
+ * after the '-': two digits of 32nds and one of 256ths, with 4 written as '+'.
+ */
+struct FractionTable
+{
+  char text[256][3];
+};
+
+constexpr FractionTable MakeFractionTable()
+{
+  FractionTable table{};
+  for (int ticks = 0; ticks < 256; ticks++)
+  {
+    int thirtyseconds = ticks / 8;
+    int eighth = ticks % 8;
+    table.text[ticks][0] = char('0' + thirtyseconds / 10);
+    table.text[ticks][1] = char('0' + thirtyseconds % 10);
+    table.text[ticks][2] = eighth == 4 ? '+' : char('0' + eighth);
+  }
+  return table;
+}
+
+/**
+ * Writes one record at a time into a fixed buffer with to_chars and lookup tables,
+ * so formatting never touches the heap. Every field is written exactly as the
+ * to_string-based formatting it replaces: integers in decimal, doubles with six
+ * decimals as to_string(double) does, prices in 32nds/256ths as Price_to_string does.
+ * A record that does not fit is cut short and Overflowed() reports it.
+ */
+class RecordWriter
+{
+
+public:
+
+  // ctor for a writer filling the given buffer
+  RecordWriter(char *_buffer, size_t size) :
+    buffer(_buffer), next(_buffer), end(_buffer + size), overflowed(false)
+  {
+  }
+
+  // Append text
+  RecordWriter& Text(string_view text)
+  {
+    if (Reserve(text.size()))
+    {
+      memcpy(next, text.data(), text.size());
+      next += text.size();
+    }
+    return *this;
+  }
+
+  // Append a character
+  RecordWriter& Char(char c)
+  {
+    if (Reserve(1))
+      *next++ = c;
+    return *this;
+  }
+
+  // Append an integer
+  RecordWriter& Integer(long long value)
+  {
+    to_chars_result result = to_chars(next, end, value);
+    if (result.ec == errc())
+      next = result.ptr;
+    else
+      overflowed = true;
+    return *this;
+  }
+
+  // Append a double with six decimals, as to_string(double)
+  RecordWriter& Fixed(double value)
+  {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    to_chars_result result = to_chars(next, end, value, chars_format::fixed, 6);
+    if (result.ec == errc())
+      next = result.ptr;
+    else
+      overflowed = true;
+#else
+    int length = snprintf(next, size_t(end - next), "%f", value);
+    if (length >= 0 && length < end - next)
+      next += length;
+    else
+      overflowed = true;
+#endif
+    return *this;
+  }
+
+  // Append a price in fractional notation (99-16+), truncated to 256ths
+  RecordWriter& Fractional(double price)
+  {
+    int x1 = int(price);
+    int x2 = int((price - x1) * 32);
+    int x3 = int((price - x1 - (double(x2) / 32.0)) * 256);
+    Integer(x1).Char('-');
+    if (x2 >= 0 && x2 < 32 && x3 >= 0 && x3 < 8)
+      return Text(string_view(FRACTIONS.text[x2 * 8 + x3], 3));
+    // Out of range only for negative or malformed prices; keep the old layout
+    if (x2 < 10)
+      Char('0');
+    Integer(x2);
+    return x3 == 4 ? Char('+') : Integer(x3);
+  }
+
+  // Append the current local time, as timestamp()
+  RecordWriter& Timestamp()
+  {
+    if (Reserve(TIMESTAMP_LENGTH))
+      next += timestamp_to_chars(next);
+    return *this;
+  }
+
+  // Append a time in milliseconds since the epoch, as timestamp() writes it
+  RecordWriter& Timestamp(int64_t millis)
+  {
+    if (Reserve(TIMESTAMP_LENGTH))
+      next += timestamp_to_chars(next, millis);
+    return *this;
+  }
+
+  // Get the record written so far
+  const char* Data() const { return buffer; }
+  size_t Size() const { return size_t(next - buffer); }
+  string_view View() const { return string_view(buffer, Size()); }
+
+  // Get whether anything was cut short for lack of room
+  bool Overflowed() const { return overflowed; }
+
+  // Start a new record in the same buffer
+  void Clear()
+  {
+    next = buffer;
+    overflowed = false;
+  }
+
+private:
+  static constexpr FractionTable FRACTIONS = MakeFractionTable();
+
+  char *buffer;
+  char *next;
+  char *end;
+  bool overflowed;
+
+  bool Reserve(size_t length)
+  {
+    if (size_t(end - next) >= length)
+      return true;
+    overflowed = true;
+    return false;
+  }
+
+};
+
+#endif
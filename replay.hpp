@@ -0,0 +1,351 @@
+/**
+ * replay.hpp
+ * Defines replay of recorded historical stores back into the services, paced by
+ * the times they were recorded at.
+ */
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include "feedsource.hpp"
+#include "binaryrecords.hpp"
+#include "recordtext.hpp"
+#include "latency.hpp"
+#include "pricingservice.hpp"
+#include "streamingservice.hpp"
+#include "executionservice.hpp"
+#include "inquiryservice.hpp"
+#include "tradebookingservice.hpp"
+
+using namespace std;
+
+/**
+ * Paces a replay on the steady clock. At speed 1 an event recorded t ms after the
+ * first one is due t ms after the replay started, at speed N after t/N ms, and at
+ * speed 0 at once. The schedule is absolute, so a replay that falls behind catches
+ * up in a burst, as the recorded system did.
+ *
+ * A wait sleeps until a margin before the event is due and spins on the clock for
+ * the rest. Sleeping alone wakes late by the scheduler's granularity, from tens of
+ * microseconds to a timer tick; spinning alone holds a core through every gap. The
+ * margin is the spin set plus the worst recent oversleep, so it widens by itself on
+ * a coarse timer.
+ */
+class ReplayClock
+{
+
+public:
+
+  // ctor for a clock at the given speed
+  explicit ReplayClock(double _speed = 1) :
+    speed(_speed), spin(chrono::microseconds(100)), oversleep(0), first(0)
+  {
+  }
+
+  // Set the speed; 0 replays as fast as the services take the events
+  void SetSpeed(double _speed) { speed = _speed; }
+
+  // Set how long before an event is due a wait stops sleeping and spins
+  void SetSpin(chrono::nanoseconds _spin) { spin = _spin; }
+
+  // Start the schedule now, with the recorded time of the first event
+  void Start(int64_t recorded)
+  {
+    first = recorded;
+    start = chrono::steady_clock::now();
+  }
+
+  // Wait until the event recorded at the given time is due; returns how late it is
+  // by then, which is zero at speed 0
+  chrono::nanoseconds WaitUntil(int64_t recorded)
+  {
+    return WaitUntilElapsed(chrono::milliseconds(recorded - first));
+  }
+
+  // Wait until an event recorded the given time after the first is due, for events
+  // timed finer than a millisecond
+  chrono::nanoseconds WaitUntilElapsed(chrono::nanoseconds elapsed)
+  {
+    if (speed <= 0)
+      return chrono::nanoseconds(0);
+    auto due = start + chrono::duration_cast<chrono::steady_clock::duration>(
+      chrono::duration<double, nano>(double(elapsed.count()) / speed));
+    auto now = chrono::steady_clock::now();
+    auto wake = due - spin - oversleep;
+    if (now < wake)
+    {
+      this_thread::sleep_until(wake);
+      now = chrono::steady_clock::now();
+      // Remember how late sleeps wake, letting an old excess fade
+      chrono::nanoseconds late = now > wake ? chrono::duration_cast<chrono::nanoseconds>(now - wake) : chrono::nanoseconds(0);
+      oversleep = max(late, oversleep * 7 / 8);
+    }
+    while (now < due)
+      now = chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::nanoseconds>(now - due);
+  }
+
+private:
+  double speed;
+  chrono::nanoseconds spin;
+  chrono::nanoseconds oversleep;
+  int64_t first;
+  chrono::steady_clock::time_point start;
+
+};
+
+/**
+ * One recorded store being replayed: a cursor over its events in recorded order.
+ */
+class ReplayChannel
+{
+
+public:
+
+  virtual ~ReplayChannel() {}
+
+  // Read the next event; false at the end of the store
+  virtual bool Next() = 0;
+
+  // Hand the event last read to its service
+  virtual void Deliver() = 0;
+
+  // Get the recorded time of the event last read, in milliseconds since the epoch
+  int64_t GetTime() const { return time; }
+
+protected:
+  int64_t time = 0;
+
+};
+
+/**
+ * Replays a store of R records, text or binary. Records that accept() turns down
+ * are skipped without waiting for them; the rest go to deliver() when due, each
+ * traced from a latency point named after the store.
+ */
+template<typename R>
+class RecordReplayChannel : public ReplayChannel
+{
+
+public:
+
+  // ctor for a channel over a store
+  RecordReplayChannel(FeedSource &_source, const string &name, function<bool(const R&)> _accept,
+    function<void(const R&)> _deliver) :
+    source(_source), binary(_source), feed(name + " replay"), accept(_accept), deliver(_deliver)
+  {
+  }
+
+  virtual bool Next()
+  {
+    while (binary ? binary.Next(record) : NextText())
+      if (accept(record))
+      {
+        time = record.time;
+        return true;
+      }
+    return false;
+  }
+
+  virtual void Deliver()
+  {
+    LatencyTrace::Begin(feed);
+    deliver(record);
+  }
+
+private:
+  FeedSource &source;
+  RecordReader<R> binary;
+  LatencyPoint feed;
+  function<bool(const R&)> accept;
+  function<void(const R&)> deliver;
+  R record;
+
+  // Read the lines of the next record; lines that do not parse spoil their record
+  // and are skipped
+  bool NextText()
+  {
+    string_view line;
+    string_view fields[12];
+    size_t part = 0;
+    record = R{};
+    while (source.NextLine(line))
+    {
+      if (line.empty())
+        continue;
+      size_t count = SplitFields(line, ',', fields, 12);
+      if (!RecordText<R>::Parse(fields, count, part, record))
+      {
+        part = 0;
+        record = R{};
+        continue;
+      }
+      if (++part == RecordText<R>::LINES)
+        return true;
+    }
+    return false;
+  }
+
+};
+
+/**
+ * Replays several stores together, merged into recorded time order, on the calling
+ * thread. Events recorded in the same millisecond go out back to back, in the order
+ * the channels were added.
+ */
+class ReplayEngine
+{
+
+public:
+
+  // ctor for an engine at the given speed; 0 replays as fast as possible
+  explicit ReplayEngine(double speed = 1) : clock(speed), events(0) {}
+
+  // Set the speed
+  void SetSpeed(double speed) { clock.SetSpeed(speed); }
+
+  // Set how long before each event the clock stops sleeping and spins
+  void SetSpin(chrono::nanoseconds spin) { clock.SetSpin(spin); }
+
+  // Add a store to replay
+  void Add(unique_ptr<ReplayChannel> channel) { channels.push_back(move(channel)); }
+
+  // Replay every store to its end
+  void Run()
+  {
+    vector<ReplayChannel*> live;
+    for (auto &channel : channels)
+      if (channel->Next())
+        live.push_back(channel.get());
+    if (live.empty())
+      return;
+    int64_t first = live[0]->GetTime();
+    for (ReplayChannel *channel : live)
+      first = min(first, channel->GetTime());
+    clock.Start(first);
+    while (!live.empty())
+    {
+      size_t next = 0;
+      for (size_t i = 1; i < live.size(); i++)
+        if (live[i]->GetTime() < live[next]->GetTime())
+          next = i;
+      ReplayChannel *channel = live[next];
+      lateness.Record(uint64_t(clock.WaitUntil(channel->GetTime()).count()));
+      channel->Deliver();
+      events++;
+      if (!channel->Next())
+        live.erase(live.begin() + ptrdiff_t(next));
+    }
+  }
+
+  // Get the number of events replayed
+  uint64_t GetEvents() const { return events; }
+
+  // Get how late events were delivered against the schedule, in nanoseconds
+  const LatencyHistogram& GetLateness() const { return lateness; }
+
+private:
+  ReplayClock clock;
+  vector<unique_ptr<ReplayChannel>> channels;
+  uint64_t events;
+  LatencyHistogram lateness;
+
+};
+
+// Replay gui.txt as prices into the pricing service
+template<typename T>
+unique_ptr<ReplayChannel> MakeGuiReplay(FeedSource &source, PricingService<T> &service)
+{
+  return unique_ptr<ReplayChannel>(new RecordReplayChannel<GuiRecord>(source, "gui",
+    [](const GuiRecord&) { return true; },
+    [&service](const GuiRecord &record) {
+      const T &product = ProductRegistry<T>::Instance().Get(GetRecordText(record.productId));
+      Price<T> price(product, FixedPrice::FromDouble(record.mid), FixedPrice::FromDouble(record.spread));
+      service.OnMessage(price);
+    }));
+}
+
+// Replay streaming.txt or .bin as streams published by the streaming service
+template<typename T>
+unique_ptr<ReplayChannel> MakeStreamingReplay(FeedSource &source, StreamingService<T> &service)
+{
+  return unique_ptr<ReplayChannel>(new RecordReplayChannel<StreamRecord>(source, "streaming",
+    [](const StreamRecord&) { return true; },
+    [&service](const StreamRecord &record) {
+      const T &product = ProductRegistry<T>::Instance().Get(GetRecordText(record.productId));
+      PriceStreamOrder bid(FixedPrice::FromDouble(record.bidPrice), long(record.bidVisibleQuantity), long(record.bidHiddenQuantity), BID);
+      PriceStreamOrder offer(FixedPrice::FromDouble(record.offerPrice), long(record.offerVisibleQuantity), long(record.offerHiddenQuantity), OFFER);
+      PriceStream<T> stream(product, bid, offer);
+      service.PublishPrice(stream);
+    }));
+}
+
+// Replay Execution.txt or .bin as orders executed by the execution service; the
+// market is not recorded, so every order goes to BROKERTEC
+template<typename T>
+unique_ptr<ReplayChannel> MakeExecutionReplay(FeedSource &source, ExecutionService<T> &service)
+{
+  return unique_ptr<ReplayChannel>(new RecordReplayChannel<ExecutionRecord>(source, "execution",
+    [](const ExecutionRecord&) { return true; },
+    [&service](const ExecutionRecord &record) {
+      const T &product = ProductRegistry<T>::Instance().Get(GetRecordText(record.productId));
+      ExecutionOrder<T> order(product, PricingSide(record.side), string(GetRecordText(record.orderId)),
+        OrderType(record.orderType), FixedPrice::FromDouble(record.price), record.visibleQuantity, record.hiddenQuantity,
+        string(GetRecordText(record.parentOrderId)), record.isChildOrder != 0);
+      service.ExecuteOrder(order, BROKERTEC);
+    }));
+}
+
+// Replay allinquiries.txt or .bin into the inquiry service. Only the RECEIVED
+// records are sent: the service quotes and completes each inquiry itself, as it
+// did when the store was recorded.
+template<typename T>
+unique_ptr<ReplayChannel> MakeInquiryReplay(FeedSource &source, InquiryService<T> &service)
+{
+  return unique_ptr<ReplayChannel>(new RecordReplayChannel<InquiryHistoryRecord>(source, "inquiry",
+    [](const InquiryHistoryRecord &record) { return record.state == RECEIVED; },
+    [&service](const InquiryHistoryRecord &record) {
+      const T &product = ProductRegistry<T>::Instance().Get(GetRecordText(record.productId));
+      Inquiry<T> inquiry(string(GetRecordText(record.inquiryId)), product, Side(record.side), long(record.quantity),
+        FixedPrice::FromDouble(record.price), InquiryState(record.state));
+      service.OnMessage(inquiry);
+    }));
+}
+
+// Replay position.txt or .bin as the trades that moved each position, booked by the
+// trade booking service. A trade's price is not recorded, so replayed trades carry
+// none; positions and risk do not depend on it. Positions include the trades of
+// executions, so replay either this store or Execution.txt into one system.
+template<typename T>
+unique_ptr<ReplayChannel> MakePositionReplay(FeedSource &source, TradeBookingService<T> &service)
+{
+  static const char *books[] = { "TRSY1", "TRSY2", "TRSY3" };
+  auto last = make_shared<map<string, PositionRecord>>();
+  auto trades = make_shared<uint64_t>(0);
+  return unique_ptr<ReplayChannel>(new RecordReplayChannel<PositionRecord>(source, "position",
+    [](const PositionRecord&) { return true; },
+    [&service, last, trades](const PositionRecord &record) {
+      string productId(GetRecordText(record.productId));
+      PositionRecord &before = (*last)[productId];
+      const T &product = ProductRegistry<T>::Instance().Get(productId);
+      for (int book = 0; book < 3; book++)
+      {
+        int64_t quantity = record.positions[book] - before.positions[book];
+        if (quantity == 0)
+          continue;
+        Trade<T> trade(product, "R" + to_string(++*trades), FixedPrice(), books[book], long(quantity > 0 ? quantity : -quantity),
+          quantity > 0 ? BUY : SELL);
+        service.BookTrade(trade);
+      }
+      before = record;
+    }));
+}
+
+#endif
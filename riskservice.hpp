@@ -7,6 +7,8 @@
 #ifndef RISK_SERVICE_HPP
 #define RISK_SERVICE_HPP
 
+#include <mutex>
+#include <algorithm>
 #include "soa.hpp"
 #include "positionservice.hpp"
 
@@ -29,7 +31,7 @@ public:
 
   // Get the product on this PV01 value
   const T& GetProduct() const {
-	  return product;
+	  return *product;
   }
 
   // Get the PV01 value
@@ -43,7 +45,7 @@ public:
   }
 
 private:
-  T product;
+  const T *product = nullptr;
   double pv01;
   long quantity;
 
@@ -79,6 +81,9 @@ private:
 /**
  * Risk Service to vend out risk for a particular security and across a risk bucketed sector.
  * Keyed on product identifier.
+ * Safe under concurrent producers: every product belongs to exactly one sector and is
+ * guarded by that sector's lock, which also covers re-aggregating the sector, so risk
+ * for different sectors is computed in parallel.
  * Type T is the product type.
  */
 template<typename T>
@@ -89,27 +94,57 @@ template<typename T>
 class RiskService : public Service<string,PV01 <T> >
 {
 private:
-	map<string, PV01<T>> risk;
+	ProductTable<PV01<T>> risk;
 	vector<ServiceListener<PV01<T>>*> listeners;
 	RiskToPositionListener<T>* listener;
 	vector<ServiceListener<PV01<BucketedSector<T>>>*> listenersbucket;
+	BucketedSector<T> frontend;
+	BucketedSector<T> belly;
+	BucketedSector<T> longend;
+	ProductTable<const BucketedSector<T>*> sectors;
+	mutex frontendlock;
+	mutex bellylock;
+	mutex longendlock;
+
+	// Get the sector a product is risked with; anything outside the front end and the belly goes with the long end
+	const BucketedSector<T>* SectorOf(ProductIndex index)
+	{
+		const BucketedSector<T>* sector = sectors[index];
+		return sector ? sector : &longend;
+	}
+
+	// Get the lock guarding a sector and its products
+	mutex& SectorLock(const BucketedSector<T>* sector)
+	{
+		if (sector == &frontend)
+			return frontendlock;
+		if (sector == &belly)
+			return bellylock;
+		return longendlock;
+	}
 	
 public:
-	map<string, double> pv01;
+	ProductTable<double> pv01;
 	
 	RiskService() {
-		risk = map<string, PV01<T>>();
+		risk = ProductTable<PV01<T>>();
 		listeners = vector<ServiceListener<PV01<T>>*>();
 		listener = new RiskToPositionListener<T>(this);
 		listenersbucket = vector<ServiceListener<PV01<BucketedSector<T>>>*>();
-		pv01 = map<string, double>();
-		date d(2018, Nov, 25);
-		T bond1("2Y", CUSIP, "T", 0, d);
-		T bond2("3Y", CUSIP, "T", 0, d);
-		T bond3("5Y", CUSIP, "T", 0, d);
-		T bond4("7Y", CUSIP, "T", 0, d);
-		T bond5("10Y", CUSIP, "T", 0, d);
-		T bond6("30Y", CUSIP, "T", 0, d);
+		pv01 = ProductTable<double>();
+		ProductRegistry<T>& registry = ProductRegistry<T>::Instance();
+		const T& bond1 = registry.Get("2Y");
+		const T& bond2 = registry.Get("3Y");
+		const T& bond3 = registry.Get("5Y");
+		const T& bond4 = registry.Get("7Y");
+		const T& bond5 = registry.Get("10Y");
+		const T& bond6 = registry.Get("30Y");
+		frontend = BucketedSector<T>({ bond1, bond2 }, "FrontEnd");
+		belly = BucketedSector<T>({ bond3, bond4, bond5 }, "Belly");
+		longend = BucketedSector<T>({ bond6 }, "LongEnd");
+		for (const BucketedSector<T>* sector : { &frontend, &belly, &longend })
+			for (const T& bond : sector->GetProducts())
+				sectors[bond.GetProductIndex()] = sector;
 		
 		string s = "2Y";		pv01[s] = 0.019851; risk[s] = PV01<T>(bond1, 0.019851, 0);
 		s = "3Y"; pv01[s] = 0.029309; risk[s] = PV01<T>(bond2, 0.029309, 0);
@@ -121,7 +156,9 @@ public:
 	~RiskService() { delete listener; }
 	// Get data on our service given a key
 	PV01<T>& GetData(string key) {
-		return risk[key];
+		ProductIndex index = ProductInterner::Intern(key);
+		lock_guard<mutex> guard(SectorLock(SectorOf(index)));
+		return risk[index];
 	}
 
 	// The callback that a Connector should invoke for any new or updated data
@@ -142,9 +179,12 @@ public:
 	}
   // Add a position that the service will risk
 	void AddPosition(Position<T> &position) {
-		T bond = position.GetProduct();
-		PV01<T> temp(bond, pv01[bond.GetProductId()], position.GetAggregatePosition());
-		risk[bond.GetProductId()] = temp;
+		static const LatencyPoint hop("risk");
+		LatencyHop trace(hop);
+		const T& bond = position.GetProduct();
+		lock_guard<mutex> guard(SectorLock(SectorOf(bond.GetProductIndex())));
+		PV01<T> temp(bond, pv01[bond.GetProductIndex()], position.GetAggregatePosition());
+		risk[bond.GetProductIndex()] = temp;
 		for (auto& l : listeners)
 			l->ProcessAdd(temp);
   }
@@ -161,11 +201,9 @@ public:
 	  double ret=0;
 	  string s = sector.GetName();
 	  long q = 0;
-	  vector<T> products = sector.GetProducts();
-	  for (const T& bond : products)
+	  for (const T& bond : sector.GetProducts())
 	  {
-		  string a = bond.GetProductId();
-		  PV01<T> tempp = risk.at(a);
+		  const PV01<T>& tempp = risk.at(bond.GetProductIndex());
 		  ret += tempp.GetPV01() *(tempp.GetQuantity());
 		  q += tempp.GetQuantity();
 	  }
@@ -174,50 +212,54 @@ public:
   }
   void AddPositionBucket(Position<T> &position)
   {
-	  date d(2018, Nov, 25);
-	  T bond = position.GetProduct();
-	  T bond1("2Y", CUSIP, "T", 0, d);
-	  T bond2("3Y", CUSIP, "T", 0, d);
-	  T bond3("5Y", CUSIP, "T", 0, d);
-	  T bond4("7Y", CUSIP, "T", 0, d);
-	  T bond5("10Y", CUSIP, "T", 0, d);
-	  T bond6("30Y", CUSIP, "T", 0, d);
-	  vector<T> bucket;
-	  
-	  if (position.GetProduct().GetProductId() == "2Y" || position.GetProduct().GetProductId() == "3Y")
-	  {
-		  bucket.push_back(bond1);
-		  bucket.push_back(bond2);
-		  BucketedSector<T> b(bucket, "FrontEnd");
-		  GetBucketedRisk(b);
-		  PV01< BucketedSector<T> > pv = GetBucketedRisk(b);
-		 for (auto& l : listenersbucket)
-			 l->ProcessAdd(pv);
-	  }
-	  else if (position.GetProduct().GetProductId() == "5Y" || position.GetProduct().GetProductId() == "7Y" || position.GetProduct().GetProductId() == "10Y")
+	  const BucketedSector<T>* sector = SectorOf(position.GetProduct().GetProductIndex());
+	  lock_guard<mutex> guard(SectorLock(sector));
+	  PV01< BucketedSector<T> > pv = GetBucketedRisk(*sector);
+	  for (auto& l : listenersbucket)
+		  l->ProcessAdd(pv);
+  }
+
+  // Add a block of positions: for each touched sector, risk its positions from the
+  // block, then re-aggregate the sector once, all under that sector's lock
+  void AddPositionBatch(Position<T> *positions, size_t count)
+  {
+	  static const LatencyPoint hop("risk");
+	  LatencyHop trace(hop);
+	  static thread_local vector<const BucketedSector<T>*> touched;
+	  static thread_local vector<PV01<T>> updated;
+	  touched.clear();
+	  for (size_t i = 0; i < count; i++)
 	  {
-		  bucket.push_back(bond3);
-		  bucket.push_back(bond4);
-		  bucket.push_back(bond5);
-		  BucketedSector<T> b(bucket, "Belly");
-		  PV01< BucketedSector<T> > pv = GetBucketedRisk(b);
-		  for (auto& l : listenersbucket)
-			  l->ProcessAdd(pv);
+		  const BucketedSector<T>* sector = SectorOf(positions[i].GetProduct().GetProductIndex());
+		  if (find(touched.begin(), touched.end(), sector) == touched.end())
+			  touched.push_back(sector);
 	  }
-	  else
+	  for (const BucketedSector<T>* sector : touched)
 	  {
-		  bucket.push_back(bond6);
-		  BucketedSector<T> b(bucket, "LongEnd");
-		  PV01< BucketedSector<T> > pv = GetBucketedRisk(b);
+		  lock_guard<mutex> guard(SectorLock(sector));
+		  updated.clear();
+		  for (size_t i = 0; i < count; i++)
+		  {
+			  const T& bond = positions[i].GetProduct();
+			  ProductIndex index = bond.GetProductIndex();
+			  if (SectorOf(index) != sector)
+				  continue;
+			  risk[index] = PV01<T>(bond, pv01[index], positions[i].GetAggregatePosition());
+			  updated.push_back(risk[index]);
+		  }
+		  for (auto& l : listeners)
+			  l->ProcessAddBatch(updated.data(), updated.size());
+
+		  PV01<BucketedSector<T>> pv = GetBucketedRisk(*sector);
 		  for (auto& l : listenersbucket)
-			  l->ProcessAdd(pv);
+			  l->ProcessAddBatch(&pv, 1);
 	  }
-	  
   }
 
 
 
 
+
 };
 
 
@@ -240,6 +282,12 @@ public:
 		service->AddPositionBucket(data);
 	}
 
+	// Listener callback to process a block of add events to the Service
+	void ProcessAddBatch(Position<T> *data, size_t count)
+	{
+		service->AddPositionBatch(data, count);
+	}
+
 	// Listener callback to process a remove event to the Service
 	virtual void ProcessRemove(Position<T> &data) {}
 
@@ -271,7 +319,7 @@ public:
 
 template<typename T>
 PV01<T>::PV01(const T &_product, double _pv01, long _quantity) :
-  product(_product)
+  product(&_product)
 {
   pv01 = _pv01;
   quantity = _quantity;
@@ -0,0 +1,430 @@
+/**
+ * scheduler.hpp
+ * Defines a per-product sharded scheduler with work stealing, and a
+ * ServiceListener adapter that runs a listener's callbacks on it.
+ */
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include "soa.hpp"
+#include "productindex.hpp"
+#include "objectpool.hpp"
+#include "asynclistener.hpp"
+#include "alloccounter.hpp"
+#include "latency.hpp"
+
+using namespace std;
+
+/**
+ * A unit of work queued on a ProductScheduler.
+ * Tasks are linked intrusively into their product's queue, so submitting one does
+ * not allocate; Run() owns the task afterwards and typically returns it to a pool.
+ */
+class SchedulerTask
+{
+
+public:
+
+  virtual ~SchedulerTask() {}
+
+  // Do the work
+  virtual void Run() = 0;
+
+private:
+  SchedulerTask *next = nullptr;
+
+  friend class ProductScheduler;
+
+};
+
+/**
+ * Runs tasks keyed by product on a fixed set of worker threads.
+ * Tasks for one product run strictly in submission order and never concurrently:
+ * a product with pending work is queued on exactly one worker at a time, on the
+ * shard given by its index. A worker with nothing to do steals whole products
+ * from the back of another worker's queue, so a busy shard does not hold up
+ * idle cores, and a product's queue is drained in bounded slices so one hot
+ * product cannot starve the others on its shard.
+ *
+ * Queues for every product interned when the scheduler is built are made up front,
+ * with room in each worker's ring for all of them, so submitting work for them never
+ * allocates. A product first seen later gets its queue on its first task.
+ */
+class ProductScheduler
+{
+
+public:
+
+  // ctor starting the given number of workers
+  explicit ProductScheduler(size_t workers = thread::hardware_concurrency());
+  ~ProductScheduler();
+
+  // Queue a task behind every task already submitted for the product
+  void Submit(ProductIndex product, SchedulerTask *task);
+
+  // Block until every submitted task has run
+  void Wait();
+
+  // Run every submitted task and stop the workers
+  void Stop();
+
+  // Get the number of workers
+  size_t GetWorkers() const { return shards.size(); }
+
+  // Get the number of products taken from another worker's queue
+  long GetSteals() const { return steals.load(memory_order_relaxed); }
+
+private:
+  // Pending tasks for one product, oldest first
+  struct ProductQueue
+  {
+    mutex lock;
+    SchedulerTask *head = nullptr;
+    SchedulerTask *tail = nullptr;
+    bool scheduled = false;
+  };
+
+  // Products ready to run on one worker, in a ring that only grows. A product is
+  // ready on at most one worker, so a ring sized to the product count never grows.
+  struct Shard
+  {
+    mutex lock;
+    vector<ProductIndex> ring;
+    size_t first = 0;
+    size_t count = 0;
+
+    void PushBack(ProductIndex product);
+    ProductIndex PopFront();
+    ProductIndex PopBack();
+  };
+
+  static const size_t SLICE = 64;
+
+  ProductTable<atomic<ProductQueue*>> queues;
+  mutex queueslock;
+  vector<unique_ptr<Shard>> shards;
+  vector<thread> workers;
+  atomic<long> pending;
+  atomic<long> steals;
+  atomic<bool> running;
+  mutex idlelock;
+  condition_variable idle;
+
+  ProductQueue& Queue(ProductIndex product);
+  void Schedule(size_t shard, ProductIndex product);
+  bool Take(size_t shard, ProductIndex &product);
+  void RunProduct(size_t shard, ProductIndex product);
+  void Run(size_t shard);
+
+};
+
+ProductScheduler::ProductScheduler(size_t workers) :
+  pending(0), steals(0), running(true)
+{
+  if (workers == 0)
+    workers = 1;
+  size_t products = ProductInterner::Size();
+  for (size_t i = 0; i < products; i++)
+    queues[ProductIndex(i)].store(new ProductQueue(), memory_order_relaxed);
+  for (size_t i = 0; i < workers; i++)
+  {
+    shards.emplace_back(new Shard());
+    shards.back()->ring.resize(products > 16 ? products : 16);
+  }
+  for (size_t i = 0; i < workers; i++)
+    this->workers.emplace_back(&ProductScheduler::Run, this, i);
+}
+
+ProductScheduler::~ProductScheduler()
+{
+  Stop();
+  for (size_t i = 0; i < queues.size(); i++)
+    delete queues[ProductIndex(i)].load(memory_order_relaxed);
+}
+
+ProductScheduler::ProductQueue& ProductScheduler::Queue(ProductIndex product)
+{
+  atomic<ProductQueue*> &slot = queues[product];
+  ProductQueue *queue = slot.load(memory_order_acquire);
+  if (!queue)
+  {
+    lock_guard<mutex> guard(queueslock);
+    queue = slot.load(memory_order_relaxed);
+    if (!queue)
+    {
+      queue = new ProductQueue();
+      slot.store(queue, memory_order_release);
+    }
+  }
+  return *queue;
+}
+
+void ProductScheduler::Submit(ProductIndex product, SchedulerTask *task)
+{
+  ProductQueue &queue = Queue(product);
+  pending.fetch_add(1, memory_order_relaxed);
+  task->next = nullptr;
+  {
+    lock_guard<mutex> guard(queue.lock);
+    if (queue.tail)
+      queue.tail->next = task;
+    else
+      queue.head = task;
+    queue.tail = task;
+    if (queue.scheduled)
+      return;
+    queue.scheduled = true;
+  }
+  Schedule(size_t(product) % shards.size(), product);
+}
+
+void ProductScheduler::Schedule(size_t shard, ProductIndex product)
+{
+  {
+    lock_guard<mutex> guard(shards[shard]->lock);
+    shards[shard]->PushBack(product);
+  }
+  idle.notify_one();
+}
+
+void ProductScheduler::Shard::PushBack(ProductIndex product)
+{
+  if (count == ring.size())
+  {
+    vector<ProductIndex> grown(ring.size() * 2);
+    for (size_t i = 0; i < count; i++)
+      grown[i] = ring[(first + i) % ring.size()];
+    ring.swap(grown);
+    first = 0;
+  }
+  ring[(first + count) % ring.size()] = product;
+  count++;
+}
+
+ProductIndex ProductScheduler::Shard::PopFront()
+{
+  ProductIndex product = ring[first];
+  first = (first + 1) % ring.size();
+  count--;
+  return product;
+}
+
+ProductIndex ProductScheduler::Shard::PopBack()
+{
+  count--;
+  return ring[(first + count) % ring.size()];
+}
+
+bool ProductScheduler::Take(size_t shard, ProductIndex &product)
+{
+  {
+    lock_guard<mutex> guard(shards[shard]->lock);
+    if (shards[shard]->count != 0)
+    {
+      product = shards[shard]->PopFront();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < shards.size(); i++)
+  {
+    Shard &victim = *shards[(shard + i) % shards.size()];
+    lock_guard<mutex> guard(victim.lock);
+    if (victim.count != 0)
+    {
+      product = victim.PopBack();
+      steals.fetch_add(1, memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ProductScheduler::RunProduct(size_t shard, ProductIndex product)
+{
+  ProductQueue &queue = Queue(product);
+  for (size_t n = 0; n < SLICE; n++)
+  {
+    SchedulerTask *task;
+    {
+      lock_guard<mutex> guard(queue.lock);
+      task = queue.head;
+      if (!task)
+      {
+        queue.scheduled = false;
+        return;
+      }
+      queue.head = task->next;
+      if (!queue.head)
+        queue.tail = nullptr;
+    }
+    task->Run();
+    pending.fetch_sub(1, memory_order_release);
+  }
+  // Slice used up: go to the back of this worker's queue, still scheduled
+  Schedule(shard, product);
+}
+
+void ProductScheduler::Run(size_t shard)
+{
+  while (true)
+  {
+    ProductIndex product;
+    if (Take(shard, product))
+    {
+      RunProduct(shard, product);
+      continue;
+    }
+    if (!running.load(memory_order_acquire) && pending.load(memory_order_acquire) == 0)
+      return;
+    unique_lock<mutex> guard(idlelock);
+    idle.wait_for(guard, chrono::microseconds(200));
+  }
+}
+
+void ProductScheduler::Wait()
+{
+  while (pending.load(memory_order_acquire) != 0)
+    this_thread::yield();
+}
+
+void ProductScheduler::Stop()
+{
+  running.store(false, memory_order_release);
+  idle.notify_all();
+  for (auto &worker : workers)
+    if (worker.joinable())
+      worker.join();
+}
+
+/**
+ * Listener adapter that runs a listener's callbacks on a ProductScheduler,
+ * keyed by the product of each item. Callbacks for different products run in
+ * parallel; callbacks for one product keep their order. A block is split into
+ * one sub-block per product, so the wrapped listener still sees blocks.
+ * Sub-blocks come from a pool of POOL_BLOCKS made up front, so delivery does not
+ * allocate; a producer that gets that far ahead of the workers waits for them.
+ * The wrapped listener must not call back into this adapter.
+ * Type V is the data type of the edge; V::GetProduct() must return a product.
+ */
+template<typename V>
+class ShardedListener : public ServiceListener<V>
+{
+
+public:
+
+  // ctor wrapping a listener
+  ShardedListener(ServiceListener<V> *_listener, ProductScheduler &_scheduler) :
+    listener(_listener), scheduler(_scheduler), pool(POOL_BLOCKS)
+  {
+  }
+
+  // Listener callback to process an add event to the Service
+  virtual void ProcessAdd(V &data) { Submit(ASYNC_ADD, data); }
+
+  // Listener callback to process a remove event to the Service
+  virtual void ProcessRemove(V &data) { Submit(ASYNC_REMOVE, data); }
+
+  // Listener callback to process an update event to the Service
+  virtual void ProcessUpdate(V &data) { Submit(ASYNC_UPDATE, data); }
+
+  // Listener callback to process a block of add events to the Service
+  virtual void ProcessAddBatch(V *data, size_t count);
+
+private:
+  static const size_t BLOCK_SIZE = 64;
+  // One batch opens up to BLOCK_SIZE blocks before submitting any, so the pool holds
+  // several times that
+  static const size_t POOL_BLOCKS = 4 * BLOCK_SIZE;
+
+  // Up to BLOCK_SIZE items for one product, delivered as one callback
+  struct Block : public SchedulerTask
+  {
+    ShardedListener<V> *owner = nullptr;
+    AsyncEventKind kind = ASYNC_ADD;
+    LatencyContext trace;
+    size_t count = 0;
+    V data[BLOCK_SIZE];
+
+    virtual void Run();
+  };
+
+  ServiceListener<V> *listener;
+  ProductScheduler &scheduler;
+  ObjectPool<Block> pool;
+
+  Block* NewBlock(AsyncEventKind kind);
+  void Submit(AsyncEventKind kind, V &data);
+
+};
+
+template<typename V>
+typename ShardedListener<V>::Block* ShardedListener<V>::NewBlock(AsyncEventKind kind)
+{
+  Block *block = pool.Acquire();
+  block->owner = this;
+  block->kind = kind;
+  block->trace = LatencyTrace::Current();
+  block->count = 0;
+  return block;
+}
+
+template<typename V>
+void ShardedListener<V>::Submit(AsyncEventKind kind, V &data)
+{
+  Block *block = NewBlock(kind);
+  block->data[block->count++] = data;
+  scheduler.Submit(data.GetProduct().GetProductIndex(), block);
+}
+
+template<typename V>
+void ShardedListener<V>::ProcessAddBatch(V *data, size_t count)
+{
+  // Each slice of BLOCK_SIZE items has at most BLOCK_SIZE products, so one open block
+  // per product fits in fixed arrays. Blocks go out in slice order, which keeps
+  // every product's items in order across slices.
+  Block *open[BLOCK_SIZE];
+  ProductIndex keys[BLOCK_SIZE];
+  for (size_t start = 0; start < count; start += BLOCK_SIZE)
+  {
+    size_t end = start + BLOCK_SIZE < count ? start + BLOCK_SIZE : count;
+    size_t opened = 0;
+    for (size_t i = start; i < end; i++)
+    {
+      ProductIndex product = data[i].GetProduct().GetProductIndex();
+      size_t b = 0;
+      while (b < opened && keys[b] != product)
+        b++;
+      if (b == opened)
+      {
+        keys[opened] = product;
+        open[opened++] = NewBlock(ASYNC_ADD);
+      }
+      open[b]->data[open[b]->count++] = data[i];
+    }
+    for (size_t b = 0; b < opened; b++)
+      scheduler.Submit(keys[b], open[b]);
+  }
+}
+
+template<typename V>
+void ShardedListener<V>::Block::Run()
+{
+  AllocationRegion region;
+  LatencyResume resume(trace);
+  ServiceListener<V> *l = owner->listener;
+  if (kind == ASYNC_ADD)
+    l->ProcessAddBatch(data, count);
+  else
+    for (size_t i = 0; i < count; i++)
+      kind == ASYNC_REMOVE ? l->ProcessRemove(data[i]) : l->ProcessUpdate(data[i]);
+  owner->pool.Release(this);
+}
+
+#endif
@@ -9,6 +9,9 @@
 #define SOA_HPP
 
 #include <vector>
+#include <cstddef>
+#include <fstream>
+#include "feedsource.hpp"
 
 using namespace std;
 
@@ -32,6 +35,14 @@ public:
   // Listener callback to process an update event to the Service
   virtual void ProcessUpdate(V &data) = 0;
 
+  // Listener callback to process a contiguous block of add events to the Service.
+  // Override to handle the block as a whole; by default each item is processed in turn.
+  virtual void ProcessAddBatch(V *data, size_t count)
+  {
+    for (size_t i = 0; i < count; i++)
+      ProcessAdd(data[i]);
+  }
+
 };
 
 /**
@@ -50,6 +61,14 @@ public:
   // The callback that a Connector should invoke for any new or updated data
   virtual void OnMessage(V &data) = 0;
 
+  // The callback that a Connector should invoke for a contiguous block of new or updated data.
+  // By default each item is passed to OnMessage in turn.
+  virtual void OnMessageBatch(V *data, size_t count)
+  {
+    for (size_t i = 0; i < count; i++)
+      OnMessage(data[i]);
+  }
+
   // Add a listener to the Service for callbacks on add, remove, and update events
   // for data to the Service.
   virtual void AddListener(ServiceListener<V> *listener) = 0;
@@ -75,7 +94,16 @@ public:
 
   // Publish data to the Connector
   virtual void Publish(V &data) = 0;
-  virtual void Subscribe(ifstream& file) = 0;
+
+  // Subscribe to a feed and read it to the end; publish-only connectors ignore it
+  virtual void Subscribe(FeedSource &/*source*/) {}
+
+  // Subscribe to a file stream, read line by line
+  virtual void Subscribe(ifstream& file)
+  {
+    StreamFeedSource source(file);
+    Subscribe(source);
+  }
 };
 
 #endif
@@ -0,0 +1,390 @@
+/**
+ * socketfeedsource.hpp
+ * Defines a feed read from a stream socket, over a Unix domain socket or TCP, and
+ * the serving end that writes one.
+ */
+#ifndef SOCKET_FEED_SOURCE_HPP
+#define SOCKET_FEED_SOURCE_HPP
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#ifdef _WIN32
+// Before feedsource.hpp's windows.h, which would bring in the old winsock.h
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "Ws2_32.lib")
+#endif
+#else
+#include <cerrno>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+#include "bufferedfeedsource.hpp"
+
+using namespace std;
+
+/**
+ * Where a socket feed is served: "unix:PATH" for a Unix domain socket, or
+ * "tcp:HOST:PORT" for TCP. Unix domain sockets are POSIX only.
+ */
+struct SocketAddress
+{
+  // Set for a Unix domain socket at path, else TCP at host and port
+  bool local = false;
+  string path;
+  string host;
+  string port;
+
+  // Parse an address; false if it is in neither form
+  static bool Parse(const string &text, SocketAddress &address)
+  {
+    address = SocketAddress();
+    if (text.compare(0, 5, "unix:") == 0 && text.size() > 5)
+    {
+      address.local = true;
+      address.path = text.substr(5);
+      return true;
+    }
+    size_t colon = text.rfind(':');
+    if (text.compare(0, 4, "tcp:") != 0 || colon <= 4 || colon + 1 >= text.size())
+      return false;
+    address.host = text.substr(4, colon - 4);
+    address.port = text.substr(colon + 1);
+    return true;
+  }
+};
+
+#ifdef _WIN32
+typedef SOCKET SocketHandle;
+const SocketHandle NO_SOCKET = INVALID_SOCKET;
+
+// Start Winsock once per process
+inline bool StartSockets()
+{
+  static const bool started = [] {
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+  }();
+  return started;
+}
+
+inline void CloseSocket(SocketHandle socket) { closesocket(socket); }
+#else
+typedef int SocketHandle;
+const SocketHandle NO_SOCKET = -1;
+
+inline bool StartSockets() { return true; }
+
+inline void CloseSocket(SocketHandle socket) { close(socket); }
+#endif
+
+// Get a socket connected to, or when listen is set bound and listening at, an
+// address; NO_SOCKET on failure
+inline SocketHandle OpenSocket(const SocketAddress &address, bool listen)
+{
+  if (!StartSockets())
+    return NO_SOCKET;
+#ifndef _WIN32
+  if (address.local)
+  {
+    sockaddr_un name = sockaddr_un();
+    name.sun_family = AF_UNIX;
+    if (address.path.size() >= sizeof(name.sun_path))
+      return NO_SOCKET;
+    memcpy(name.sun_path, address.path.c_str(), address.path.size() + 1);
+    SocketHandle s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == NO_SOCKET)
+      return NO_SOCKET;
+    if (listen)
+    {
+      // A socket file left by an earlier server would make bind fail
+      unlink(address.path.c_str());
+      if (bind(s, reinterpret_cast<sockaddr*>(&name), sizeof(name)) == 0 && ::listen(s, 1) == 0)
+        return s;
+    }
+    else if (connect(s, reinterpret_cast<sockaddr*>(&name), sizeof(name)) == 0)
+      return s;
+    CloseSocket(s);
+    return NO_SOCKET;
+  }
+#else
+  if (address.local)
+    return NO_SOCKET;
+#endif
+  addrinfo hints = addrinfo();
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listen ? AI_PASSIVE : 0;
+  addrinfo *found = nullptr;
+  if (getaddrinfo(address.host.c_str(), address.port.c_str(), &hints, &found) != 0)
+    return NO_SOCKET;
+  SocketHandle s = NO_SOCKET;
+  for (addrinfo *entry = found; entry && s == NO_SOCKET; entry = entry->ai_next)
+  {
+    s = socket(entry->ai_family, entry->ai_socktype, entry->ai_protocol);
+    if (s == NO_SOCKET)
+      continue;
+    int one = 1;
+    bool ok;
+    if (listen)
+    {
+      setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+      ok = bind(s, entry->ai_addr, int(entry->ai_addrlen)) == 0 && ::listen(s, 1) == 0;
+    }
+    else
+    {
+      ok = connect(s, entry->ai_addr, int(entry->ai_addrlen)) == 0;
+      // Small writes from the server side go out at once
+      setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+    }
+    if (!ok)
+    {
+      CloseSocket(s);
+      s = NO_SOCKET;
+    }
+  }
+  freeaddrinfo(found);
+  return s;
+}
+
+/**
+ * Feed read from a stream socket, for connectors to consume a feed served by
+ * another process.
+ * The socket is non-blocking: each refill takes everything that has arrived with
+ * one recv into the free end of the buffer (at least 64KB), and lines are parsed in
+ * place there. When nothing has arrived a read spins on recv for a short while
+ * (SetSpin), then sleeps in poll until data arrives. The feed ends when the server
+ * closes the connection, after the last line it sent has been read, or when Stop()
+ * is called from another thread.
+ */
+class SocketFeedSource : public BufferedFeedSource
+{
+
+public:
+
+  // ctor for a feed from a server at an address such as unix:/tmp/market.sock or
+  // tcp:127.0.0.1:9000; check IsOpen() before reading
+  explicit SocketFeedSource(const string &address);
+  ~SocketFeedSource();
+
+  SocketFeedSource(const SocketFeedSource&) = delete;
+  SocketFeedSource& operator=(const SocketFeedSource&) = delete;
+
+  // Get whether the connection was made
+  bool IsOpen() const { return socket != NO_SOCKET; }
+
+  // Set how long a read spins on the socket before sleeping; zero sleeps at once
+  void SetSpin(chrono::nanoseconds _spin) { spin = _spin; }
+
+  // End the feed once what has arrived is read; safe from any thread
+  void Stop() { stopped.store(true, memory_order_release); }
+
+protected:
+
+  // Take everything that has arrived, up to size bytes
+  virtual long long ReadSome(char *buffer, size_t size)
+  {
+    if (closed)
+      return 0;
+    long long count = (long long)recv(socket, buffer, int(size), 0);
+    if (count > 0)
+      return count;
+    if (count == 0 || !WouldBlock())
+      closed = true;
+    return 0;
+  }
+
+  // Wait for data; false once the server has closed the connection or the feed is
+  // stopped, and everything that arrived has been read
+  virtual bool Wait()
+  {
+    if (socket == NO_SOCKET)
+      return false;
+    auto deadline = chrono::steady_clock::now() + spin;
+    while (!closed && chrono::steady_clock::now() < deadline)
+      if (Fill())
+        return true;
+    while (!closed)
+    {
+      if (stopped.load(memory_order_acquire))
+        return Fill();
+      Idle();
+      if (Fill())
+        return true;
+    }
+    return false;
+  }
+
+private:
+  SocketHandle socket;
+  bool closed;
+  chrono::nanoseconds spin;
+  atomic<bool> stopped;
+
+  static bool WouldBlock()
+  {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+  }
+
+  // Sleep until the socket is readable, or a while has passed so Stop() is seen
+  void Idle()
+  {
+#ifdef _WIN32
+    WSAPOLLFD fd;
+    fd.fd = socket;
+    fd.events = POLLRDNORM;
+    WSAPoll(&fd, 1, 10);
+#else
+    pollfd fd;
+    fd.fd = socket;
+    fd.events = POLLIN;
+    poll(&fd, 1, 10);
+#endif
+  }
+
+};
+
+inline SocketFeedSource::SocketFeedSource(const string &address) :
+  socket(NO_SOCKET), closed(false), spin(chrono::microseconds(100)), stopped(false)
+{
+  SocketAddress parsed;
+  if (!SocketAddress::Parse(address, parsed))
+    return;
+  socket = OpenSocket(parsed, false);
+  if (socket == NO_SOCKET)
+    return;
+#ifdef _WIN32
+  u_long nonblocking = 1;
+  ioctlsocket(socket, FIONBIO, &nonblocking);
+#else
+  fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+#endif
+  // Room for a burst to wait in the kernel while the connector is busy
+  int size = 1 << 20;
+  setsockopt(socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&size), sizeof(size));
+}
+
+inline SocketFeedSource::~SocketFeedSource()
+{
+  if (socket != NO_SOCKET)
+    CloseSocket(socket);
+}
+
+/**
+ * The serving end of a socket feed: listens at an address, takes one client at a
+ * time and writes the feed to it.
+ */
+class SocketFeedServer
+{
+
+public:
+
+  // ctor for a server listening at an address; check IsOpen()
+  explicit SocketFeedServer(const string &address) :
+    listener(NO_SOCKET), client(NO_SOCKET)
+  {
+    if (SocketAddress::Parse(address, parsed))
+      listener = OpenSocket(parsed, true);
+  }
+
+  ~SocketFeedServer()
+  {
+    Disconnect();
+    if (listener != NO_SOCKET)
+      CloseSocket(listener);
+#ifndef _WIN32
+    if (listener != NO_SOCKET && parsed.local)
+      unlink(parsed.path.c_str());
+#endif
+  }
+
+  SocketFeedServer(const SocketFeedServer&) = delete;
+  SocketFeedServer& operator=(const SocketFeedServer&) = delete;
+
+  // Get whether the server is listening
+  bool IsOpen() const { return listener != NO_SOCKET; }
+
+  // Get the address clients connect to; a TCP server asked for port 0 reports the
+  // port it was given
+  string GetAddress() const
+  {
+    if (parsed.local)
+      return "unix:" + parsed.path;
+    sockaddr_storage bound = sockaddr_storage();
+    socklen_t length = sizeof(bound);
+    if (listener == NO_SOCKET || getsockname(listener, reinterpret_cast<sockaddr*>(&bound), &length) != 0)
+      return "tcp:" + parsed.host + ":" + parsed.port;
+    unsigned port = bound.ss_family == AF_INET6 ? ntohs(reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port)
+      : ntohs(reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+    return "tcp:" + parsed.host + ":" + to_string(port);
+  }
+
+  // Wait for a client to connect, dropping any earlier one; false on failure
+  bool Accept()
+  {
+    Disconnect();
+    if (listener == NO_SOCKET)
+      return false;
+    client = accept(listener, nullptr, nullptr);
+    if (client == NO_SOCKET)
+      return false;
+    if (!parsed.local)
+    {
+      int one = 1;
+      setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+    }
+    return true;
+  }
+
+  // Write data to the client, all of it; false once the client has gone
+  bool Send(string_view data)
+  {
+    while (!data.empty() && client != NO_SOCKET)
+    {
+#if defined(MSG_NOSIGNAL)
+      long long sent = (long long)send(client, data.data(), data.size(), MSG_NOSIGNAL);
+#else
+      long long sent = (long long)send(client, data.data(), int(data.size()), 0);
+#endif
+      if (sent <= 0)
+      {
+        Disconnect();
+        return false;
+      }
+      data.remove_prefix(size_t(sent));
+    }
+    return client != NO_SOCKET;
+  }
+
+  // Close the connection to the client, which ends its feed
+  void Disconnect()
+  {
+    if (client != NO_SOCKET)
+      CloseSocket(client);
+    client = NO_SOCKET;
+  }
+
+private:
+  SocketAddress parsed;
+  SocketHandle listener;
+  SocketHandle client;
+
+};
+
+#endif
@@ -0,0 +1,106 @@
+/**
+ * spscqueue.hpp
+ * Bounded lock-free single-producer/single-consumer ring buffer.
+ */
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Bounded ring buffer shared by exactly one producer thread and one consumer thread.
+ * Capacity is rounded up to a power of two. Slots are allocated once, up front.
+ * Type V is the element type and must be default constructible and copy assignable.
+ */
+template<typename V>
+class SPSCQueue
+{
+
+public:
+
+  // ctor for a queue holding at least _capacity elements
+  explicit SPSCQueue(size_t _capacity);
+
+  // Copy an element in from the producer thread; returns false when the queue is full
+  bool TryPush(const V &data);
+
+  // Copy an element out on the consumer thread; returns false when the queue is empty
+  bool TryPop(V &data);
+
+  // Approximate number of queued elements
+  size_t Size() const;
+
+  // Get the capacity of the queue
+  size_t Capacity() const;
+
+private:
+  vector<V> slots;
+  size_t mask;
+
+  // Producer and consumer indices live on separate cache lines, each next to
+  // the cached copy of the other side's index it reads on the fast path.
+  alignas(64) atomic<size_t> head;
+  size_t cachedTail;
+  alignas(64) atomic<size_t> tail;
+  size_t cachedHead;
+
+};
+
+template<typename V>
+SPSCQueue<V>::SPSCQueue(size_t _capacity) :
+  head(0), cachedTail(0), tail(0), cachedHead(0)
+{
+  size_t capacity = 2;
+  while (capacity < _capacity)
+    capacity <<= 1;
+  slots.resize(capacity);
+  mask = capacity - 1;
+}
+
+template<typename V>
+bool SPSCQueue<V>::TryPush(const V &data)
+{
+  size_t t = tail.load(memory_order_relaxed);
+  if (t - cachedHead > mask)
+  {
+    cachedHead = head.load(memory_order_acquire);
+    if (t - cachedHead > mask)
+      return false;
+  }
+  slots[t & mask] = data;
+  tail.store(t + 1, memory_order_release);
+  return true;
+}
+
+template<typename V>
+bool SPSCQueue<V>::TryPop(V &data)
+{
+  size_t h = head.load(memory_order_relaxed);
+  if (h == cachedTail)
+  {
+    cachedTail = tail.load(memory_order_acquire);
+    if (h == cachedTail)
+      return false;
+  }
+  data = slots[h & mask];
+  head.store(h + 1, memory_order_release);
+  return true;
+}
+
+template<typename V>
+size_t SPSCQueue<V>::Size() const
+{
+  return tail.load(memory_order_acquire) - head.load(memory_order_acquire);
+}
+
+template<typename V>
+size_t SPSCQueue<V>::Capacity() const
+{
+  return mask + 1;
+}
+
+#endif
@@ -17,14 +17,14 @@ template<typename T>
 class StreamingAlgoService : public Service<string, PriceStream <T> >
 {
 private:
-	map<string, PriceStream<T>> streammap;
+	ProductTable<PriceStream<T>> streammap;
 	vector<ServiceListener<PriceStream<T>>*> listeners;
 	StreamingAlgoListener<T>* listener;
 public:
 	StreamingAlgoService() {
 		listener = new StreamingAlgoListener<T>(this);
 		listeners = vector<ServiceListener<PriceStream<T>>*>();
-		streammap = map<string, PriceStream<T>>();
+		streammap = ProductTable<PriceStream<T>>();
 	}
 	~StreamingAlgoService() {
 		delete listener;
@@ -40,7 +40,7 @@ public:
 	// The callback that a Connector should invoke for any new or updated data
 	virtual void OnMessage(PriceStream<T> &data)
 	{
-		streammap[data.GetProduct().GetProductId()] = data;
+		streammap[data.GetProduct().GetProductIndex()] = data;
 	}
 
 	// Add a listener to the Service for callbacks on add, remove, and update events
@@ -75,14 +75,32 @@ public:
 		streamalgo = s;
 	}
 	~StreamingAlgoListener(){}
+	// Build the two-way price stream around a mid
+	PriceStream<T> MakeStream(const Price<T> &data) const
+	{
+		PriceStreamOrder bid(data.GetMid() - data.GetBidOfferSpread().Half(), 1000000, 2000000, BID);
+		PriceStreamOrder ask(data.GetMid() + data.GetBidOfferSpread().Half(), 1000000, 2000000, OFFER);
+		return PriceStream<T>(data.GetProduct(), bid, ask);
+	}
+
 	void ProcessAdd(Price<T> &data)
 	{
-		PriceStreamOrder bid(data.GetMid() - data.GetBidOfferSpread() / 2, 1000000, 2000000, BID);
-		PriceStreamOrder ask(data.GetMid() + data.GetBidOfferSpread() / 2, 1000000, 2000000, OFFER);
-		PriceStream<T> P(data.GetProduct(), bid, ask);
+		static const LatencyPoint hop("streaming algo");
+		LatencyHop trace(hop);
+		PriceStream<T> P = MakeStream(data);
 		streamalgo->PublishPrice(P);
 	}
 
+	// Pipeline stage: hand the stream straight to the next stage instead of the listeners
+	template<typename Next>
+	void Process(Price<T> &data, Next &next)
+	{
+		static const LatencyPoint hop("streaming algo");
+		LatencyHop trace(hop);
+		PriceStream<T> P = MakeStream(data);
+		next(P);
+	}
+
 	// Listener callback to process a remove event to the Service
 	virtual void ProcessRemove(Price<T> &data) {}
 
@@ -9,6 +9,9 @@
 
 #include "soa.hpp"
 #include "marketdataservice.hpp"
+#include "latency.hpp"
+#include "recordwriter.hpp"
+#include "binaryrecords.hpp"
 
 /**
  * A price stream order with price and quantity (visible and hidden)
@@ -19,7 +22,7 @@ class PriceStreamOrder
 public:
 
   // ctor for an order
-  PriceStreamOrder(double _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side);
+  PriceStreamOrder(FixedPrice _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side);
   PriceStreamOrder() = default;
   // The side on this order
   PricingSide GetSide() const {
@@ -27,7 +30,7 @@ public:
   }
 
   // Get the price on this order
-  double GetPrice() const;
+  FixedPrice GetPrice() const;
 
   // Get the visible quantity on this order
   long GetVisibleQuantity() const;
@@ -36,9 +39,9 @@ public:
   long GetHiddenQuantity() const;
 
 private:
-  double price;
   long visibleQuantity;
   long hiddenQuantity;
+  FixedPrice price;
   PricingSide side;
 
 };
@@ -66,25 +69,44 @@ public:
   const PriceStreamOrder& GetOfferOrder() const;
 
   string stream_to_string_bid() {
-	  string s1 = product.GetProductId();
-	  string s2 = to_string(bidOrder.GetPrice());
-	  string s3 = to_string(bidOrder.GetVisibleQuantity());
-	  string s4 = to_string(bidOrder.GetHiddenQuantity());
-	  string s5 = "BID";
-	  return s1 + "," + s2 + "," + s3 + "," + s4 + "," + s5;
+	  char buffer[256];
+	  RecordWriter out(buffer, sizeof(buffer));
+	  stream_to_chars_bid(out);
+	  return string(out.View());
 	}
   string stream_to_string_offer() {
-	  string s1 = product.GetProductId();
-	  string s2 = to_string(offerOrder.GetPrice());
-	  string s3 = to_string(offerOrder.GetVisibleQuantity());
-	  string s4 = to_string(offerOrder.GetHiddenQuantity());
-	  string s5 = "OFFER";
-	  return s1 + "," + s2 + "," + s3 + "," + s4 + "," + s5;
+	  char buffer[256];
+	  RecordWriter out(buffer, sizeof(buffer));
+	  stream_to_chars_offer(out);
+	  return string(out.View());
+  }
+
+  // Write productId,price,visibleQuantity,hiddenQuantity,BID
+  void stream_to_chars_bid(RecordWriter &out) const {
+	  out.Text(product->GetProductId()).Char(',').Fixed(bidOrder.GetPrice().ToDouble()).Char(',')
+		  .Integer(bidOrder.GetVisibleQuantity()).Char(',').Integer(bidOrder.GetHiddenQuantity()).Text(",BID");
+  }
+
+  // Write productId,price,visibleQuantity,hiddenQuantity,OFFER
+  void stream_to_chars_offer(RecordWriter &out) const {
+	  out.Text(product->GetProductId()).Char(',').Fixed(offerOrder.GetPrice().ToDouble()).Char(',')
+		  .Integer(offerOrder.GetVisibleQuantity()).Char(',').Integer(offerOrder.GetHiddenQuantity()).Text(",OFFER");
+  }
+
+  // Fill every field of a record but its time
+  void stream_to_record(StreamRecord &record) const {
+	  SetRecordText(record.productId, product->GetProductId());
+	  record.bidPrice = bidOrder.GetPrice().ToDouble();
+	  record.bidVisibleQuantity = bidOrder.GetVisibleQuantity();
+	  record.bidHiddenQuantity = bidOrder.GetHiddenQuantity();
+	  record.offerPrice = offerOrder.GetPrice().ToDouble();
+	  record.offerVisibleQuantity = offerOrder.GetVisibleQuantity();
+	  record.offerHiddenQuantity = offerOrder.GetHiddenQuantity();
   }
 
 
 private:
-  T product;
+  const T *product = nullptr;
   PriceStreamOrder bidOrder;
   PriceStreamOrder offerOrder;
 
@@ -109,7 +131,7 @@ class StreamingService : public Service<string,PriceStream <T> >
 {
 
 private:
-	map<string, PriceStream<T>> streammap;
+	ProductTable<PriceStream<T>> streammap;
 	vector<ServiceListener<PriceStream<T>>*> listeners;
 	StreamingListener<T>* listener;
 	StreamingConnector<T>* connector;
@@ -117,7 +139,7 @@ public:
 	StreamingService() {
 		listener = new StreamingListener<T>(this);
 		listeners = vector<ServiceListener<PriceStream<T>>*>();
-		streammap = map<string, PriceStream<T>>();
+		streammap = ProductTable<PriceStream<T>>();
 		connector = new StreamingConnector<T>(this);
 	}
 	~StreamingService() {
@@ -135,7 +157,7 @@ public:
 	// The callback that a Connector should invoke for any new or updated data
 	virtual void OnMessage(PriceStream<T> &data)
 	{
-		streammap[data.GetProduct().GetProductId()] = data;
+		streammap[data.GetProduct().GetProductIndex()] = data;
 	}
 
 	// Add a listener to the Service for callbacks on add, remove, and update events
@@ -152,6 +174,8 @@ public:
 	}
 
 	virtual void PublishPrice(PriceStream<T>& priceStream) {
+		static const LatencyPoint hop("streaming");
+		LatencyHop trace(hop);
 		for (auto& l : listeners)
 			l->ProcessAdd(priceStream);
 	}
@@ -161,7 +185,7 @@ public:
 
 };
 
-PriceStreamOrder::PriceStreamOrder(double _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side)
+PriceStreamOrder::PriceStreamOrder(FixedPrice _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side)
 {
   price = _price;
   visibleQuantity = _visibleQuantity;
@@ -169,7 +193,7 @@ PriceStreamOrder::PriceStreamOrder(double _price, long _visibleQuantity, long _h
   side = _side;
 }
 
-double PriceStreamOrder::GetPrice() const
+FixedPrice PriceStreamOrder::GetPrice() const
 {
   return price;
 }
@@ -186,7 +210,7 @@ long PriceStreamOrder::GetHiddenQuantity() const
 
 template<typename T>
 PriceStream<T>::PriceStream(const T &_product, const PriceStreamOrder &_bidOrder, const PriceStreamOrder &_offerOrder) :
-  product(_product), bidOrder(_bidOrder), offerOrder(_offerOrder)
+  product(&_product), bidOrder(_bidOrder), offerOrder(_offerOrder)
 {
 }
 
@@ -194,7 +218,7 @@ PriceStream<T>::PriceStream(const T &_product, const PriceStreamOrder &_bidOrder
 template<typename T>
 const T& PriceStream<T>::GetProduct() const
 {
-  return product;
+  return *product;
 }
 
 template<typename T>
@@ -235,6 +259,15 @@ public:
 		stream->PublishPrice(data);
 	}
 
+	// Pipeline stage: publishing only forwards, so pass the stream on unchanged
+	template<typename Next>
+	void Process(PriceStream<T> &data, Next &next)
+	{
+		static const LatencyPoint hop("streaming");
+		LatencyHop trace(hop);
+		next(data);
+	}
+
 	// Listener callback to process a remove event to the Service
 	virtual void ProcessRemove(PriceStream<T> &data) {}
 
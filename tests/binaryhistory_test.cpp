@@ -0,0 +1,144 @@
+/**
+ * binaryhistory_test.cpp
+ * Runs the wired system over the same feeds writing text history and then binary
+ * history, turns the binary stores back into text and checks they hold what the
+ * text stores do.
+ */
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include "check.hpp"
+#include "../tradingsystem.hpp"
+#include "../feedgenerator.hpp"
+#include "../recordtext.hpp"
+
+// Run a fresh system over generated feeds in a directory of its own, writing its
+// history in the given format there
+static void RunSystem(const filesystem::path &dir, RecordFormat format)
+{
+  filesystem::remove_all(dir);
+  filesystem::create_directories(dir);
+  filesystem::path home = filesystem::current_path();
+  filesystem::current_path(dir);
+  FeedGeneratorConfig config;
+  config.levelJitter = 16;
+  FeedGenerator generator(FeedGenerator::SyntheticProducts(6), config);
+  generator.WritePrices("price.txt", 600);
+  generator.WriteTrades("trades.txt", 60);
+  generator.WriteMarket("market.txt", 120);
+  generator.WriteInquiries("inquiry.txt", 60);
+  {
+    TradingSystem<Bond> system(1);
+    system.SetHistoryFormat(format);
+    MappedFeedSource prices("price.txt"), trades("trades.txt"), market("market.txt"), inquiries("inquiry.txt");
+    system.Run(prices, trades, market, inquiries);
+  }
+  filesystem::current_path(home);
+}
+
+// Get the fields of a line after its timestamp, leaving out those at the given
+// positions
+static string Fields(string_view line, const vector<size_t> &dropped = {})
+{
+  string_view fields[12];
+  size_t count = SplitFields(line, ',', fields, 12);
+  string kept;
+  for (size_t i = 1; i < count; i++)
+    if (find(dropped.begin(), dropped.end(), i) == dropped.end())
+      kept.append(fields[i].data(), fields[i].size()).push_back(',');
+  return kept;
+}
+
+// Get the lines of a text store
+static vector<string> TextLines(const filesystem::path &path)
+{
+  vector<string> lines;
+  MappedFeedSource source(path.string());
+  string_view line;
+  while (source.NextLine(line))
+    if (!line.empty())
+      lines.push_back(string(line));
+  return lines;
+}
+
+// Get the lines of a binary store written out as text
+template<typename R>
+static vector<string> BinaryLines(const filesystem::path &path)
+{
+  vector<string> lines;
+  MappedFeedSource source(path.string());
+  RecordReader<R> reader(source);
+  CHECK(bool(reader));
+  R record;
+  char text[512];
+  RecordWriter out(text, sizeof(text));
+  while (reader.Next(record))
+  {
+    out.Clear();
+    RecordText<R>::Write(record, out);
+    string_view written(out.Data(), out.Size());
+    string_view line;
+    while (TakeLine(written, line))
+      lines.push_back(string(line));
+  }
+  return lines;
+}
+
+// Get every line's fields, in sorted order, for a store written on one thread in an
+// order that can differ between runs only where threads interleave
+static vector<string> Sorted(const vector<string> &lines, const vector<size_t> &dropped = {})
+{
+  vector<string> result;
+  for (const string &line : lines)
+    result.push_back(Fields(line, dropped));
+  sort(result.begin(), result.end());
+  return result;
+}
+
+// Get the fields of the last line for each key, the first field after the timestamp,
+// for a store of running values that two feeds move in an order that varies
+static map<string, string> Latest(const vector<string> &lines)
+{
+  map<string, string> result;
+  for (const string &line : lines)
+  {
+    string fields = Fields(line);
+    result[fields.substr(0, fields.find(','))] = fields;
+  }
+  return result;
+}
+
+int main()
+{
+  filesystem::path root = filesystem::temp_directory_path() / "binaryhistory_test";
+  filesystem::path text = root / "text", binary = root / "binary";
+  RunSystem(text, TEXT_RECORDS);
+  RunSystem(binary, BINARY_RECORDS);
+
+  CHECK(!filesystem::exists(binary / "streaming.txt"));
+  CHECK(!filesystem::exists(text / "streaming.bin"));
+
+  vector<string> streams = TextLines(text / "streaming.txt");
+  CHECK(!streams.empty());
+  CHECK(Sorted(streams) == Sorted(BinaryLines<StreamRecord>(binary / "streaming.bin")));
+
+  // Execution order ids count up across the process, so they differ between the runs
+  vector<string> executions = TextLines(text / "Execution.txt");
+  CHECK(!executions.empty());
+  CHECK(Sorted(executions, { 3, 8 }) == Sorted(BinaryLines<ExecutionRecord>(binary / "Execution.bin"), { 3, 8 }));
+
+  vector<string> inquiries = TextLines(text / "allinquiries.txt");
+  CHECK(!inquiries.empty());
+  CHECK(Sorted(inquiries) == Sorted(BinaryLines<InquiryHistoryRecord>(binary / "allinquiries.bin")));
+
+  // Booked trades and executions reach positions and risk in either order
+  map<string, string> positions = Latest(TextLines(text / "position.txt"));
+  CHECK(!positions.empty());
+  CHECK(positions == Latest(BinaryLines<PositionRecord>(binary / "position.bin")));
+  map<string, string> risks = Latest(TextLines(text / "risk.txt"));
+  CHECK(!risks.empty());
+  CHECK(risks == Latest(BinaryLines<RiskRecord>(binary / "risk.bin")));
+
+  filesystem::remove_all(root);
+  return CheckResult();
+}
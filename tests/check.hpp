@@ -0,0 +1,37 @@
+/**
+ * check.hpp
+ * Minimal assertions for the test executables: a failed CHECK reports its line and
+ * the test carries on, and CheckResult() gives main's exit status.
+ */
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <iostream>
+
+using namespace std;
+
+inline int& CheckFailures()
+{
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(condition) \
+  do \
+  { \
+    if (!(condition)) \
+    { \
+      cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << endl; \
+      CheckFailures()++; \
+    } \
+  } while (0)
+
+// Get main's exit status: 0 if every check passed
+inline int CheckResult()
+{
+  if (CheckFailures())
+    cerr << CheckFailures() << " check(s) failed" << endl;
+  return CheckFailures() ? 1 : 0;
+}
+
+#endif
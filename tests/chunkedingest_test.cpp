@@ -0,0 +1,78 @@
+/**
+ * chunkedingest_test.cpp
+ * Parallel ingest hands records on in the text's order, and an exception from a
+ * parse or consume reaches the caller once every parse thread has stopped.
+ */
+#include <stdexcept>
+#include <string>
+#include "check.hpp"
+#include "../chunkedingest.hpp"
+
+// Parse a chunk of numbered lines; a line "bad" throws, as a record that does not
+// convert would
+static void ParseNumbers(string_view chunk, vector<long> &numbers)
+{
+  while (!chunk.empty())
+  {
+    size_t end = chunk.find('\n');
+    string line(chunk.substr(0, end));
+    chunk.remove_prefix(end == string_view::npos ? chunk.size() : end + 1);
+    numbers.push_back(stol(line));
+  }
+}
+
+int main()
+{
+  const long lines = 200000;
+  string text;
+  for (long i = 0; i < lines; i++)
+    text += to_string(i) + "\n";
+
+  for (size_t threads : { 1, 3, 8 })
+  {
+    long expected = 0;
+    bool ordered = true;
+    ParallelIngest<long>(text, threads, ParseNumbers, [&](vector<long> &numbers) {
+      for (long number : numbers)
+        ordered = ordered && number == expected++;
+    });
+    CHECK(ordered);
+    CHECK(expected == lines);
+  }
+
+  // A bad line halfway through fails the ingest on the calling thread
+  string bad = text;
+  bad.insert(bad.find('\n', bad.size() / 2) + 1, "bad\n");
+  for (size_t threads : { 1, 4 })
+  {
+    bool thrown = false;
+    try
+    {
+      ParallelIngest<long>(bad, threads, ParseNumbers, [](vector<long> &) {});
+    }
+    catch (const invalid_argument &)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+  }
+
+  // So does a consume that throws
+  bool thrown = false;
+  size_t consumed = 0;
+  try
+  {
+    ParallelIngest<long>(text, 4, ParseNumbers, [&](vector<long> &) {
+      if (++consumed == 3)
+        throw runtime_error("consume failed");
+    });
+  }
+  catch (const runtime_error &)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  CHECK(consumed == 3);
+
+  return CheckResult();
+}
@@ -0,0 +1,68 @@
+/**
+ * eventallocs_test.cpp
+ * Runs the wired system over generated feeds of two lengths and checks the event
+ * paths make the same number of heap allocations at both: once the system has
+ * warmed up, events do not allocate. Over-aligned allocations are counted too.
+ */
+#ifndef TRADING_COUNT_ALLOCS
+#define TRADING_COUNT_ALLOCS
+#endif
+#include <filesystem>
+#include "check.hpp"
+#include "../alloccounter.hpp"
+#include "../tradingsystem.hpp"
+#include "../feedgenerator.hpp"
+
+// Generate feeds scale times the base length in a directory of their own, run a
+// fresh system over them there, and get the allocations its event paths made
+static long RunFeeds(const filesystem::path &dir, size_t scale)
+{
+  filesystem::create_directories(dir);
+  filesystem::path home = filesystem::current_path();
+  filesystem::current_path(dir);
+  FeedGeneratorConfig config;
+  config.levelJitter = 16;
+  FeedGenerator generator(FeedGenerator::SyntheticProducts(6), config);
+  generator.WritePrices("price.txt", 600 * scale);
+  generator.WriteTrades("trades.txt", 60 * scale);
+  generator.WriteMarket("market.txt", 120 * scale);
+  generator.WriteInquiries("inquiry.txt", 60 * scale);
+  long before = AllocationCounter::Counted();
+  {
+    // Position and risk keep per-thread scratch, which each worker allocates the first
+    // time it runs a product; with one worker that does not depend on scheduling
+    TradingSystem<Bond> system(1);
+    MappedFeedSource prices("price.txt"), trades("trades.txt"), market("market.txt"), inquiries("inquiry.txt");
+    system.Run(prices, trades, market, inquiries);
+  }
+  long counted = AllocationCounter::Counted() - before;
+  filesystem::current_path(home);
+  cout << scale << "x feeds: " << counted << " event path allocations" << endl;
+  return counted;
+}
+
+// A type the aligned forms of operator new allocate
+struct alignas(128) CacheLines
+{
+  char bytes[256];
+};
+
+int main()
+{
+  {
+    AllocationRegion region;
+    long before = AllocationCounter::Counted();
+    delete new CacheLines();
+    delete[] new CacheLines[2];
+    CHECK(AllocationCounter::Counted() == before + 2);
+  }
+
+  // The first run warms process-wide state, such as the product registry
+  filesystem::path root = filesystem::temp_directory_path() / "eventallocs_test";
+  RunFeeds(root / "warmup", 1);
+  long shorter = RunFeeds(root / "1x", 1);
+  long longer = RunFeeds(root / "10x", 10);
+  CHECK(shorter == longer);
+  filesystem::remove_all(root);
+  return CheckResult();
+}
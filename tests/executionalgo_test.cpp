@@ -0,0 +1,86 @@
+/**
+ * executionalgo_test.cpp
+ * When the execution algo crosses the spread: only when the top of a book moves,
+ * and only when its bid and offer are within two ticks.
+ */
+#include "check.hpp"
+#include "../pricingservice.hpp"
+#include "../executionAlgoservice.hpp"
+
+class OrderCounter : public ServiceListener<ExecutionOrder<Bond>>
+{
+public:
+  size_t orders = 0;
+
+  virtual void ProcessAdd(ExecutionOrder<Bond> &) { orders++; }
+  virtual void ProcessRemove(ExecutionOrder<Bond> &) {}
+  virtual void ProcessUpdate(ExecutionOrder<Bond> &) {}
+};
+
+const int64_t PAR = 100 * TICKS_PER_POINT;
+
+// A level a number of ticks from par
+static Order Level(int64_t ticks, long quantity, PricingSide side)
+{
+  return Order(FixedPrice::FromTicks(PAR + ticks), quantity, side);
+}
+
+// A book of one level a side, its bid and offer given in ticks from par
+static OrderBook<Bond> Book(const Bond &bond, int64_t bid, int64_t offer)
+{
+  vector<Order> bids{ Level(bid, 1000000, BID) };
+  vector<Order> offers{ Level(offer, 1000000, OFFER) };
+  return OrderBook<Bond>(bond, bids, offers);
+}
+
+int main()
+{
+  const Bond &bond = ProductRegistry<Bond>::Instance().Get("EXEC_ALGO");
+  MarketDataService<Bond> marketdata;
+  ExecutionAlgoService<Bond> algo;
+  OrderCounter counter;
+  marketdata.AddTopListener(algo.GetListener());
+  algo.AddListener(&counter);
+
+  // Three ticks apart is left alone
+  OrderBook<Bond> wide = Book(bond, 0, 3);
+  marketdata.OnMessage(wide);
+  CHECK(counter.orders == 0);
+
+  // Exactly two ticks apart sends an order a side
+  OrderBook<Bond> tight = Book(bond, 1, 3);
+  marketdata.OnMessage(tight);
+  CHECK(counter.orders == 2);
+
+  // The same book again leaves the top where it was, so nothing more is crossed
+  marketdata.OnMessage(tight);
+  CHECK(counter.orders == 2);
+
+  // Nor does a level behind the top
+  OrderBookUpdate<Bond> behind(bond, ADD_LEVEL, Level(-1, 1000000, BID));
+  marketdata.OnUpdate(behind);
+  CHECK(counter.orders == 2);
+
+  // A new size at the top moves it, and the book is still tight
+  OrderBookUpdate<Bond> resized(bond, MODIFY_LEVEL, Level(1, 2000000, BID));
+  marketdata.OnUpdate(resized);
+  CHECK(counter.orders == 4);
+
+  // One tick, locked and crossed books are crossed too
+  OrderBook<Bond> onetick = Book(bond, 2, 3);
+  marketdata.OnMessage(onetick);
+  CHECK(counter.orders == 6);
+  OrderBook<Bond> locked = Book(bond, 3, 3);
+  marketdata.OnMessage(locked);
+  CHECK(counter.orders == 8);
+  OrderBook<Bond> crossed = Book(bond, 4, 3);
+  marketdata.OnMessage(crossed);
+  CHECK(counter.orders == 10);
+
+  // Three ticks apart again
+  OrderBook<Bond> reopened = Book(bond, 0, 3);
+  marketdata.OnMessage(reopened);
+  CHECK(counter.orders == 10);
+
+  return CheckResult();
+}
@@ -0,0 +1,59 @@
+/**
+ * followfeed_test.cpp
+ * A followed price file whose last line is still being written: the whole lines
+ * before it reach the service without waiting for its line end.
+ */
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include "check.hpp"
+#include "../pricingservice.hpp"
+#include "../followfeedsource.hpp"
+
+class PriceCounter : public ServiceListener<Price<Bond>>
+{
+public:
+  atomic<size_t> prices{0};
+
+  virtual void ProcessAdd(Price<Bond> &) { prices++; }
+  virtual void ProcessRemove(Price<Bond> &) {}
+  virtual void ProcessUpdate(Price<Bond> &) {}
+};
+
+// Wait up to five seconds for the counter to reach count
+static bool WaitFor(const PriceCounter &counter, size_t count)
+{
+  auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+  while (counter.prices.load() < count && chrono::steady_clock::now() < deadline)
+    this_thread::sleep_for(chrono::milliseconds(1));
+  return counter.prices.load() == count;
+}
+
+int main()
+{
+  const char *path = "followfeed_test.txt";
+  ofstream file(path, ios::trunc);
+  file << "FOLLOW_A,99-160,0-01+\nFOLLOW_B,100-000,0-01+\nFOLLOW_C,100-08+,0-01+\nFOLLOW_D,99-2" << flush;
+
+  FollowFeedSource source(path);
+  CHECK(source.IsOpen());
+  PricingService<Bond> service;
+  PriceCounter counter;
+  service.AddListener(&counter);
+  streambuf *saved = cout.rdbuf(nullptr);
+  thread reader([&] { service.GetConnector()->Subscribe(source); });
+
+  // The three whole lines are delivered while the fourth waits for its line end
+  CHECK(WaitFor(counter, 3));
+
+  file << "40,0-01+\n" << flush;
+  CHECK(WaitFor(counter, 4));
+
+  source.Stop();
+  reader.join();
+  cout.rdbuf(saved);
+  cout.clear();
+  remove(path);
+  return CheckResult();
+}
@@ -0,0 +1,42 @@
+/**
+ * productindex_test.cpp
+ * ProductTable indexing, including indices it must refuse.
+ */
+#include <stdexcept>
+#include "check.hpp"
+#include "../productindex.hpp"
+#include "../products.hpp"
+
+int main()
+{
+  ProductTable<int> table;
+  ProductIndex index = ProductInterner::Intern("PRODUCT_INDEX_TEST");
+  table[index] = 7;
+  CHECK(table.at(index) == 7);
+  CHECK(table.size() == size_t(index) + 1);
+
+  // A default-constructed product has index -1, which must not reach the chunks
+  bool thrown = false;
+  try
+  {
+    table[Bond().GetProductIndex()] = 1;
+  }
+  catch (const out_of_range&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+
+  thrown = false;
+  try
+  {
+    table[ProductIndex(1 << 30)] = 1;
+  }
+  catch (const out_of_range&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  CHECK(table.size() == size_t(index) + 1);
+  return CheckResult();
+}
@@ -0,0 +1,52 @@
+/**
+ * productregistry_test.cpp
+ * Product lookups from several threads at once, and registration that never changes
+ * a product already handed out.
+ */
+#include <thread>
+#include <vector>
+#include <string>
+#include "check.hpp"
+#include "../productregistry.hpp"
+
+int main()
+{
+  ProductRegistry<Bond> &registry = ProductRegistry<Bond>::Instance();
+  const Bond &loaded = registry.Add(Bond("REG_LOADED", CUSIP, "T", 2.5f, date(2030, 1, 1)));
+  CHECK(&registry.Get("REG_LOADED") == &loaded);
+
+  // Registering again keeps the product other threads may hold
+  const Bond &again = registry.Add(Bond("REG_LOADED", CUSIP, "X", 9.0f, date(2040, 1, 1)));
+  CHECK(&again == &loaded);
+  CHECK(loaded.GetTicker() == "T");
+
+  // Threads resolving overlapping identifiers, most of them new, agree on one
+  // product and one index for each
+  const int threads = 4;
+  const int products = 3000;
+  vector<vector<const Bond*>> seen(threads, vector<const Bond*>(products));
+  vector<thread> workers;
+  for (int t = 0; t < threads; t++)
+    workers.emplace_back([&, t] {
+      for (int i = 0; i < products; i++)
+      {
+        int n = (i * 7 + t * 1000) % products;
+        seen[t][n] = &registry.Get("REG_" + to_string(n));
+      }
+    });
+  for (auto &worker : workers)
+    worker.join();
+  for (int i = 0; i < products; i++)
+  {
+    string productId = "REG_" + to_string(i);
+    for (int t = 1; t < threads; t++)
+      CHECK(seen[t][i] == seen[0][i]);
+    CHECK(seen[0][i]->GetProductId() == productId);
+    ProductIndex index = ProductInterner::Find(productId);
+    CHECK(index == seen[0][i]->GetProductIndex());
+    CHECK(ProductInterner::GetProductId(index) == productId);
+  }
+  CHECK(ProductInterner::Find("REG_MISSING") == -1);
+  CHECK(registry.Size() == size_t(products) + 1);
+  return CheckResult();
+}
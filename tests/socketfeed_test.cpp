@@ -0,0 +1,73 @@
+/**
+ * socketfeed_test.cpp
+ * A market feed over a socket whose last book arrives in two writes with a pause
+ * between them: the books before it reach the service during the pause.
+ */
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "check.hpp"
+#include "../pricingservice.hpp"
+#include "../marketdataservice.hpp"
+#include "../socketfeedsource.hpp"
+
+class BookCounter : public ServiceListener<OrderBook<Bond>>
+{
+public:
+  atomic<size_t> books{0};
+
+  virtual void ProcessAdd(OrderBook<Bond> &) { books++; }
+  virtual void ProcessRemove(OrderBook<Bond> &) {}
+  virtual void ProcessUpdate(OrderBook<Bond> &) {}
+};
+
+// Wait up to five seconds for the counter to reach count
+static bool WaitFor(const BookCounter &counter, size_t count)
+{
+  auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+  while (counter.books.load() < count && chrono::steady_clock::now() < deadline)
+    this_thread::sleep_for(chrono::milliseconds(1));
+  return counter.books.load() == count;
+}
+
+// The five lines of a book for a product
+static string Book(const string &productId)
+{
+  string book;
+  const char *levels[] = { "100-281,0-003,1000000", "100-282,0-005,2000000", "100-292,0-007,3000000",
+    "100-300,0-011,4000000", "100-302,0-013,5000000" };
+  for (const char *level : levels)
+    book += productId + "," + level + "\n";
+  return book;
+}
+
+int main()
+{
+  SocketFeedServer server("tcp:127.0.0.1:0");
+  CHECK(server.IsOpen());
+  SocketFeedSource source(server.GetAddress());
+  CHECK(source.IsOpen());
+  CHECK(server.Accept());
+
+  MarketDataService<Bond> service;
+  BookCounter counter;
+  service.AddListener(&counter);
+  streambuf *saved = cout.rdbuf(nullptr);
+  thread reader([&] { service.GetConnector()->Subscribe(source); });
+
+  // Two whole books, then the third cut off in the middle of its last line
+  string third = Book("SOCKET_C");
+  size_t cut = third.size() - 10;
+  CHECK(server.Send(Book("SOCKET_A") + Book("SOCKET_B") + third.substr(0, cut)));
+  this_thread::sleep_for(chrono::milliseconds(50));
+  CHECK(WaitFor(counter, 2));
+
+  CHECK(server.Send(third.substr(cut)));
+  CHECK(WaitFor(counter, 3));
+
+  server.Disconnect();
+  reader.join();
+  cout.rdbuf(saved);
+  cout.clear();
+  return CheckResult();
+}
@@ -0,0 +1,104 @@
+/**
+ * timestamp.hpp
+ * Defines the wall-clock timestamp written in front of every persisted record.
+ */
+#ifndef TIMESTAMP_HPP
+#define TIMESTAMP_HPP
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+// Length of a timestamp, "2018 Mon dd hh:mm:ss.mmm"
+const size_t TIMESTAMP_LENGTH = 24;
+
+// Get the current time in milliseconds since the epoch, as binary records carry it
+inline int64_t timestamp_millis()
+{
+	using namespace chrono;
+	return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// Write a time in milliseconds since the epoch as local "2018 Mon dd hh:mm:ss.mmm"
+// to a buffer of at least TIMESTAMP_LENGTH characters; returns the length written
+inline size_t timestamp_to_chars(char *buffer, int64_t millis)
+{
+	static const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+	// The ingest chains call this from several threads, so use the reentrant
+	// localtime and format by hand instead of sharing asctime's static buffer.
+	// Each thread keeps the text up to the second and only redoes it when the second changes.
+	static thread_local time_t last = -1;
+	static thread_local char seconds[TIMESTAMP_LENGTH + 1];
+	time_t tv = time_t(millis / 1000);
+	if (tv != last)
+	{
+		tm local;
+#ifdef _WIN32
+		localtime_s(&local, &tv);
+#else
+		localtime_r(&tv, &local);
+#endif
+		snprintf(seconds, sizeof(seconds), "2018 %s %2d %02d:%02d:%02d", months[local.tm_mon], local.tm_mday,
+			local.tm_hour, local.tm_min, local.tm_sec);
+		last = tv;
+	}
+	int ms = int(millis % 1000);
+	memcpy(buffer, seconds, TIMESTAMP_LENGTH - 4);
+	buffer[TIMESTAMP_LENGTH - 4] = '.';
+	buffer[TIMESTAMP_LENGTH - 3] = char('0' + ms / 100);
+	buffer[TIMESTAMP_LENGTH - 2] = char('0' + ms / 10 % 10);
+	buffer[TIMESTAMP_LENGTH - 1] = char('0' + ms % 10);
+	return TIMESTAMP_LENGTH;
+}
+
+// Write the current local time as "2018 Mon dd hh:mm:ss.mmm" to a buffer of at
+// least TIMESTAMP_LENGTH characters; returns the length written
+inline size_t timestamp_to_chars(char *buffer)
+{
+	return timestamp_to_chars(buffer, timestamp_millis());
+}
+
+// Read a timestamp written by timestamp_to_chars back into milliseconds since the
+// epoch, taking its year as written; false if it is not in that form
+inline bool timestamp_from_chars(string_view text, int64_t &millis)
+{
+	static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	if (text.size() != TIMESTAMP_LENGTH)
+		return false;
+	char copy[TIMESTAMP_LENGTH + 1];
+	memcpy(copy, text.data(), TIMESTAMP_LENGTH);
+	copy[TIMESTAMP_LENGTH] = 0;
+	char month[4];
+	tm local = tm();
+	int ms;
+	if (sscanf(copy, "%d %3s %d %d:%d:%d.%d", &local.tm_year, month, &local.tm_mday,
+		&local.tm_hour, &local.tm_min, &local.tm_sec, &ms) != 7)
+		return false;
+	const char *found = strstr(months, month);
+	if (!found || (found - months) % 3 != 0)
+		return false;
+	local.tm_mon = int(found - months) / 3;
+	local.tm_year -= 1900;
+	local.tm_isdst = -1;
+	time_t tv = mktime(&local);
+	if (tv == time_t(-1))
+		return false;
+	millis = int64_t(tv) * 1000 + ms;
+	return true;
+}
+
+// Get the current local time as "2018 Mon dd hh:mm:ss.mmm"
+inline string timestamp()
+{
+	char temp[TIMESTAMP_LENGTH];
+	return string(temp, timestamp_to_chars(temp));
+}
+
+#endif
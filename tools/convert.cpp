@@ -0,0 +1,210 @@
+/**
+ * convert.cpp
+ * Converts feed files and historical stores between their text and binary record
+ * formats, in either direction.
+ *
+ * Usage: tradingconvert INPUT OUTPUT [--type TYPE]
+ *
+ * A binary input, recognized by its header, is written out as text in the layout
+ * the system reads or writes. A text input is written out as binary; its TYPE is
+ * one of price, trade, market, update, inquiry, streaming, position, risk, execution,
+ * allinquiries or gui, and is taken from the input's file name (price.txt, trades.txt,
+ * Execution.txt, ...) when --type is not given. Lines that do not parse are
+ * skipped and counted.
+ *
+ * Text timestamps carry no real year, so a history store converted to text and
+ * back keeps its times up to the year.
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include "../pricingservice.hpp"
+#include "../inquiryservice.hpp"
+#include "../binaryrecords.hpp"
+#include "../recordwriter.hpp"
+#include "../timestamp.hpp"
+#include "../recordtext.hpp"
+
+using namespace std;
+
+// Write every text record of the input as a binary record; returns the number of
+// lines skipped
+template<typename R>
+static size_t TextToBinary(FeedSource &input, ofstream &output, size_t &records)
+{
+  RecordHeader header = MakeRecordHeader(R::TYPE, sizeof(R));
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  string_view line;
+  string_view fields[12];
+  R record{};
+  size_t part = 0;
+  size_t skipped = 0;
+  while (input.NextLine(line))
+  {
+    if (line.empty())
+      continue;
+    size_t count = SplitFields(line, ',', fields, 12);
+    if (!RecordText<R>::Parse(fields, count, part, record))
+    {
+      // A bad line spoils the whole record it belongs to
+      skipped += part + 1;
+      part = 0;
+      continue;
+    }
+    if (++part < RecordText<R>::LINES)
+      continue;
+    WriteRecord(output, record);
+    records++;
+    record = R{};
+    part = 0;
+  }
+  return skipped + part;
+}
+
+// Write every binary record of the input as text
+template<typename R>
+static void BinaryToText(FeedSource &input, ofstream &output, size_t &records)
+{
+  RecordReader<R> reader(input);
+  R record;
+  char line[512];
+  RecordWriter out(line, sizeof(line));
+  while (reader.Next(record))
+  {
+    out.Clear();
+    RecordText<R>::Write(record, out);
+    output.write(out.Data(), out.Size());
+    records++;
+  }
+}
+
+// Convert in the direction the input calls for
+template<typename R>
+static size_t Convert(FeedSource &input, bool binary, ofstream &output, size_t &records)
+{
+  if (!binary)
+    return TextToBinary<R>(input, output, records);
+  BinaryToText<R>(input, output, records);
+  return 0;
+}
+
+// Get the record type named on the command line, or implied by a file name
+static bool FindType(string name, RecordType &type)
+{
+  static const struct { const char *name; RecordType type; } types[] = {
+    { "price", PRICE_RECORD }, { "trade", TRADE_RECORD }, { "trades", TRADE_RECORD },
+    { "market", MARKET_RECORD }, { "update", BOOK_UPDATE_RECORD }, { "updates", BOOK_UPDATE_RECORD },
+    { "inquiry", INQUIRY_RECORD }, { "streaming", STREAM_RECORD },
+    { "position", POSITION_RECORD }, { "risk", RISK_RECORD }, { "execution", EXECUTION_RECORD },
+    { "allinquiries", INQUIRY_HISTORY_RECORD }, { "gui", GUI_RECORD } };
+  transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return char(tolower(c)); });
+  for (auto &entry : types)
+    if (name == entry.name)
+    {
+      type = entry.type;
+      return true;
+    }
+  return false;
+}
+
+static void usage()
+{
+  cerr << "usage: tradingconvert INPUT OUTPUT [--type price|trade|market|update|inquiry|streaming|position|risk|execution|allinquiries|gui]\n"
+    "  A binary input is written as text; a text input is written as binary records of TYPE,\n"
+    "  which defaults to the one implied by the input's file name." << endl;
+}
+
+int main(int argc, char **argv)
+{
+  string inputpath, outputpath, typeName;
+  for (int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      usage();
+      return 0;
+    }
+    if (arg == "--type" && i + 1 < argc)
+      typeName = argv[++i];
+    else if (inputpath.empty())
+      inputpath = arg;
+    else if (outputpath.empty())
+      outputpath = arg;
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+  if (inputpath.empty() || outputpath.empty())
+  {
+    usage();
+    return 1;
+  }
+
+  MappedFeedSource input(inputpath);
+  if (!input.IsOpen())
+  {
+    cerr << "cannot open " << inputpath << endl;
+    return 1;
+  }
+
+  RecordHeader header;
+  bool binary = PeekRecordHeader(input, header);
+  RecordType type;
+  if (binary)
+    type = RecordType(header.type);
+  else
+  {
+    string stem = typeName;
+    if (stem.empty())
+    {
+      size_t slash = inputpath.find_last_of("/\\");
+      stem = inputpath.substr(slash == string::npos ? 0 : slash + 1);
+      stem = stem.substr(0, stem.find('.'));
+    }
+    if (!FindType(stem, type))
+    {
+      cerr << "cannot tell the record type of " << inputpath << "; give --type" << endl;
+      return 1;
+    }
+  }
+
+  ofstream output(outputpath, binary ? ios::out : ios::out | ios::binary);
+  if (!output)
+  {
+    cerr << "cannot create " << outputpath << endl;
+    return 1;
+  }
+
+  size_t records = 0;
+  size_t skipped = 0;
+  switch (type)
+  {
+  case PRICE_RECORD: skipped = Convert<PriceRecord>(input, binary, output, records); break;
+  case TRADE_RECORD: skipped = Convert<TradeRecord>(input, binary, output, records); break;
+  case MARKET_RECORD: skipped = Convert<MarketRecord>(input, binary, output, records); break;
+  case INQUIRY_RECORD: skipped = Convert<InquiryRecord>(input, binary, output, records); break;
+  case STREAM_RECORD: skipped = Convert<StreamRecord>(input, binary, output, records); break;
+  case POSITION_RECORD: skipped = Convert<PositionRecord>(input, binary, output, records); break;
+  case RISK_RECORD: skipped = Convert<RiskRecord>(input, binary, output, records); break;
+  case EXECUTION_RECORD: skipped = Convert<ExecutionRecord>(input, binary, output, records); break;
+  case INQUIRY_HISTORY_RECORD: skipped = Convert<InquiryHistoryRecord>(input, binary, output, records); break;
+  case GUI_RECORD: skipped = Convert<GuiRecord>(input, binary, output, records); break;
+  case BOOK_UPDATE_RECORD: skipped = Convert<BookUpdateRecord>(input, binary, output, records); break;
+  default:
+    cerr << inputpath << " holds unknown record type " << header.type << endl;
+    return 1;
+  }
+
+  cout << records << " records written to " << outputpath << (binary ? " as text" : " as binary");
+  if (skipped > 0)
+    cout << ", " << skipped << " lines skipped";
+  cout << endl;
+  return output ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/**
+ * feedsim.cpp
+ * Serves a market data feed over a socket at a set rate, standing in for an exchange
+ * so the system's socket path can be run and measured locally.
+ *
+ * Usage: tradingfeedsim [--listen ADDRESS] [--file PATH] [--rate N] [--loops N]
+ *                       [--batch N] [--spin US]
+ *
+ * The feed is read from --file (market.txt by default), a text feed of one order
+ * book level per line, and written to the first client to connect at --listen, an
+ * address such as unix:/tmp/market.sock or tcp:127.0.0.1:9000. Lines go out at --rate
+ * lines a second, or as fast as the client takes them with rate 0; lines that are
+ * due together go in one write of up to --batch lines. The file is sent --loops
+ * times, or until the client disconnects with loops 0, and the connection is then
+ * closed, which ends the client's feed. Run the system with --market ADDRESS to read
+ * from it.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <csignal>
+#include "../socketfeedsource.hpp"
+#include "../replay.hpp"
+
+using namespace std;
+
+static void usage()
+{
+  cerr << "usage: tradingfeedsim [--listen ADDRESS] [--file PATH] [--rate N] [--loops N]\n"
+    "                      [--batch N] [--spin US]\n"
+    "  Serves PATH (default market.txt) to one client at ADDRESS (default\n"
+    "  unix:market.sock) at N lines a second (0 for as fast as possible)." << endl;
+}
+
+int main(int argc, char **argv)
+{
+  string address = "unix:market.sock";
+  string path = "market.txt";
+  double rate = 100000;
+  unsigned long long loops = 1;
+  size_t batch = 256;
+  long long spin = 100;
+  for (int i = 1; i < argc; i++)
+  {
+    string option = argv[i];
+    if (option == "--help" || option == "-h" || i + 1 >= argc)
+    {
+      usage();
+      return option == "--help" || option == "-h" ? 0 : 1;
+    }
+    string value = argv[++i];
+    try
+    {
+      if (option == "--listen") address = value;
+      else if (option == "--file") path = value;
+      else if (option == "--rate") rate = stod(value);
+      else if (option == "--loops") loops = stoull(value);
+      else if (option == "--batch") batch = stoull(value);
+      else if (option == "--spin") spin = stoll(value);
+      else
+      {
+        usage();
+        return 1;
+      }
+    }
+    catch (const exception&)
+    {
+      cerr << "bad value for " << option << ": " << value << endl;
+      return 1;
+    }
+  }
+  if (batch == 0)
+    batch = 1;
+
+  // The whole feed is held in memory with the offset of each line, so a run of lines
+  // is sent straight from it
+  ifstream file(path, ios::binary);
+  if (!file)
+  {
+    cerr << "cannot read " << path << endl;
+    return 1;
+  }
+  stringstream contents;
+  contents << file.rdbuf();
+  string feed = contents.str();
+  if (!feed.empty() && feed.back() != '\n')
+    feed += '\n';
+  vector<size_t> starts;
+  for (size_t offset = 0; offset < feed.size(); offset = feed.find('\n', offset) + 1)
+    starts.push_back(offset);
+  starts.push_back(feed.size());
+  size_t lines = starts.size() - 1;
+  if (lines == 0)
+  {
+    cerr << path << " is empty" << endl;
+    return 1;
+  }
+
+#ifdef SIGPIPE
+  // A client that goes away fails the write instead of ending the process
+  signal(SIGPIPE, SIG_IGN);
+#endif
+  SocketFeedServer server(address);
+  if (!server.IsOpen())
+  {
+    cerr << "cannot listen at " << address << endl;
+    return 1;
+  }
+  cout << "serving " << lines << " lines of " << path << " at " << server.GetAddress() << endl;
+  if (!server.Accept())
+  {
+    cerr << "accept failed" << endl;
+    return 1;
+  }
+
+  // Line n of the run is due n / rate seconds after the start
+  ReplayClock clock(rate > 0 ? 1 : 0);
+  clock.SetSpin(chrono::microseconds(spin));
+  clock.Start(0);
+  LatencyHistogram lateness;
+  unsigned long long sent = 0;
+  auto start = chrono::steady_clock::now();
+  bool connected = true;
+  for (unsigned long long loop = 0; connected && (loops == 0 || loop < loops); loop++)
+  {
+    for (size_t line = 0; connected && line < lines; )
+    {
+      if (rate > 0)
+        lateness.Record(uint64_t(clock.WaitUntilElapsed(chrono::nanoseconds((long long)(double(sent) * 1e9 / rate))).count()));
+      // Everything due by now goes in one write
+      size_t due = rate > 0
+        ? size_t(chrono::duration<double>(chrono::steady_clock::now() - start).count() * rate) + 1
+        : sent + batch;
+      size_t count = due > sent ? due - size_t(sent) : 1;
+      count = min(count, min(batch, lines - line));
+      connected = server.Send(string_view(feed.data() + starts[line], starts[line + count] - starts[line]));
+      line += count;
+      sent += count;
+    }
+  }
+  server.Disconnect();
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  cout << sent << " lines in " << seconds << " s (" << (seconds > 0 ? double(sent) / seconds : 0) << " a second)";
+  if (rate > 0)
+    cout << "; late by p50 " << lateness.GetPercentile(50) << " ns, p99 " << lateness.GetPercentile(99) << " ns";
+  cout << endl;
+  if (!connected)
+    cout << "the client disconnected" << endl;
+  return 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * generate.cpp
+ * Writes synthetic price, trade, market and inquiry feeds, and reference data for
+ * their products, of any size.
+ *
+ * Usage: tradinggenerate [--products N] [--prices N] [--trades N] [--books N]
+ *                        [--updates N] [--inquiries N] [--depth N] [--volatility X]
+ *                        [--reversion X] [--jitter X] [--skew X] [--trade-buys X]
+ *                        [--inquiry-buys X] [--seed N] [--threads N] [--binary] [--dir PATH]
+ *
+ * The feeds are written to price.txt, trades.txt, market.txt and inquiry.txt under
+ * --dir, as text or, with --binary, as binary records under the same names, and the
+ * products' reference data to bonds.txt there. With --updates, the level updates of
+ * that many book moves are written to updates.txt, an incremental market feed.
+ * Products are named B00000 upwards. The same options always write the same files, whatever --threads is.
+ */
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <filesystem>
+#include "../feedgenerator.hpp"
+
+using namespace std;
+
+static void usage()
+{
+  cerr << "usage: tradinggenerate [--products N] [--prices N] [--trades N] [--books N]\n"
+    "                       [--updates N] [--inquiries N] [--depth N] [--volatility X]\n"
+    "                       [--reversion X] [--jitter X] [--skew X] [--trade-buys X]\n"
+    "                       [--inquiry-buys X] [--seed N] [--threads N] [--binary] [--dir PATH]\n"
+    "  Writes price.txt, trades.txt, market.txt (--books books of --depth levels),\n"
+    "  inquiry.txt and bonds.txt under --dir, and updates.txt with --updates;\n"
+    "  --binary writes the feeds as binary records." << endl;
+}
+
+int main(int argc, char **argv)
+{
+  FeedGeneratorConfig config;
+  config.threads = thread::hardware_concurrency();
+  size_t products = 1000;
+  size_t prices = 1000000;
+  size_t trades = 100000;
+  size_t books = 200000;
+  size_t updates = 0;
+  size_t inquiries = 100000;
+  string dir = ".";
+  for (int i = 1; i < argc; i++)
+  {
+    string option = argv[i];
+    if (option == "--help" || option == "-h")
+    {
+      usage();
+      return 0;
+    }
+    if (option == "--binary")
+    {
+      config.format = BINARY_RECORDS;
+      continue;
+    }
+    if (i + 1 >= argc)
+    {
+      usage();
+      return 1;
+    }
+    string value = argv[++i];
+    try
+    {
+      if (option == "--products") products = stoull(value);
+      else if (option == "--prices") prices = stoull(value);
+      else if (option == "--trades") trades = stoull(value);
+      else if (option == "--books") books = stoull(value);
+      else if (option == "--updates") updates = stoull(value);
+      else if (option == "--inquiries") inquiries = stoull(value);
+      else if (option == "--depth") config.depth = stoull(value);
+      else if (option == "--volatility") config.volatility = stod(value);
+      else if (option == "--reversion") config.reversion = stod(value);
+      else if (option == "--jitter") config.levelJitter = stod(value);
+      else if (option == "--skew") config.skew = stod(value);
+      else if (option == "--trade-buys") config.tradeBuyShare = stod(value);
+      else if (option == "--inquiry-buys") config.inquiryBuyShare = stod(value);
+      else if (option == "--seed") config.seed = stoull(value);
+      else if (option == "--threads") config.threads = stoull(value);
+      else if (option == "--dir") dir = value;
+      else
+      {
+        usage();
+        return 1;
+      }
+    }
+    catch (const exception&)
+    {
+      cerr << "bad value for " << option << ": " << value << endl;
+      return 1;
+    }
+  }
+
+  filesystem::create_directories(dir);
+  FeedGenerator generator(FeedGenerator::SyntheticProducts(products), config);
+  auto start = chrono::steady_clock::now();
+  generator.WriteReference(dir + "/bonds.txt");
+  generator.WritePrices(dir + "/price.txt", prices);
+  generator.WriteTrades(dir + "/trades.txt", trades);
+  generator.WriteMarket(dir + "/market.txt", books);
+  generator.WriteInquiries(dir + "/inquiry.txt", inquiries);
+  size_t levels = updates ? generator.WriteMarketUpdates(dir + "/updates.txt", updates) : 0;
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  uintmax_t bytes = 0;
+  for (const char *name : { "price.txt", "trades.txt", "market.txt", "inquiry.txt" })
+    bytes += filesystem::file_size(dir + "/" + name);
+  if (updates)
+    bytes += filesystem::file_size(dir + "/updates.txt");
+  cout << prices + trades + books * config.depth + levels + inquiries << " lines, " << bytes << " bytes in "
+    << seconds << " s" << endl;
+  return 0;
+}
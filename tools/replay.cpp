@@ -0,0 +1,161 @@
+/**
+ * replay.cpp
+ * Replays recorded historical stores into a freshly wired trading system, paced by
+ * the times they were recorded at.
+ *
+ * Usage: tradingreplay --from DIR [--speed X|max] [--spin US]
+ *                      [--stores gui,streaming,position,inquiry,execution]
+ *
+ * Each store is read from DIR as NAME.txt, or NAME.bin when there is no text store:
+ * gui prices go to the pricing service, streams to the streaming service, positions
+ * as the trades that made them to trade booking, inquiries to the inquiry service
+ * and executions to the execution service. The stores default to all but execution,
+ * whose trades the positions already hold. Speed 1 keeps the recorded gaps, N
+ * replays N times faster and max does not wait at all.
+ *
+ * The system writes its own historical stores to the current directory, which must
+ * not be DIR, and reads reference data from bonds.txt there. At the end the replay
+ * reports how late events were delivered against the schedule, and the latency of
+ * every path from a replayed store to its sinks.
+ */
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include "../tradingsystem.hpp"
+#include "../replay.hpp"
+#include "../latency.hpp"
+
+using namespace std;
+
+static void usage()
+{
+  cerr << "usage: tradingreplay --from DIR [--speed X|max] [--spin US]\n"
+    "                     [--stores gui,streaming,position,inquiry,execution]\n"
+    "  Replays DIR's recorded stores into the services at X times the recorded pace\n"
+    "  (default 1), writing new stores to the current directory." << endl;
+}
+
+// Open NAME.txt in dir, or NAME.bin; null if neither is there
+static unique_ptr<MappedFeedSource> OpenStore(const string &dir, const string &name)
+{
+  for (const char *extension : { ".txt", ".bin" })
+  {
+    string path = dir + "/" + name + extension;
+    if (!filesystem::exists(path))
+      continue;
+    unique_ptr<MappedFeedSource> source(new MappedFeedSource(path));
+    if (source->IsOpen())
+      return source;
+  }
+  return nullptr;
+}
+
+int main(int argc, char **argv)
+{
+  string dir;
+  double speed = 1;
+  long long spin = 100;
+  string stores = "gui,streaming,position,inquiry";
+  for (int i = 1; i < argc; i++)
+  {
+    string option = argv[i];
+    if (option == "--help" || option == "-h" || i + 1 >= argc)
+    {
+      usage();
+      return option == "--help" || option == "-h" ? 0 : 1;
+    }
+    string value = argv[++i];
+    try
+    {
+      if (option == "--from") dir = value;
+      else if (option == "--speed") speed = value == "max" ? 0 : stod(value);
+      else if (option == "--spin") spin = stoll(value);
+      else if (option == "--stores") stores = value;
+      else
+      {
+        usage();
+        return 1;
+      }
+    }
+    catch (const exception&)
+    {
+      cerr << "bad value for " << option << ": " << value << endl;
+      return 1;
+    }
+  }
+  if (dir.empty())
+  {
+    usage();
+    return 1;
+  }
+  error_code ignored;
+  if (filesystem::equivalent(dir, ".", ignored))
+  {
+    cerr << "replay from another directory than the one the system writes to" << endl;
+    return 1;
+  }
+
+  ifstream bondfile("bonds.txt");
+  ProductRegistry<Bond>::Instance().Load(bondfile);
+  TradingSystem<Bond> system;
+  ReplayEngine engine(speed);
+  engine.SetSpin(chrono::microseconds(spin));
+
+  // The sources must outlive the replay
+  vector<unique_ptr<MappedFeedSource>> sources;
+  stringstream list(stores);
+  string store;
+  while (getline(list, store, ','))
+  {
+    static const struct { const char *store; const char *file; } files[] = {
+      { "gui", "gui" }, { "streaming", "streaming" }, { "position", "position" },
+      { "inquiry", "allinquiries" }, { "execution", "Execution" } };
+    const char *file = nullptr;
+    for (auto &entry : files)
+      if (store == entry.store)
+        file = entry.file;
+    if (!file)
+    {
+      cerr << "unknown store " << store << endl;
+      return 1;
+    }
+    unique_ptr<MappedFeedSource> source = OpenStore(dir, file);
+    if (!source)
+    {
+      cerr << "no " << file << " store in " << dir << "; skipped" << endl;
+      continue;
+    }
+    if (store == "gui")
+      engine.Add(MakeGuiReplay(*source, system.GetPricingService()));
+    else if (store == "streaming")
+      engine.Add(MakeStreamingReplay(*source, system.GetStreamingService()));
+    else if (store == "position")
+      engine.Add(MakePositionReplay(*source, system.GetTradeBookingService()));
+    else if (store == "inquiry")
+      engine.Add(MakeInquiryReplay(*source, system.GetInquiryService()));
+    else
+      engine.Add(MakeExecutionReplay(*source, system.GetExecutionService()));
+    sources.push_back(move(source));
+  }
+
+  LatencyTracer::Instance().Reset();
+  auto start = chrono::steady_clock::now();
+  {
+    // The GUI prints a count per price
+    streambuf *saved = cout.rdbuf(nullptr);
+    engine.Run();
+    system.Drain();
+    cout.rdbuf(saved);
+    cout.clear();
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  const LatencyHistogram &lateness = engine.GetLateness();
+  cout << engine.GetEvents() << " events in " << seconds << " s; late by p50 " << lateness.GetPercentile(50)
+    << " ns, p99 " << lateness.GetPercentile(99) << " ns, max " << lateness.GetMax() << " ns" << endl;
+  LatencyTracer::Instance().Report(cout);
+  return 0;
+}
@@ -9,8 +9,13 @@
 
 #include <string>
 #include <vector>
+#include <mutex>
 #include "soa.hpp"
 #include "executionservice.hpp"
+#include "productregistry.hpp"
+#include "alloccounter.hpp"
+#include "latency.hpp"
+#include "binaryrecords.hpp"
 
 // Trade sides
 enum Side { BUY, SELL };
@@ -36,7 +41,7 @@ class Trade
 public:
 
   // ctor for a trade
-  Trade(const T &_product, string _tradeId, double _price, string _book, long _quantity, Side _side);
+  Trade(const T &_product, string _tradeId, FixedPrice _price, string _book, long _quantity, Side _side);
   Trade() = default;
   // Get the product
   const T& GetProduct() const;
@@ -45,7 +50,7 @@ public:
   const string& GetTradeId() const;
 
   // Get the mid price
-  double GetPrice() const;
+  FixedPrice GetPrice() const;
 
   // Get the book
   const string& GetBook() const;
@@ -57,11 +62,11 @@ public:
   Side GetSide() const;
 
 private:
-  T product;
+  const T *product = nullptr;
   string tradeId;
-  double price;
   string book;
   long quantity;
+  FixedPrice price;
   Side side;
 
 };
@@ -72,37 +77,71 @@ template<typename T>
 class TradeBookingConnector :public Connector<Trade<T>> {
 private:
 	TradeBookingService<T>* service;
+	size_t batchSize;
 public:
 	TradeBookingConnector(TradeBookingService<T>* s) {
 		service = s;
+		batchSize = 64;
 	}
 	~TradeBookingConnector(){}
+
+	// Set the number of trades booked per block
+	void SetBatchSize(size_t size) {
+		batchSize = size;
+	}
+
 	virtual void Publish(Trade<T> &data) {}
-	virtual void Subscribe(ifstream& file) {
-		string line;
-		stringstream linestream;
+	using Connector<Trade<T>>::Subscribe;
+
+	// Read trades, one per line: productId,tradeId,price,quantity,book,side, or as
+	// TradeRecords
+	virtual void Subscribe(FeedSource& source) {
+		static const LatencyPoint feed("trade feed");
+		RecordReader<TradeRecord> binary(source);
+		TradeRecord record;
+		string_view line;
+		string_view component[6];
+		vector<Trade<T>> block;
+		block.reserve(batchSize);
 		cout << "trades data loading......" << endl;
-		while (getline(file, line))
+		while (binary ? binary.Next(record) : source.NextLine(line))
 		{
-			linestream.clear();
-			linestream.str(line);
-			string temp;
-			vector<string> component;
-			while (getline(linestream, temp, ','))
-				component.push_back(temp);
-			
-			
-			double price = convert(component[2]);
-			string book = component[4];
-			Side side;
-			if (component[5] == "BUY")
-				side = BUY;
+			// A block is as old as its first line
+			if (block.empty())
+				LatencyTrace::Begin(feed);
+			if (binary)
+			{
+				const T &bond = ProductRegistry<T>::Instance().Get(GetRecordText(record.productId));
+				Side side = record.side == BUY ? BUY : SELL;
+				block.push_back(Trade<T>(bond, string(GetRecordText(record.tradeId)), FixedPrice::FromDouble(record.price),
+					string(GetRecordText(record.book)), long(record.quantity), side));
+			}
 			else
-				side = SELL;
-			date d(2018, Nov, 25);
-			T bond(component[0], CUSIP, "T", 0, d);
-			Trade<T> data(bond, component[1], price, book, stol(component[3]), side);
-			service->BookTrade(data);
+			{
+				if (SplitFields(line, ',', component, 6) < 6)
+					continue;
+
+				FixedPrice price = ConvertPrice(component[2]);
+				string book(component[4]);
+				Side side;
+				if (component[5] == "BUY")
+					side = BUY;
+				else
+					side = SELL;
+				const T &bond = ProductRegistry<T>::Instance().Get(component[0]);
+				block.push_back(Trade<T>(bond, string(component[1]), price, book, ParseLong(component[3]), side));
+			}
+			if (block.size() >= batchSize || !(binary ? binary.Ready() : source.Ready()))
+			{
+				AllocationRegion region;
+				service->BookTradeBatch(block.data(), block.size());
+				block.clear();
+			}
+		}
+		if (!block.empty())
+		{
+			AllocationRegion region;
+			service->BookTradeBatch(block.data(), block.size());
 		}
 		cout << "trades data loaded!" << endl;
 
@@ -124,20 +163,23 @@ class TradeToOrderListener;
 /**
  * Trade Booking Service to book trades to a particular book.
  * Keyed on trade id.
+ * Trades arrive both from the trade feed and from executions, so booking is
+ * serialized; listeners are notified under the same lock to keep them in booking order.
  * Type T is the product type.
  */
 template<typename T>
 class TradeBookingService : public Service<string,Trade <T> >
 {
 private:
-	map<string, Trade<T>> book;
+	ProductTable<Trade<T>> book;
 	TradeBookingConnector<T>* connector;
 	vector<ServiceListener<Trade<T>>*> listeners;
 	TradeToOrderListener<T>* listener;
+	mutex lock;
 
 public:
 	TradeBookingService() {
-		book = map<string, Trade<T>>();
+		book = ProductTable<Trade<T>>();
 		connector = new TradeBookingConnector<T>(this);
 		listeners = vector<ServiceListener<Trade<T>>*>();
 		listener = new TradeToOrderListener<T>(this);
@@ -153,15 +195,34 @@ public:
 	// Get data on our service given a key
 	virtual Trade<T>& GetData(string key)
 	{
+		lock_guard<mutex> guard(lock);
 		return book[key];
 	}
 
   // Book the trade
 	void BookTrade( Trade<T>& trade) {
-		book[trade.GetProduct().GetProductId()] = trade;
+		static const LatencyPoint hop("trade booking");
+		static const LatencyPoint sink("trade booked");
+		LatencyHop trace(hop);
+		LatencyTrace::End(sink);
+		lock_guard<mutex> guard(lock);
+		book[trade.GetProduct().GetProductIndex()] = trade;
 		for (auto& l : listeners)
 			l->ProcessAdd(trade);
   }
+
+  // Book a block of trades and hand the whole block to the listeners
+	void BookTradeBatch(Trade<T>* trades, size_t count) {
+		static const LatencyPoint hop("trade booking");
+		static const LatencyPoint sink("trade booked");
+		LatencyHop trace(hop);
+		LatencyTrace::End(sink);
+		lock_guard<mutex> guard(lock);
+		for (size_t i = 0; i < count; i++)
+			book[trades[i].GetProduct().GetProductIndex()] = trades[i];
+		for (auto& l : listeners)
+			l->ProcessAddBatch(trades, count);
+  }
 	virtual void AddListener(ServiceListener<Trade<T>> *listener)
 	{
 		listeners.push_back(listener);
@@ -243,8 +304,8 @@ public:
 
 
 template<typename T>
-Trade<T>::Trade(const T &_product, string _tradeId, double _price, string _book, long _quantity, Side _side) :
-  product(_product)
+Trade<T>::Trade(const T &_product, string _tradeId, FixedPrice _price, string _book, long _quantity, Side _side) :
+  product(&_product)
 {
   tradeId = _tradeId;
   price = _price;
@@ -256,7 +317,7 @@ Trade<T>::Trade(const T &_product, string _tradeId, double _price, string _book,
 template<typename T>
 const T& Trade<T>::GetProduct() const
 {
-  return product;
+  return *product;
 }
 
 template<typename T>
@@ -266,7 +327,7 @@ const string& Trade<T>::GetTradeId() const
 }
 
 template<typename T>
-double Trade<T>::GetPrice() const
+FixedPrice Trade<T>::GetPrice() const
 {
   return price;
 }
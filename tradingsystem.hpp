@@ -0,0 +1,172 @@
+/**
+ * tradingsystem.hpp
+ * Defines the fully wired set of services that main() and the benchmarks run.
+ */
+#ifndef TRADING_SYSTEM_HPP
+#define TRADING_SYSTEM_HPP
+
+#include <thread>
+#include "pricingservice.hpp"
+#include "guiservice.hpp"
+#include "streamingAlgoservice.hpp"
+#include "historicaldataservice.hpp"
+#include "executionAlgoservice.hpp"
+#include "asynclistener.hpp"
+#include "pipeline.hpp"
+#include "scheduler.hpp"
+#include "feedsource.hpp"
+
+using namespace std;
+
+/**
+ * Every service of the trading system, wired together:
+ *   prices -> GUI, and prices -> streaming algo -> streaming -> history
+ *   trades -> booking -> position -> risk -> history
+ *   market data (books and level updates) -> execution algo -> execution -> history and booking
+ *   inquiries -> history
+ * Reference data must be loaded into the ProductRegistry before construction.
+ * Type T is the product type.
+ */
+template<typename T>
+class TradingSystem
+{
+
+public:
+
+  // ctor for a system whose position and risk run on the given number of workers
+  explicit TradingSystem(size_t workers = thread::hardware_concurrency());
+
+  // Run the four feeds to completion, each on its own thread, and drain every
+  // asynchronous edge. Call once.
+  void Run(FeedSource &pricefeed, FeedSource &tradefeed, FeedSource &marketfeed, FeedSource &inquiryfeed);
+
+  // Get the services at the head of each chain
+  PricingService<T>& GetPricingService() { return pricingservice; }
+  TradeBookingService<T>& GetTradeBookingService() { return tradebookingservice; }
+  MarketDataService<T>& GetMarketDataService() { return marketdataservice; }
+  InquiryService<T>& GetInquiryService() { return inquiryservice; }
+
+  // Get the position and risk services
+  PositionService<T>& GetPositionService() { return positionservice; }
+  RiskService<T>& GetRiskService() { return riskservice; }
+
+  // Get the services a replay publishes streams and executions through
+  StreamingService<T>& GetStreamingService() { return streamingservice; }
+  ExecutionService<T>& GetExecutionService() { return executionservice; }
+
+  // Wait for the asynchronous edges to finish what the services have been given,
+  // after driving the services directly rather than through Run. Call once.
+  void Drain();
+
+  // Set whether every historical store is written as text (*.txt) or binary (*.bin)
+  void SetHistoryFormat(RecordFormat format);
+
+private:
+  PricingService<T> pricingservice;
+  GuiService<T> guiservice;
+  StreamingAlgoService<T> streamingalgoservice;
+  StreamingService<T> streamingservice;
+
+  TradeBookingService<T> tradebookingservice;
+  PositionService<T> positionservice;
+  RiskService<T> riskservice;
+
+  MarketDataService<T> marketdataservice;
+  ExecutionService<T> executionservice;
+  ExecutionAlgoService<T> executionalgoservice;
+
+  InquiryService<T> inquiryservice;
+
+  HistoricalDataServiceStream<T> historicaldataservicestream;
+  HistoricalDataServicePosition<T> historicaldataserviceposition;
+  HistoricalDataServiceRisk<T> historicaldataservicerisk;
+  HistoricalDataServiceExecution<T> historicaldataserviceexecution;
+  HistoricalDataServiceInquiry<T> historicaldataserviceinquiry;
+
+  // Per-product workers for the booking -> position -> risk chain
+  ProductScheduler scheduler;
+
+  // The GUI throttles its output, so it runs on its own thread behind an async edge
+  // and the streaming path never waits on it.
+  AsyncListener<Price<T>> guiedge;
+
+  // price -> stream -> persist is fixed, so it is composed at compile time.
+  // The equivalent runtime wiring is
+  //   pricingservice.AddListener(streamingalgoservice.GetListener());
+  //   streamingalgoservice.AddListener(streamingservice.GetListener());
+  //   streamingservice.AddListener(historicaldataservicestream.GetListener());
+  StaticPipeline<Price<T>, StreamingAlgoListener<T>, StreamingListener<T>, HisToStreamingListener<T>> streampipeline;
+
+  // Booked trades are sharded by product: each product's trades are applied in
+  // booking order on one worker at a time, and position -> risk runs on that
+  // same worker, so different products are positioned and risked in parallel.
+  ShardedListener<Trade<T>> positionedge;
+
+};
+
+template<typename T>
+TradingSystem<T>::TradingSystem(size_t workers) :
+  scheduler(workers),
+  guiedge(guiservice.GetListener()),
+  streampipeline(*streamingalgoservice.GetListener(), *streamingservice.GetListener(), *historicaldataservicestream.GetListener()),
+  positionedge(positionservice.GetListener(), scheduler)
+{
+  pricingservice.AddListener(&guiedge);
+  pricingservice.AddListener(&streampipeline);
+  // The pipeline persists streams without going through PublishPrice; streams
+  // published straight to the streaming service, as in a replay, are persisted here
+  streamingservice.AddListener(historicaldataservicestream.GetListener());
+
+  tradebookingservice.AddListener(&positionedge);
+  positionservice.AddListener(historicaldataserviceposition.GetListener());
+  positionservice.AddListener(riskservice.GetListener());
+
+  riskservice.AddListener(historicaldataservicerisk.GetListener());
+  riskservice.AddListenerB(historicaldataservicerisk.GetListenerB());
+
+  // Books cover three points either side of their first price, so updates within
+  // them do not reallocate ladders
+  marketdataservice.SetReservedTicks(3 * TICKS_PER_POINT);
+  // The execution algo only trades on the top of book, from books and updates alike
+  marketdataservice.AddTopListener(executionalgoservice.GetListener());
+  executionalgoservice.AddListener(executionservice.GetListener());
+  executionservice.AddListener(historicaldataserviceexecution.GetListener());
+  executionservice.AddListener(tradebookingservice.GetListener());
+
+  inquiryservice.AddListener(historicaldataserviceinquiry.GetListener());
+}
+
+template<typename T>
+void TradingSystem<T>::SetHistoryFormat(RecordFormat format)
+{
+  historicaldataservicestream.SetFormat(format);
+  historicaldataserviceposition.SetFormat(format);
+  historicaldataservicerisk.SetFormat(format);
+  historicaldataserviceexecution.SetFormat(format);
+  historicaldataserviceinquiry.SetFormat(format);
+}
+
+template<typename T>
+void TradingSystem<T>::Run(FeedSource &pricefeed, FeedSource &tradefeed, FeedSource &marketfeed, FeedSource &inquiryfeed)
+{
+  // Each feed runs on its own thread. The chains only meet at trade booking
+  // (trades and executions from market data), which serializes its producers.
+  thread pricethread([&] { pricingservice.GetConnector()->Subscribe(pricefeed); });
+  thread tradethread([&] { tradebookingservice.GetConnector()->Subscribe(tradefeed); });
+  thread marketthread([&] { marketdataservice.GetConnector()->Subscribe(marketfeed); });
+  thread inquirythread([&] { inquiryservice.GetConnector()->Subscribe(inquiryfeed); });
+  pricethread.join();
+  tradethread.join();
+  marketthread.join();
+  inquirythread.join();
+  Drain();
+}
+
+template<typename T>
+void TradingSystem<T>::Drain()
+{
+  scheduler.Wait();
+  guiedge.Stop();
+}
+
+#endif